@@ -2,65 +2,36 @@
 #include <cstdlib>
 #include <cstring>
 #include <cassert>
+#include <ctime>
 
 #include <SDL.h>
 #include <SDL_ttf.h>
 #include <SDL_image.h>
 #include <SDL_mixer.h>
 
-typedef uint8_t u8;
-typedef uint16_t u16;
-typedef uint32_t u32;
-typedef int8_t s8;
-typedef int16_t s16;
-typedef int32_t s32;
-
+#include "game.h"
 #include "colors.h"
-
-//Define board sizes
-#define WIDTH 10
-#define HEIGHT 22
-#define VISIBLE_HEIGHT 20
+#include "delta_stream.h"
+#include "bot.h"
+#include "corpus.h"
+#include "triple_buffer.h"
+#include "render_snapshot.h"
+#include "shared_state.h"
+#include "rewind.h"
+
+#ifdef TETRIS_ALLOC_STATS
+#include "alloc_stats.h"
+#else
+#define ALLOC_SCOPE(subsystem)
+#endif
 
 #define GRID_SIZE 30
 
-#define ARRAY_COUNT(x) (sizeof(x) / sizeof((x)[0]))
-
 const int FPS=60;
 const float frame_delay=1000/FPS;
 
-const u8 FRAMES_PER_DROP[] = {
-    48,
-    43,
-    38,
-    33,
-    28,
-    23,
-    18,
-    13,
-    8,
-    6,
-    5,
-    5,
-    5,
-    4,
-    4,
-    4,
-    3,
-    3,
-    3,
-    2,
-    2,
-    2,
-    2,
-    2,
-    2,
-    2,
-    2,
-    2,
-    2,
-    1
-};
+//Ticks the simulation catches up on after a stall before it drops the rest
+#define MAX_TICKS_BEHIND 5
 
     Mix_Music *music;
     Mix_Chunk *increaseLVL;
@@ -75,602 +46,230 @@ const u8 FRAMES_PER_DROP[] = {
     Mix_Chunk *pause_sfx;
     Mix_Chunk *gameover;
 
+//Spectator and overlay feed, encodes nothing until someone subscribes
+Delta_Encoder delta_encoder;
 
+//Autoplay, toggled with B; the search is only set up the first time it is used
+Bot_Player bot_player;
 
+//Printable ASCII prerendered into one texture, so drawing text allocates nothing
+#define GLYPH_FIRST 32
+#define GLYPH_LAST 126
 
-//Convert from frames to seconds
-const float TARGET_SECONDS_PER_FRAME = 1.f / 60.f;
-
-struct Tetromino
+struct Glyph_Atlas
 {
-    const u8 *data;
-    const int side;
-};
-
-Tetromino tetromino(const u8 *data, int side)
-{
-    return { data, side };
-}
-
-const u8 TETROMINO_DEFAULT[] = {
-    0, 0, 0, 0,
-    0, 0, 0, 0,
-    0, 0, 0, 0,
-    0, 0, 0, 0
-};
-
-//I-shaped tetromino
-const u8 TETROMINO_1[] = {
-    0, 0, 0, 0,
-    1, 1, 1, 1,
-    0, 0, 0, 0,
-    0, 0, 0, 0
-};
-
-//O-shaped tetromino
-const u8 TETROMINO_2[] = {
-    2, 2,
-    2, 2
-};
-
-//T-shaped tetromino
-const u8 TETROMINO_3[] = {
-    0, 3, 0,
-    3, 3, 3,
-    0, 0, 0
-};
-
-//S-shaped tetromino
-const u8 TETROMINO_4[] = {
-    0, 4, 4,
-    4, 4, 0,
-    0, 0, 0
-};
-
-//Z-shaped tetromino
-const u8 TETROMINO_5[] = {
-    5, 5, 0,
-    0, 5, 5,
-    0, 0, 0
+    TTF_Font *font;
+    SDL_Texture *texture;
+    SDL_Rect glyphs[GLYPH_LAST - GLYPH_FIRST + 1];
 };
 
-//L-shaped tetromino
-const u8 TETROMINO_6[] = {
-    6, 0, 0,
-    6, 6, 6,
-    0, 0, 0
-};
- //J-shaped tetromino
-const u8 TETROMINO_7[] = {
-    0, 0, 7,
-    7, 7, 7,
-    0, 0, 0
-};
-
-
-const Tetromino TETROMINOS[] = {
-    tetromino(TETROMINO_DEFAULT, 4),
-    tetromino(TETROMINO_1, 4),
-    tetromino(TETROMINO_2, 2),
-    tetromino(TETROMINO_3, 3),
-    tetromino(TETROMINO_4, 3),
-    tetromino(TETROMINO_5, 3),
-    tetromino(TETROMINO_6, 3),
-    tetromino(TETROMINO_7, 3),
-};
-
-enum Game_Phase
-{
-    GAME_PHASE_START,
-    GAME_PHASE_PLAY,
-    GAME_PHASE_LINE,
-    GAME_PHASE_GAMEOVER
-};
-
-struct Piece_State
-{
-    u8 tetromino_index;
-    int offset_row;
-    int offset_col;
-    int rotation;
-};
-
-//Represents the board with zero is an empty cell and the other values represent different colors
-struct Game_State
-{
-    u8 board[WIDTH * HEIGHT];
-    u8 lines[HEIGHT];
-    int pending_line_count;
-
-    bool muted=false;
-    bool holdPlace=false;
-
-    Piece_State piece;
-    Piece_State nextPiece;
-    Piece_State holdPiece;
-
-    Game_Phase phase;
-
-    int start_level;
-    int level;
-    int line_count;
-    int points;
-    u8 pause;
-
-    float next_drop_time;
-    float highlight_end_time;
-    float time;
-};
-
-struct Input_State
-{
-    u8 left;
-    u8 right;
-    u8 up;
-    u8 down;
-    u8 space;
-    u8 p;
-    u8 m;
-    u8 g;
-    u8 h;
-
-    s8 dleft;
-    s8 dright;
-    s8 dup;
-    s8 ddown;
-    s8 dspace;
-    s8 dp;
-    s8 dm;
-    s8 dg;
-    s8 dh;
-};
-
-enum Text_Align
-{
-    TEXT_ALIGN_LEFT,
-    TEXT_ALIGN_CENTER,
-    TEXT_ALIGN_RIGHT,
-    TEXT_ALIGN_HUD
-};
-
-//Get the value at a coordinate
-u8 matrix_get(const u8 *values, int width, int row, int col)
-{
-    int index = row * width + col;
-    return values[index];
-}
-
-//Set the value at a coordinate
-void matrix_set(u8 *values, int width, int row, int col, u8 value)
-{
-    int index = row * width + col;
-    values[index] = value;
-}
-
-//Rotates the tetromino
-u8 tetromino_rotate(const Tetromino *tetromino, int row, int col, int rotation)
-{
-    int side = tetromino->side;
-    switch (rotation)
-    {
-    case 0:
-        return tetromino->data[row * side + col];
-    case 1:
-        return tetromino->data[(side - col - 1) * side + row];
-    case 2:
-        return tetromino->data[(side - row - 1) * side + (side - col - 1)];
-    case 3:
-        return tetromino->data[col * side + (side - row - 1)];
-    }
-    return 0;
-}
-
-u8 check_row_filled(const u8 *values, int width, int row)
-{
-    for (int col = 0;
-         col < width;
-         ++col)
-    {
-        if (!matrix_get(values, width, row, col))
+Glyph_Atlas text_atlas;
+
+//Plays the sounds queued by the updates since the last frame
+void play_sounds(u32 sounds)
+{
+    Mix_Chunk *chunks[SOUND_COUNT] = {
+        increaseLVL,
+        decreaseLVL,
+        start,
+        softDrop,
+        move_sfx,
+        rotate_sfx,
+        landing,
+        hardDrop,
+        lvlUp,
+        pause_sfx,
+        gameover
+    };
+    for (int sound = 0;
+         sound < SOUND_COUNT;
+         ++sound)
+    {
+        if (sounds & (1u << sound))
         {
-            return 0;
+            Mix_PlayChannel( -1, chunks[sound], 0 );
         }
     }
-    return 1;
 }
 
-u8 check_row_empty(const u8 *values, int width, int row)
-{
-    for (int col = 0;
-         col < width;
-         ++col)
-    {
-        if (matrix_get(values, width, row, col))
-        {
-            return 0;
-        }
-    }
-    return 1;
-}
-
-int find_lines(const u8 *values, int width, int height, u8 *lines_out)
-{
-    int count = 0;
-    for (int row = 0;
-         row < height;
-         ++row)
-    {
-        u8 filled = check_row_filled(values, width, row);
-        lines_out[row] = filled;
-        count += filled;
-    }
-    return count;
-}
+//The game runs on its own thread so a slow present or vsync wait never delays it.
+//Only that thread touches the Game_State; the render thread hands it buttons and
+//takes back snapshots through a triple buffer and sounds through an atomic mask.
+struct Sim_Context
+{
+    Game_State game;
+    Corpus *corpus;
+    Replay_Recorder recorder;
+    //Live state for overlays in other processes, when the segment could be created
+    Shared_State *shared_state;
+    //Early-game moves for the bot, when a book was generated next to the game
+    Opening_Book *opening_book;
+    //Learned evaluation for the bot's search, when a model was trained next to the game
+    Nn_Model *eval_model;
+    //Practice rewind; a rewound game is no longer one straight run, so it isn't recorded
+    Rewind_Buffer rewind;
+    bool rewound;
+    u16 step_buttons;
+
+    std::atomic<u16> held_buttons;
+    //Presses since the last tick, so a tap released before the tick still lands
+    std::atomic<u16> pressed_buttons;
+    std::atomic<bool> bot_enabled;
+    //Pieces to scrub by, negative for back
+    std::atomic<int> rewind_steps;
+    std::atomic<bool> quit;
+
+    std::atomic<u32> sounds;
+    Render_Snapshot snapshots[3];
+    Triple_Buffer snapshot_buffer;
+};
 
-void clear_lines(u8 *values, int width, int height, const u8 *lines)
+void publish_tick(Sim_Context *sim)
 {
-    int src_row = height - 1;
-    for (int dst_row = height - 1;
-         dst_row >= 0;
-         --dst_row)
+    Game_State *game = &sim->game;
+    if (sim->shared_state)
     {
-        while (src_row >= 0 && lines[src_row])
-        {
-            --src_row;
-        }
-
-        if (src_row < 0)
-        {
-            memset(values + dst_row * width, 0, width);
-        }
-        else
-        {
-            if (src_row != dst_row)
-            {
-                memcpy(values + dst_row * width,
-                       values + src_row * width,
-                       width);
-            }
-            --src_row;
-        }
+        shared_state_publish(sim->shared_state, game);
     }
+    sim->sounds.fetch_or(game->sounds, std::memory_order_relaxed);
+    game->sounds = 0;
+    make_render_snapshot(game, sim->snapshots + triple_buffer_back(&sim->snapshot_buffer));
+    triple_buffer_publish(&sim->snapshot_buffer);
 }
 
-//Checks if the tetromino collides with anything
-bool check_piece_valid(const Piece_State *piece,
-                  const u8 *board, int width, int height)
+//The game stays frozen on the shown piece until a key is pressed
+bool scrub_tick(Sim_Context *sim, u16 pressed)
 {
-    const Tetromino *tetromino = TETROMINOS + piece->tetromino_index;
-    // assert(tetromino);
-
-    for (int row = 0;
-         row < tetromino->side;
-         ++row)
+    Game_State *game = &sim->game;
+    int steps = sim->rewind_steps.exchange(0, std::memory_order_relaxed);
+    bool moved = false;
+    for (;
+         steps < 0;
+         ++steps)
     {
-        for (int col = 0;
-             col < tetromino->side;
-             ++col)
-        {
-            u8 value = tetromino_rotate(tetromino, row, col, piece->rotation);
-            if (value > 0)
-            {
-                int board_row = piece->offset_row + row;
-                int board_col = piece->offset_col + col;
-                if (board_row < 0)
-                {
-                    return false;
-                }
-                if (board_row >= height)
-                {
-                    return false;
-                }
-                if (board_col < 0)
-                {
-                    return false;
-                }
-                if (board_col >= width)
-                {
-                    return false;
-                }
-                if (matrix_get(board, width, board_row, board_col))
-                {
-                    return false;
-                }
-            }
-        }
+        moved |= rewind_back(&sim->rewind, game);
     }
-    return true;
-}
-
-void merge_piece(Game_State *game)
-{
-    const Tetromino *tetromino = TETROMINOS + game->piece.tetromino_index;
-    for (int row = 0;
-         row < tetromino->side;
-         ++row)
+    for (;
+         steps > 0;
+         --steps)
     {
-        for (int col = 0;
-             col < tetromino->side;
-             ++col)
-        {
-            u8 value = tetromino_rotate(tetromino, row, col, game->piece.rotation);
-            if (value)
-            {
-                int board_row = game->piece.offset_row + row;
-                int board_col = game->piece.offset_col + col;
-                matrix_set(game->board, WIDTH, board_row, board_col, value);
-            }
-        }
+        moved |= rewind_forward(&sim->rewind, game);
     }
-}
-
-int random_int(int min, int max)
-{
-    int range = max - min;
-    return min + rand() % range;
-}
-
-float get_time_to_next_drop(int level)
-{
-    if (level > 29)
+    if (moved)
     {
-        level = 29;
+        sim->rewound = true;
+        sim->recorder.recording = false;
+        //The bot's planned move was for another board
+        bot_player.pending_hold = false;
+        bot_player.piece_count = 0;
     }
-    return FRAMES_PER_DROP[level] * TARGET_SECONDS_PER_FRAME;
-}
 
-
-void spawn_piece(Game_State *game, bool start=false)
-{
-    game->piece = {};
-    if(start)
+    if (!sim->rewind.scrubbing)
     {
-        game->piece.tetromino_index = (u8)random_int(1, ARRAY_COUNT(TETROMINOS));
-        game->piece.offset_col = WIDTH / 2;
-
-        game->nextPiece = {};
-        game->nextPiece.tetromino_index = (u8)random_int(1, ARRAY_COUNT(TETROMINOS));
-        start=false;
+        return false;
     }
-    else
+    if (!pressed)
     {
-        game->piece=game->nextPiece;
-        game->piece.offset_col = WIDTH / 2;
-        game->nextPiece.tetromino_index = (u8)random_int(1, ARRAY_COUNT(TETROMINOS));
+        publish_tick(sim);
+        return true;
     }
-    game->next_drop_time = game->time + get_time_to_next_drop(game->level);
+    sim->step_buttons = rewind_resume(&sim->rewind, sim->step_buttons);
+    return false;
 }
 
-void hold_piece(Game_State *game)
+void simulate_tick(Sim_Context *sim)
 {
-    if(!game->holdPlace)
+    TRACE_ZONE("simulate_tick");
+    Game_State *game = &sim->game;
+    u16 pressed = sim->pressed_buttons.exchange(0, std::memory_order_relaxed);
+    u16 buttons = sim->held_buttons.load(std::memory_order_relaxed) | pressed;
+    if (scrub_tick(sim, pressed))
     {
-        game->holdPiece.tetromino_index = game->piece.tetromino_index;
-        spawn_piece(game);
-        game->holdPlace = true;
+        sim->step_buttons = buttons;
+        return;
     }
-    else
+
+    if (sim->bot_enabled.load(std::memory_order_relaxed) && game->phase == GAME_PHASE_PLAY)
     {
-        Piece_State piece=game->piece;
-        piece.tetromino_index=game->holdPiece.tetromino_index;
-        if (check_piece_valid(&piece, game->board, WIDTH, HEIGHT))
+        if (!bot_player.bot)
         {
-            u8 temp = game->piece.tetromino_index;
-            game->piece.tetromino_index = game->holdPiece.tetromino_index;
-            game->holdPiece.tetromino_index = temp;
+            //Set up once on first use, not part of the per-frame traffic
+            ALLOC_SCOPE(ALLOC_SETUP);
+            Bot_Config config = bot_default_config();
+            bot_player.bot = bot_create(&config);
+            bot_player.bot->book = sim->opening_book;
+            bot_player.bot->model = sim->eval_model;
         }
+        u16 bot_buttons = bot_player_buttons(&bot_player, game, sim->step_buttons & ~(INPUT_P | INPUT_M));
+        buttons = (buttons & (INPUT_P | INPUT_M)) | bot_buttons;
     }
-}
-
-void pushHold(Game_State* game)
-{
-    if(game->holdPlace)
-    {
-        game->nextPiece.tetromino_index=game->holdPiece.tetromino_index;
-        game->holdPiece = {};
-        game->holdPlace = false;
-    }
-
-}
-
-bool soft_drop(Game_State *game)
-{
-    ++game->piece.offset_row;
-    if (!check_piece_valid(&game->piece, game->board, WIDTH, HEIGHT))
-    {
-        Mix_PlayChannel( -1, landing, 0 );
-        --game->piece.offset_row;
-
-        merge_piece(game);
-        spawn_piece(game);
-        return false;
-    }
-
-    game->next_drop_time = game->time + get_time_to_next_drop(game->level);
-    return true;
-}
-
-int compute_points(int level, int line_count)
-{
-    switch (line_count)
-    {
-    case 1:
-        return 40 * (level + 1);
-    case 2:
-        return 100 * (level + 1);
-    case 3:
-        return 300 * (level + 1);
-    case 4:
-        return 1200 * (level + 1);
-    }
-    return 0;
-}
-
-int min(int x, int y)
-{
-    return x < y ? x : y;
-}
-int max(int x, int y)
-{
-    return x > y ? x : y;
-}
-
-int get_lines_for_next_level(int start_level, int level)
-{
-    int first_level_up_limit = min((start_level * 10 + 10),
-        max(100, (start_level * 10 - 50)));
-    if (level == start_level)
-    {
-        return first_level_up_limit;
-    }
-    int diff = level - start_level;
-    return first_level_up_limit + diff * 10;
-}
 
-void update_game_start(Game_State *game, const Input_State *input)
-{
-    if (input->dup > 0)
+    Input_State input = unpack_input(buttons, sim->step_buttons);
+    if (input.dm > 0)
     {
-        Mix_PlayChannel( -1, increaseLVL, 0 );
-        ++game->start_level;
+        game->muted = !game->muted;
     }
-
-    if (input->ddown > 0 && game->start_level > 0)
+    if (game->phase == GAME_PHASE_START)
     {
-        Mix_PlayChannel( -1, decreaseLVL, 0 );
-        --game->start_level;
+        sim->rewound = false;
     }
-
-    if (input->dspace > 0)
+    if (sim->corpus && !sim->rewound)
     {
-        Mix_PlayChannel( -1, start, 0 );
-        memset(game->board, 0, WIDTH * HEIGHT);
-        game->level = game->start_level;
-        game->line_count = 0;
-        game->points = 0;
-        spawn_piece(game, true);
-        game->phase = GAME_PHASE_PLAY;
+        replay_record_input(&sim->recorder, game, buttons, sim->step_buttons);
     }
-}
-
-void update_game_gameover(Game_State *game, const Input_State *input)
-{
-    if (input->dspace > 0)
+    step_game(game, &input);
+    if (sim->corpus && !sim->rewound)
     {
-        game->phase = GAME_PHASE_START;
+        replay_record_state(&sim->recorder, sim->corpus, game);
     }
+    rewind_record(&sim->rewind, game, buttons);
+    delta_encode(&delta_encoder, game);
+    sim->step_buttons = buttons;
+    publish_tick(sim);
 }
 
-void update_game_line(Game_State *game)
+//Ticks are scheduled on an absolute 60 Hz timeline, so they don't drift with sleep jitter
+int simulation_thread(void *data)
 {
-    if (game->time >= game->highlight_end_time)
+    Sim_Context *sim = (Sim_Context *)data;
+    TRACE_THREAD_NAME("simulation");
+    ALLOC_SCOPE(ALLOC_SIMULATION);
+    u64 frequency = SDL_GetPerformanceFrequency();
+    u64 start = SDL_GetPerformanceCounter();
+    u64 tick = 0;
+    while (!sim->quit.load(std::memory_order_relaxed))
     {
-        clear_lines(game->board, WIDTH, HEIGHT, game->lines);
-        game->line_count += game->pending_line_count;
-        game->points += compute_points(game->level, game->pending_line_count);
-
-        int lines_for_next_level = get_lines_for_next_level(game->start_level,
-                                                            game->level);
-        if (game->line_count >= lines_for_next_level)
+        u64 now = SDL_GetPerformanceCounter();
+        u64 next_tick = start + tick * frequency / FPS;
+        if (now < next_tick)
         {
-            ++game->level;
+            //SDL_Delay is coarse, so sleep all but the last millisecond and spin the rest
+            u64 wait_ms = (next_tick - now) * 1000 / frequency;
+            if (wait_ms > 1)
+            {
+                SDL_Delay((u32)(wait_ms - 1));
+            }
+            continue;
+        }
+        if (now - next_tick > MAX_TICKS_BEHIND * frequency / FPS)
+        {
+            start = now;
+            tick = 0;
         }
 
-        game->phase = GAME_PHASE_PLAY;
-    }
-}
-
-void update_game_play(Game_State *game, const Input_State *input)
-{
-    if (input->dp > 0) {
-        Mix_PlayChannel( -1, pause_sfx, 0 );
-        game->pause = (game->pause+1) % 2;
-    }
-    Piece_State piece = game->piece;
-
-    if (input->dleft > 0 && game->pause == 0)
-    {
-       Mix_PlayChannel( -1, move_sfx, 0 );
-        --piece.offset_col;
-    }
-    if (input->dright> 0 && game->pause == 0)
-    {
-        Mix_PlayChannel( -1, move_sfx, 0 );
-        ++piece.offset_col;
-    }
-    if (input->dup > 0 && game->pause == 0)
-    {
-        Mix_PlayChannel( -1, rotate_sfx, 0 );
-        piece.rotation = (piece.rotation + 1) % 4;
-    }
-
-    if (check_piece_valid(&piece, game->board, WIDTH, HEIGHT))
-    {
-        game->piece = piece;
-    }
-
-    if (input->ddown > 0 && game->pause == 0)
-    {
-        Mix_PlayChannel( -1, move_sfx, 0 );
-        soft_drop(game);
-    }
-
-    if (input->dspace > 0 && game->pause == 0)
-    {
-        Mix_PlayChannel( -1, hardDrop, 0 );
-        while(soft_drop(game));
-    }
-
-    while (game->time >= game->next_drop_time && game->pause == 0)
-    {
-        Mix_PlayChannel( -1, softDrop, 0 );
-        soft_drop(game);
-    }
-
-    if (input->dg > 0 && game->pause == 0)
-    {
-        hold_piece(game);
-    }
-
-    if(input->dh > 0 && game->pause == 0)
-    {
-        pushHold(game);
-    }
-
-    game->pending_line_count = find_lines(game->board, WIDTH, HEIGHT, game->lines);
-    if (game->pending_line_count > 0)
-    {
-        game->phase = GAME_PHASE_LINE;
-        game->highlight_end_time = game->time + 0.5f;
-    }
-
-    int game_over_row = 0;
-    if (!check_row_empty(game->board, WIDTH, game_over_row))
-    {
-        Mix_PlayChannel( -1, gameover, 0 );
-        game->phase = GAME_PHASE_GAMEOVER;
+        simulate_tick(sim);
+        ++tick;
     }
+    return 0;
 }
 
-//Switches between game phases
-void update_game(Game_State *game, const Input_State *input)
+enum Text_Align
 {
-    switch(game->phase)
-    {
-    case GAME_PHASE_START:
-        update_game_start(game, input);
-        break;
-    case GAME_PHASE_PLAY:
-        update_game_play(game, input);
-        break;
-    case GAME_PHASE_LINE:
-        update_game_line(game);
-        break;
-    case GAME_PHASE_GAMEOVER:
-        update_game_gameover(game, input);
-        break;
-    }
-}
+    TEXT_ALIGN_LEFT,
+    TEXT_ALIGN_CENTER,
+    TEXT_ALIGN_RIGHT,
+    TEXT_ALIGN_HUD
+};
 
 void fill_rect(SDL_Renderer *renderer, int x, int y, int width, int height, Color color)
 {
@@ -695,6 +294,88 @@ void draw_rect (SDL_Renderer *renderer, int x, int y, int width, int height, Col
     SDL_RenderDrawRect(renderer, &rect);
 }
 
+//Glyphs are rendered white and tinted when drawn
+bool glyph_atlas_create(Glyph_Atlas *atlas, SDL_Renderer *renderer, TTF_Font *font)
+{
+    *atlas = {};
+    SDL_Surface *glyphs[GLYPH_LAST - GLYPH_FIRST + 1] = {};
+    SDL_Color white = { 0xFF, 0xFF, 0xFF, 0xFF };
+    int width = 0;
+    int height = 1;
+    for (int glyph = GLYPH_FIRST;
+         glyph <= GLYPH_LAST;
+         ++glyph)
+    {
+        SDL_Surface *surface = TTF_RenderGlyph_Solid(font, (u16)glyph, white);
+        if (!surface)
+        {
+            continue;
+        }
+        glyphs[glyph - GLYPH_FIRST] = surface;
+        SDL_Rect *rect = atlas->glyphs + glyph - GLYPH_FIRST;
+        rect->x = width;
+        rect->y = 0;
+        rect->w = surface->w;
+        rect->h = surface->h;
+        width += surface->w;
+        height = max(height, surface->h);
+    }
+
+    SDL_Surface *sheet = SDL_CreateRGBSurfaceWithFormat(0, max(width, 1), height, 32, SDL_PIXELFORMAT_RGBA32);
+    for (int i = 0;
+         i < GLYPH_LAST - GLYPH_FIRST + 1;
+         ++i)
+    {
+        if (glyphs[i])
+        {
+            if (sheet)
+            {
+                SDL_Rect rect = atlas->glyphs[i];
+                SDL_BlitSurface(glyphs[i], 0, sheet, &rect);
+            }
+            SDL_FreeSurface(glyphs[i]);
+        }
+    }
+    if (!sheet)
+    {
+        return false;
+    }
+    atlas->texture = SDL_CreateTextureFromSurface(renderer, sheet);
+    SDL_FreeSurface(sheet);
+    if (!atlas->texture)
+    {
+        return false;
+    }
+    SDL_SetTextureBlendMode(atlas->texture, SDL_BLENDMODE_BLEND);
+    atlas->font = font;
+    return true;
+}
+
+void glyph_atlas_destroy(Glyph_Atlas *atlas)
+{
+    if (atlas->texture)
+    {
+        SDL_DestroyTexture(atlas->texture);
+    }
+    *atlas = {};
+}
+
+int text_x(int x, int width, Text_Align alignment)
+{
+    switch (alignment)
+    {
+    case TEXT_ALIGN_LEFT:
+        return x;
+    case TEXT_ALIGN_CENTER:
+        return x - width / 2;
+    case TEXT_ALIGN_RIGHT:
+        return x - width;
+    case TEXT_ALIGN_HUD:
+        return x - width / 3;
+    }
+    return x;
+}
+
 void draw_string(SDL_Renderer *renderer,
             TTF_Font *font,
             const char *text,
@@ -702,28 +383,53 @@ void draw_string(SDL_Renderer *renderer,
             Text_Align alignment,
             Color color)
 {
+    TRACE_ZONE("draw_string");
+    ALLOC_SCOPE(ALLOC_TEXT);
+    if (text_atlas.font == font)
+    {
+        const Glyph_Atlas *atlas = &text_atlas;
+        int width = 0;
+        for (const char *c = text;
+             *c;
+             ++c)
+        {
+            if (*c >= GLYPH_FIRST && *c <= GLYPH_LAST)
+            {
+                width += atlas->glyphs[*c - GLYPH_FIRST].w;
+            }
+        }
+
+        SDL_SetTextureColorMod(atlas->texture, color.r, color.g, color.b);
+        SDL_SetTextureAlphaMod(atlas->texture, color.a);
+        SDL_Rect rect;
+        rect.x = text_x(x, width, alignment);
+        rect.y = y;
+        for (const char *c = text;
+             *c;
+             ++c)
+        {
+            if (*c < GLYPH_FIRST || *c > GLYPH_LAST)
+            {
+                continue;
+            }
+            const SDL_Rect *glyph = atlas->glyphs + *c - GLYPH_FIRST;
+            rect.w = glyph->w;
+            rect.h = glyph->h;
+            SDL_RenderCopy(renderer, atlas->texture, glyph, &rect);
+            rect.x += glyph->w;
+        }
+        return;
+    }
+
     SDL_Color sdl_color = SDL_Color { color.r, color.g, color.b, color.a };
     SDL_Surface *surface = TTF_RenderText_Solid(font, text, sdl_color);
     SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
 
     SDL_Rect rect;
+    rect.x = text_x(x, surface->w, alignment);
     rect.y = y;
     rect.w = surface->w;
     rect.h = surface->h;
-    switch (alignment)
-    {
-    case TEXT_ALIGN_LEFT:
-        rect.x = x;
-        break;
-    case TEXT_ALIGN_CENTER:
-        rect.x = x - surface->w / 2;
-        break;
-    case TEXT_ALIGN_RIGHT:
-        rect.x = x - surface->w;
-        break;
-    case TEXT_ALIGN_HUD:
-        rect.x = x - surface->w / 3;
-    }
 
     SDL_RenderCopy(renderer, texture, 0, &rect);
     SDL_FreeSurface(surface);
@@ -838,10 +544,11 @@ SDL_Texture* loadTexture(SDL_Renderer *renderer, std::string path )
 }
 
 
-void render_game(Game_State *game,
+void render_game(const Render_Snapshot *game,
             SDL_Renderer *renderer,
             TTF_Font *font)
 {
+    TRACE_ZONE("render_game");
 
     char buffer[4096];
 
@@ -928,6 +635,33 @@ void render_game(Game_State *game,
 
 int main(int argc, char** argv)
 {
+#ifdef TETRIS_ALLOC_STATS
+    alloc_stats_install();
+#endif
+    //Tetris [--rules classic|guideline|tournament]
+    int rules = RULES_COUNT;
+    if (argc == 1)
+    {
+        rules = RULES_CLASSIC;
+    }
+    else if (argc == 3 && strcmp(argv[1], "--rules") == 0)
+    {
+        for (int i = 0;
+             i < RULES_COUNT;
+             ++i)
+        {
+            if (strcmp(argv[2], RULES_NAMES[i]) == 0)
+            {
+                rules = i;
+            }
+        }
+    }
+    if (rules == RULES_COUNT)
+    {
+        printf("usage: Tetris [--rules classic|guideline|tournament]\n");
+        return 6;
+    }
+
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0)
     {
         return 1;
@@ -984,21 +718,52 @@ int main(int argc, char** argv)
 
     const char *font_name = "font/novem___.ttf";
     TTF_Font *font = TTF_OpenFont(font_name, 24);
-
-    Game_State game = {};
-    Input_State input = {};
-
-    game.pause = 0;
+    //Without the atlas draw_string renders every string from scratch each frame
+    glyph_atlas_create(&text_atlas, renderer, font);
+
+    Sim_Context *sim = new Sim_Context();
+    u16 buttons = 0;
+    u8 bot_key = 0;
+    u8 rewind_key = 0;
+    u8 forward_key = 0;
+#ifdef TETRIS_TRACE
+    //Exports the session so far without stopping it
+    u8 trace_key = 0;
+    TRACE_THREAD_NAME("render");
+#endif
+    bool muted = false;
+
+    seed_game(&sim->game, (u32)time(0));
+    sim->game.rules = (u8)rules;
+    //Every finished game is kept for replay; the directory is created when missing, and if it
+    //or its index can't be opened the game just isn't recorded
+    sim->corpus = corpus_open("replays");
+    sim->shared_state = shared_state_create(SHARED_STATE_NAME);
+    sim->opening_book = opening_book_open("opening.book");
+    //Only a model put there deliberately; nn_train writes elsewhere by default
+    sim->eval_model = nn_model_open("eval.nn");
+    triple_buffer_init(&sim->snapshot_buffer);
+    for (int i = 0;
+         i < 3;
+         ++i)
+    {
+        make_render_snapshot(&sim->game, sim->snapshots + i);
+    }
+#ifdef TETRIS_TELEMETRY
+    Telemetry_Writer *telemetry = telemetry_start("telemetry.bin", 1000);
+#endif
 
 
     Mix_Volume(-1, 64);
     Mix_VolumeMusic(64);
 
+    SDL_Thread *sim_thread = SDL_CreateThread(simulation_thread, "simulation", sim);
+
     bool quit = false;
     while (!quit)
     {
-        game.time = SDL_GetTicks() / 1000.0f;
-
+        TRACE_ZONE("frame");
+        ALLOC_SCOPE(ALLOC_EVENTS);
         int key_count;
         const u8 *key_states = SDL_GetKeyboardState(&key_count);
 
@@ -1007,27 +772,54 @@ int main(int argc, char** argv)
             quit = true;
         }
 
-        Input_State prev_input = input;
-
-        input.left = key_states[SDL_SCANCODE_LEFT];
-        input.right = key_states[SDL_SCANCODE_RIGHT];
-        input.up = key_states[SDL_SCANCODE_UP];
-        input.down = key_states[SDL_SCANCODE_DOWN];
-        input.space = key_states[SDL_SCANCODE_SPACE];
-        input.p = key_states[SDL_SCANCODE_P];
-        input.m = key_states[SDL_SCANCODE_M];
-        input.g = key_states[SDL_SCANCODE_G];
-        input.h = key_states[SDL_SCANCODE_H];
-
-        input.dleft = input.left - prev_input.left;
-        input.dright = input.right - prev_input.right;
-        input.dup = input.up - prev_input.up;
-        input.ddown = input.down - prev_input.down;
-        input.dspace = input.space - prev_input.space;
-        input.dp = input.p - prev_input.p;
-        input.dm = input.m - prev_input.m;
-        input.dg = input.g - prev_input.g;
-        input.dh = input.h - prev_input.h;
+        u16 prev_buttons = buttons;
+
+        buttons = 0;
+        buttons |= key_states[SDL_SCANCODE_LEFT] ? INPUT_LEFT : 0;
+        buttons |= key_states[SDL_SCANCODE_RIGHT] ? INPUT_RIGHT : 0;
+        buttons |= key_states[SDL_SCANCODE_UP] ? INPUT_UP : 0;
+        buttons |= key_states[SDL_SCANCODE_DOWN] ? INPUT_DOWN : 0;
+        buttons |= key_states[SDL_SCANCODE_SPACE] ? INPUT_SPACE : 0;
+        buttons |= key_states[SDL_SCANCODE_P] ? INPUT_P : 0;
+        buttons |= key_states[SDL_SCANCODE_M] ? INPUT_M : 0;
+        buttons |= key_states[SDL_SCANCODE_G] ? INPUT_G : 0;
+        buttons |= key_states[SDL_SCANCODE_H] ? INPUT_H : 0;
+
+        sim->held_buttons.store(buttons, std::memory_order_relaxed);
+        u16 pressed = buttons & ~prev_buttons;
+        if (pressed)
+        {
+            sim->pressed_buttons.fetch_or(pressed, std::memory_order_relaxed);
+        }
+
+        u8 prev_bot_key = bot_key;
+        bot_key = key_states[SDL_SCANCODE_B];
+        if (bot_key && !prev_bot_key)
+        {
+            sim->bot_enabled.store(!sim->bot_enabled.load(std::memory_order_relaxed),
+                                   std::memory_order_relaxed);
+        }
+
+        u8 prev_rewind_key = rewind_key;
+        rewind_key = key_states[SDL_SCANCODE_R];
+        if (rewind_key && !prev_rewind_key)
+        {
+            sim->rewind_steps.fetch_sub(1, std::memory_order_relaxed);
+        }
+        u8 prev_forward_key = forward_key;
+        forward_key = key_states[SDL_SCANCODE_F];
+        if (forward_key && !prev_forward_key)
+        {
+            sim->rewind_steps.fetch_add(1, std::memory_order_relaxed);
+        }
+#ifdef TETRIS_TRACE
+        u8 prev_trace_key = trace_key;
+        trace_key = key_states[SDL_SCANCODE_F12];
+        if (trace_key && !prev_trace_key)
+        {
+            trace_export("trace.json");
+        }
+#endif
 
         SDL_Event e;
         while (SDL_PollEvent(&e) != 0)
@@ -1038,20 +830,14 @@ int main(int argc, char** argv)
             }
         }
 
-        if (input.dm > 0)
-            {
-                    if(game.muted==true)
-                    {
-                        Mix_Volume(-1, 64);
-                        Mix_VolumeMusic(64);
-                        game.muted=false;
-                    }
-                    else
-                    {
-                        Mix_Volume(-1, 0);
-                        Mix_VolumeMusic(0);
-                        game.muted=true;
-                    }
+        const Render_Snapshot *snapshot = sim->snapshots + triple_buffer_read(&sim->snapshot_buffer);
+        ALLOC_SCOPE(ALLOC_RENDER);
+
+        if (snapshot->muted != muted)
+        {
+            muted = snapshot->muted;
+            Mix_Volume(-1, muted ? 0 : 64);
+            Mix_VolumeMusic(muted ? 0 : 64);
         }
 
 
@@ -1072,9 +858,13 @@ int main(int argc, char** argv)
         fullScreenViewport.h = 780;
         SDL_RenderSetViewport( renderer, &fullScreenViewport );
 
-        update_game(&game, &input);
+        {
+            TRACE_ZONE("play_sounds");
+            ALLOC_SCOPE(ALLOC_AUDIO);
+            play_sounds(sim->sounds.exchange(0, std::memory_order_relaxed));
+        }
         SDL_RenderCopy( renderer, gTexture, NULL, NULL );
-        render_game(&game, renderer, font);
+        render_game(snapshot, renderer, font);
         SDL_Rect topLeftViewport;
         topLeftViewport.x = 60;
         topLeftViewport.y = 60 + 15;
@@ -1084,12 +874,38 @@ int main(int argc, char** argv)
 
         SDL_RenderCopy( renderer, nTexture, NULL, NULL );
 
-        SDL_RenderPresent(renderer);
+        {
+            TRACE_ZONE("SDL_RenderPresent");
+            SDL_RenderPresent(renderer);
+        }
+#ifdef TETRIS_ALLOC_STATS
+        alloc_stats_frame_end(snapshot->phase);
+#endif
 
 //        float frame_time=SDL_GetTicks() / 1000.0f - game.time;
 //        if(frame_time < frame_delay) SDL_Delay(frame_delay - frame_time);
     }
+    sim->quit.store(true, std::memory_order_relaxed);
+    SDL_WaitThread(sim_thread, 0);
+    if (bot_player.bot)
+    {
+        bot_destroy(bot_player.bot);
+    }
+    corpus_close(sim->corpus);
+    replay_recorder_free(&sim->recorder);
+    shared_state_close(sim->shared_state);
+    opening_book_close(sim->opening_book);
+    nn_model_close(sim->eval_model);
+    delete sim;
+#ifdef TETRIS_TELEMETRY
+    telemetry_stop(telemetry);
+#endif
+#ifdef TETRIS_TRACE
+    trace_export("trace.json");
+#endif
+
     SDL_DestroyTexture( gTexture );
+    glyph_atlas_destroy(&text_atlas);
     TTF_CloseFont(font);
 
     Mix_FreeChunk(increaseLVL);
@@ -1112,5 +928,12 @@ int main(int argc, char** argv)
     Mix_Quit();
     SDL_Quit();
 
+#ifdef TETRIS_ALLOC_STATS
+    //A steady play frame that allocated fails the run, so scripted sessions catch it
+    if (!alloc_stats_report())
+    {
+        return 5;
+    }
+#endif
     return 0;
 }
@@ -0,0 +1,243 @@
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+//Heap accounting for the game, compiled in with TETRIS_ALLOC_STATS. Include it from one
+//translation unit only, it replaces the global operator new and delete.
+//Allocations through SDL (and SDL_ttf, SDL_image and SDL_mixer, which allocate through
+//SDL_malloc) and through new are counted against the subsystem of the innermost
+//ALLOC_SCOPE on the allocating thread. Libraries calling malloc directly are not seen.
+//
+//alloc_stats_frame_end prints every frame that allocated. After a warmup, a frame during
+//play that allocates outside ALLOC_SETUP is a regression, and alloc_stats_report fails the run.
+
+#define ALLOC_STATS_WARMUP_FRAMES 120
+
+enum Alloc_Subsystem
+{
+    ALLOC_OTHER,
+    ALLOC_SIMULATION,
+    ALLOC_EVENTS,
+    ALLOC_RENDER,
+    ALLOC_TEXT,
+    ALLOC_AUDIO,
+    //One-off setup that happens to run during play, like the bot on first use
+    ALLOC_SETUP,
+    ALLOC_SUBSYSTEM_COUNT
+};
+
+const char *ALLOC_SUBSYSTEM_NAMES[ALLOC_SUBSYSTEM_COUNT] = {
+    "other",
+    "simulation",
+    "events",
+    "render",
+    "text",
+    "audio",
+    "setup"
+};
+
+//Diagnostic build only, so plain atomic adds are cheap enough
+std::atomic<u64> alloc_counts[ALLOC_SUBSYSTEM_COUNT];
+std::atomic<u64> alloc_bytes[ALLOC_SUBSYSTEM_COUNT];
+thread_local u8 alloc_subsystem = ALLOC_OTHER;
+
+struct Alloc_Stats
+{
+    u64 frames;
+    u64 play_frames;
+    //Play frames past the warmup that allocated
+    u64 regressed_frames;
+    u64 total_counts[ALLOC_SUBSYSTEM_COUNT];
+    u64 total_bytes[ALLOC_SUBSYSTEM_COUNT];
+};
+
+Alloc_Stats alloc_stats;
+SDL_malloc_func alloc_sdl_malloc;
+SDL_calloc_func alloc_sdl_calloc;
+SDL_realloc_func alloc_sdl_realloc;
+SDL_free_func alloc_sdl_free;
+
+void alloc_count(size_t size)
+{
+    alloc_counts[alloc_subsystem].fetch_add(1, std::memory_order_relaxed);
+    alloc_bytes[alloc_subsystem].fetch_add(size, std::memory_order_relaxed);
+}
+
+struct Alloc_Scope
+{
+    u8 previous;
+
+    Alloc_Scope(u8 subsystem)
+    {
+        previous = alloc_subsystem;
+        alloc_subsystem = subsystem;
+    }
+
+    ~Alloc_Scope()
+    {
+        alloc_subsystem = previous;
+    }
+};
+
+void *alloc_sdl_malloc_hook(size_t size)
+{
+    alloc_count(size);
+    return alloc_sdl_malloc(size);
+}
+
+void *alloc_sdl_calloc_hook(size_t count, size_t size)
+{
+    alloc_count(count * size);
+    return alloc_sdl_calloc(count, size);
+}
+
+//A realloc may move the block, so it counts like a fresh allocation
+void *alloc_sdl_realloc_hook(void *memory, size_t size)
+{
+    alloc_count(size);
+    return alloc_sdl_realloc(memory, size);
+}
+
+void alloc_sdl_free_hook(void *memory)
+{
+    alloc_sdl_free(memory);
+}
+
+//Has to run before any other SDL call, SDL frees memory with the functions that allocated it
+void alloc_stats_install()
+{
+    SDL_GetMemoryFunctions(&alloc_sdl_malloc, &alloc_sdl_calloc, &alloc_sdl_realloc, &alloc_sdl_free);
+    SDL_SetMemoryFunctions(alloc_sdl_malloc_hook, alloc_sdl_calloc_hook, alloc_sdl_realloc_hook,
+                           alloc_sdl_free_hook);
+}
+
+//Call once per rendered frame with the phase it showed
+void alloc_stats_frame_end(Game_Phase phase)
+{
+    u64 counts[ALLOC_SUBSYSTEM_COUNT];
+    u64 bytes[ALLOC_SUBSYSTEM_COUNT];
+    u64 frame_count = 0;
+    u64 frame_bytes = 0;
+    for (int subsystem = 0;
+         subsystem < ALLOC_SUBSYSTEM_COUNT;
+         ++subsystem)
+    {
+        counts[subsystem] = alloc_counts[subsystem].exchange(0, std::memory_order_relaxed);
+        bytes[subsystem] = alloc_bytes[subsystem].exchange(0, std::memory_order_relaxed);
+        alloc_stats.total_counts[subsystem] += counts[subsystem];
+        alloc_stats.total_bytes[subsystem] += bytes[subsystem];
+        frame_count += counts[subsystem];
+        frame_bytes += bytes[subsystem];
+    }
+
+    u64 frame = alloc_stats.frames++;
+    bool steady = false;
+    if (phase == GAME_PHASE_PLAY)
+    {
+        steady = alloc_stats.play_frames++ >= ALLOC_STATS_WARMUP_FRAMES;
+    }
+    if (frame_count == 0)
+    {
+        return;
+    }
+    if (steady && frame_count > counts[ALLOC_SETUP])
+    {
+        ++alloc_stats.regressed_frames;
+    }
+
+    fprintf(stderr, "alloc frame %llu%s: %llu allocations, %llu bytes:",
+            (unsigned long long)frame, steady ? " (play)" : "",
+            (unsigned long long)frame_count, (unsigned long long)frame_bytes);
+    for (int subsystem = 0;
+         subsystem < ALLOC_SUBSYSTEM_COUNT;
+         ++subsystem)
+    {
+        if (counts[subsystem])
+        {
+            fprintf(stderr, " %s %llu/%llu", ALLOC_SUBSYSTEM_NAMES[subsystem],
+                    (unsigned long long)counts[subsystem], (unsigned long long)bytes[subsystem]);
+        }
+    }
+    fprintf(stderr, "\n");
+}
+
+//Prints the session totals; false when a steady play frame allocated
+bool alloc_stats_report()
+{
+    fprintf(stderr, "alloc totals over %llu frames, %llu in play:\n",
+            (unsigned long long)alloc_stats.frames, (unsigned long long)alloc_stats.play_frames);
+    for (int subsystem = 0;
+         subsystem < ALLOC_SUBSYSTEM_COUNT;
+         ++subsystem)
+    {
+        fprintf(stderr, "  %-10s %10llu allocations %12llu bytes\n", ALLOC_SUBSYSTEM_NAMES[subsystem],
+                (unsigned long long)alloc_stats.total_counts[subsystem],
+                (unsigned long long)alloc_stats.total_bytes[subsystem]);
+    }
+    if (alloc_stats.regressed_frames)
+    {
+        fprintf(stderr, "FAIL: %llu play frames allocated after the warmup\n",
+                (unsigned long long)alloc_stats.regressed_frames);
+        return false;
+    }
+    fprintf(stderr, "ok: no play frame allocated after the warmup\n");
+    return true;
+}
+
+void *operator new(size_t size)
+{
+    alloc_count(size);
+    void *memory = malloc(size ? size : 1);
+    if (!memory)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    alloc_count(size);
+    return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    alloc_count(size);
+    return malloc(size ? size : 1);
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+#define ALLOC_CONCAT_INNER(a, b) a##b
+#define ALLOC_CONCAT(a, b) ALLOC_CONCAT_INNER(a, b)
+#define ALLOC_SCOPE(subsystem) Alloc_Scope ALLOC_CONCAT(alloc_scope_, __LINE__)(subsystem)
+
+#endif
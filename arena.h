@@ -0,0 +1,45 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstdlib>
+
+//Bump allocator: allocations are never freed one by one, the whole arena is reset at once
+
+struct Arena
+{
+    u8 *base;
+    size_t size;
+    size_t used;
+};
+
+void arena_init(Arena *arena, size_t size)
+{
+    arena->base = (u8 *)malloc(size);
+    arena->size = size;
+    arena->used = 0;
+}
+
+void arena_free(Arena *arena)
+{
+    free(arena->base);
+    *arena = {};
+}
+
+//Returns null once the arena is full
+void *arena_push(Arena *arena, size_t size, size_t align = 16)
+{
+    size_t start = (arena->used + align - 1) & ~(align - 1);
+    if (start + size > arena->size)
+    {
+        return 0;
+    }
+    arena->used = start + size;
+    return arena->base + start;
+}
+
+void arena_reset(Arena *arena)
+{
+    arena->used = 0;
+}
+
+#endif
@@ -0,0 +1,194 @@
+//Throughput benchmark for the batch engine, optionally cross-checked against update_game.
+//Build: g++ -O2 -mavx2 batch_bench.cpp -o batch_bench  (drop -mavx2 for the scalar path)
+//Usage: batch_bench [lanes] [frames] [--check]
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+
+#include "game.h"
+#include "batch_engine.h"
+
+//Random held keys that change now and then, so edges happen at a realistic rate
+u16 random_buttons(u32 *rng, u16 buttons)
+{
+    u32 roll = random_next(rng);
+    if (roll % 4 == 0)
+    {
+        buttons = (u16)((roll >> 8) & (INPUT_LEFT | INPUT_RIGHT | INPUT_UP |
+                                       INPUT_DOWN | INPUT_SPACE | INPUT_G | INPUT_H));
+        if ((roll >> 20) % 8)
+        {
+            buttons &= ~INPUT_SPACE;
+        }
+    }
+    return buttons;
+}
+
+void start_scalar_game(Game_State *game, u32 seed, int start_level)
+{
+    *game = {};
+    seed_game(game, seed);
+    game->start_level = start_level;
+    Input_State input = unpack_input(INPUT_SPACE, 0);
+    step_game(game, &input);
+    game->sounds = 0;
+}
+
+//Compares everything the batch engine keeps; returns false on the first difference
+bool compare_lane(Batch_Engine *batch, int lane, const Game_State *game)
+{
+    const u16 *rows = batch_lane_rows(batch, lane);
+    for (int row = 0;
+         row < HEIGHT;
+         ++row)
+    {
+        for (int col = 0;
+             col < WIDTH;
+             ++col)
+        {
+            bool batch_cell = (rows[row] >> (col + BATCH_COL_SHIFT)) & 1;
+            bool game_cell = matrix_get(game->board, WIDTH, row, col) != 0;
+            if (batch_cell != game_cell)
+            {
+                return false;
+            }
+        }
+    }
+    return batch->phase[lane] == game->phase &&
+           batch->tetromino[lane] == game->piece.tetromino_index &&
+           batch->rotation[lane] == game->piece.rotation &&
+           batch->offset_row[lane] == game->piece.offset_row &&
+           batch->offset_col[lane] == game->piece.offset_col &&
+           batch->next_tetromino[lane] == game->nextPiece.tetromino_index &&
+           batch->hold_tetromino[lane] == game->holdPiece.tetromino_index &&
+           batch->hold_place[lane] == game->holdPlace &&
+           batch->level[lane] == game->level &&
+           batch->line_count[lane] == game->line_count &&
+           batch->points[lane] == game->points;
+}
+
+int main(int argc, char **argv)
+{
+    int lanes = 4096;
+    int frames = 2000;
+    bool check = false;
+    //--check may come anywhere, the counts are taken in order from the rest
+    int position = 0;
+    for (int i = 1;
+         i < argc;
+         ++i)
+    {
+        if (strcmp(argv[i], "--check") == 0)
+        {
+            check = true;
+        }
+        else if (position == 0)
+        {
+            lanes = atoi(argv[i]);
+            ++position;
+        }
+        else if (position == 1)
+        {
+            frames = atoi(argv[i]);
+            ++position;
+        }
+        else
+        {
+            position = -1;
+            break;
+        }
+    }
+    if (position < 0 || lanes <= 0 || frames <= 0)
+    {
+        fprintf(stderr, "usage: batch_bench [lanes] [frames] [--check], with positive counts\n");
+        return 1;
+    }
+
+    Batch_Engine *batch = batch_create(lanes);
+    u16 *buttons = (u16 *)calloc(lanes, sizeof(u16));
+    Game_State *games = check ? (Game_State *)calloc(lanes, sizeof(Game_State)) : 0;
+    u16 *prev_buttons = check ? (u16 *)calloc(lanes, sizeof(u16)) : 0;
+
+    u32 input_rng = 1234;
+    u32 next_seed = 1;
+    for (int lane = 0;
+         lane < lanes;
+         ++lane)
+    {
+        batch_reset(batch, lane, next_seed, 0);
+        if (check)
+        {
+            start_scalar_game(games + lane, next_seed, 0);
+        }
+        ++next_seed;
+    }
+
+    double batch_seconds = 0;
+    u64 steps = 0;
+    u64 games_finished = 0;
+    for (int frame = 0;
+         frame < frames;
+         ++frame)
+    {
+        for (int lane = 0;
+             lane < lanes;
+             ++lane)
+        {
+            if (batch->phase[lane] == GAME_PHASE_GAMEOVER)
+            {
+                batch_reset(batch, lane, next_seed, 0);
+                if (check)
+                {
+                    start_scalar_game(games + lane, next_seed, 0);
+                    prev_buttons[lane] = 0;
+                }
+                buttons[lane] = 0;
+                ++next_seed;
+                ++games_finished;
+            }
+            buttons[lane] = random_buttons(&input_rng, buttons[lane]);
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        batch_step(batch, buttons);
+        batch_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        steps += lanes;
+
+        if (check)
+        {
+            for (int lane = 0;
+                 lane < lanes;
+                 ++lane)
+            {
+                Input_State input = unpack_input(buttons[lane], prev_buttons[lane]);
+                prev_buttons[lane] = buttons[lane];
+                step_game(games + lane, &input);
+                if (!compare_lane(batch, lane, games + lane))
+                {
+                    printf("MISMATCH lane %d frame %d\n", lane, frame);
+                    return 1;
+                }
+            }
+        }
+    }
+
+#ifdef __AVX2__
+    const char *path = "avx2";
+#else
+    const char *path = "scalar";
+#endif
+    printf("%s: %d lanes x %d frames, %llu games finished\n",
+           path, lanes, frames, (unsigned long long)games_finished);
+    printf("%.0f env-steps/s\n", steps / batch_seconds);
+    if (check)
+    {
+        printf("all lanes matched update_game\n");
+    }
+
+    batch_destroy(batch);
+    free(buttons);
+    free(games);
+    free(prev_buttons);
+    return 0;
+}
@@ -0,0 +1,646 @@
+#ifndef BATCH_ENGINE_H
+#define BATCH_ENGINE_H
+
+#include <cstdlib>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+//Steps many games in lockstep with the same rules as update_game_play.
+//Every per-game field is its own array indexed by lane, and each board is a
+//32-row bitboard: bits 3..12 are the columns, the bits around them are walls
+//and rows 22..31 are floor, so a collision test is one 64-bit AND per lane.
+//Cell colors are not kept, only occupancy.
+
+#define BATCH_ROWS 32
+#define BATCH_WALL_ROW 0xE007
+#define BATCH_FULL_ROW 0xFFFF
+#define BATCH_CELL_BITS 0x1FF8
+#define BATCH_COL_SHIFT 3
+#define BATCH_BOARD_ROWS_MASK ((1u << HEIGHT) - 1)
+
+struct Batch_Engine
+{
+    int count;
+
+    u16 *rows;
+
+    u8 *tetromino;
+    u8 *rotation;
+    s32 *offset_row;
+    s32 *offset_col;
+    u8 *next_tetromino;
+    u8 *hold_tetromino;
+    u8 *hold_place;
+
+    u8 *phase;
+    u8 *pause;
+    s32 *start_level;
+    s32 *level;
+    s32 *line_count;
+    s32 *points;
+    u32 *lines;
+    s32 *pending_line_count;
+
+    u32 *rng_state;
+    u32 *frame;
+    float *time;
+    float *next_drop_time;
+    float *highlight_end_time;
+    u16 *prev_buttons;
+
+    //Scratch lists of lanes and of their batched collision tests
+    s32 *play_lane;
+    s32 *drop_lane;
+    u16 *pressed;
+    s32 *test_lane;
+    s32 *test_col;
+    u8 *test_rotation;
+    s64 *test_offset;
+    u64 *test_mask;
+    u8 *test_valid;
+    int test_count;
+};
+
+//Piece rows at offset_col 0, one 16-bit row per piece row
+u64 BATCH_PIECE_MASKS[ARRAY_COUNT(TETROMINOS)][4];
+
+void batch_init_piece_masks()
+{
+    for (u32 index = 0;
+         index < ARRAY_COUNT(TETROMINOS);
+         ++index)
+    {
+        const Tetromino *tetromino = TETROMINOS + index;
+        for (int rotation = 0;
+             rotation < 4;
+             ++rotation)
+        {
+            u64 mask = 0;
+            for (int row = 0;
+                 row < tetromino->side;
+                 ++row)
+            {
+                for (int col = 0;
+                     col < tetromino->side;
+                     ++col)
+                {
+                    if (tetromino_rotate(tetromino, row, col, rotation))
+                    {
+                        mask |= (u64)1 << (row * 16 + col + BATCH_COL_SHIFT);
+                    }
+                }
+            }
+            BATCH_PIECE_MASKS[index][rotation] = mask;
+        }
+    }
+}
+
+//Reachable pieces never leave columns -3..12, so shifting never spills into the next row
+u64 batch_piece_mask(u8 tetromino, int rotation, int offset_col)
+{
+    assert(offset_col >= -BATCH_COL_SHIFT && offset_col <= WIDTH - 1);
+    u64 mask = BATCH_PIECE_MASKS[tetromino][rotation];
+    return offset_col >= 0 ? mask << offset_col : mask >> -offset_col;
+}
+
+u64 batch_load_window(const u16 *rows, int offset_row)
+{
+    u64 window;
+    memcpy(&window, rows + offset_row, sizeof(window));
+    return window;
+}
+
+void batch_store_window(u16 *rows, int offset_row, u64 window)
+{
+    memcpy(rows + offset_row, &window, sizeof(window));
+}
+
+u16 *batch_lane_rows(Batch_Engine *batch, int lane)
+{
+    return batch->rows + lane * BATCH_ROWS;
+}
+
+Batch_Engine *batch_create(int count)
+{
+    batch_init_piece_masks();
+
+    //Pad to a whole number of gather groups
+    int padded = (count + 3) & ~3;
+
+    Batch_Engine *batch = (Batch_Engine *)calloc(1, sizeof(Batch_Engine));
+    batch->count = count;
+    batch->rows = (u16 *)calloc(padded * BATCH_ROWS, sizeof(u16));
+    batch->tetromino = (u8 *)calloc(padded, sizeof(u8));
+    batch->rotation = (u8 *)calloc(padded, sizeof(u8));
+    batch->offset_row = (s32 *)calloc(padded, sizeof(s32));
+    batch->offset_col = (s32 *)calloc(padded, sizeof(s32));
+    batch->next_tetromino = (u8 *)calloc(padded, sizeof(u8));
+    batch->hold_tetromino = (u8 *)calloc(padded, sizeof(u8));
+    batch->hold_place = (u8 *)calloc(padded, sizeof(u8));
+    batch->phase = (u8 *)calloc(padded, sizeof(u8));
+    batch->pause = (u8 *)calloc(padded, sizeof(u8));
+    batch->start_level = (s32 *)calloc(padded, sizeof(s32));
+    batch->level = (s32 *)calloc(padded, sizeof(s32));
+    batch->line_count = (s32 *)calloc(padded, sizeof(s32));
+    batch->points = (s32 *)calloc(padded, sizeof(s32));
+    batch->lines = (u32 *)calloc(padded, sizeof(u32));
+    batch->pending_line_count = (s32 *)calloc(padded, sizeof(s32));
+    batch->rng_state = (u32 *)calloc(padded, sizeof(u32));
+    batch->frame = (u32 *)calloc(padded, sizeof(u32));
+    batch->time = (float *)calloc(padded, sizeof(float));
+    batch->next_drop_time = (float *)calloc(padded, sizeof(float));
+    batch->highlight_end_time = (float *)calloc(padded, sizeof(float));
+    batch->prev_buttons = (u16 *)calloc(padded, sizeof(u16));
+    batch->play_lane = (s32 *)calloc(padded, sizeof(s32));
+    batch->drop_lane = (s32 *)calloc(padded, sizeof(s32));
+    batch->pressed = (u16 *)calloc(padded, sizeof(u16));
+    batch->test_lane = (s32 *)calloc(padded, sizeof(s32));
+    batch->test_col = (s32 *)calloc(padded, sizeof(s32));
+    batch->test_rotation = (u8 *)calloc(padded, sizeof(u8));
+    batch->test_offset = (s64 *)calloc(padded, sizeof(s64));
+    batch->test_mask = (u64 *)calloc(padded, sizeof(u64));
+    batch->test_valid = (u8 *)calloc(padded, sizeof(u8));
+
+    for (int lane = 0;
+         lane < padded;
+         ++lane)
+    {
+        u16 *rows = batch_lane_rows(batch, lane);
+        for (int row = 0;
+             row < BATCH_ROWS;
+             ++row)
+        {
+            rows[row] = row < HEIGHT ? BATCH_WALL_ROW : BATCH_FULL_ROW;
+        }
+        batch->phase[lane] = GAME_PHASE_START;
+    }
+    return batch;
+}
+
+void batch_destroy(Batch_Engine *batch)
+{
+    free(batch->rows);
+    free(batch->tetromino);
+    free(batch->rotation);
+    free(batch->offset_row);
+    free(batch->offset_col);
+    free(batch->next_tetromino);
+    free(batch->hold_tetromino);
+    free(batch->hold_place);
+    free(batch->phase);
+    free(batch->pause);
+    free(batch->start_level);
+    free(batch->level);
+    free(batch->line_count);
+    free(batch->points);
+    free(batch->lines);
+    free(batch->pending_line_count);
+    free(batch->rng_state);
+    free(batch->frame);
+    free(batch->time);
+    free(batch->next_drop_time);
+    free(batch->highlight_end_time);
+    free(batch->prev_buttons);
+    free(batch->play_lane);
+    free(batch->drop_lane);
+    free(batch->pressed);
+    free(batch->test_lane);
+    free(batch->test_col);
+    free(batch->test_rotation);
+    free(batch->test_offset);
+    free(batch->test_mask);
+    free(batch->test_valid);
+    free(batch);
+}
+
+void batch_test_push(Batch_Engine *batch, int lane,
+                     u8 tetromino, int rotation, int offset_row, int offset_col)
+{
+    int index = batch->test_count++;
+    batch->test_lane[index] = lane;
+    batch->test_col[index] = offset_col;
+    batch->test_rotation[index] = (u8)rotation;
+    batch->test_offset[index] = ((s64)lane * BATCH_ROWS + offset_row) * (s64)sizeof(u16);
+    batch->test_mask[index] = batch_piece_mask(tetromino, rotation, offset_col);
+}
+
+//Runs every queued collision test, four lanes per gather on AVX2
+void batch_test_run(Batch_Engine *batch)
+{
+    int count = batch->test_count;
+    const u8 *base = (const u8 *)batch->rows;
+    int index = 0;
+#ifdef __AVX2__
+    __m256i zero = _mm256_setzero_si256();
+    for (;
+         index + 4 <= count;
+         index += 4)
+    {
+        __m256i offsets = _mm256_loadu_si256((const __m256i *)(batch->test_offset + index));
+        __m256i masks = _mm256_loadu_si256((const __m256i *)(batch->test_mask + index));
+        __m256i windows = _mm256_i64gather_epi64((const long long *)base, offsets, 1);
+        __m256i hits = _mm256_cmpeq_epi64(_mm256_and_si256(windows, masks), zero);
+        int valid = _mm256_movemask_pd(_mm256_castsi256_pd(hits));
+        batch->test_valid[index + 0] = (valid >> 0) & 1;
+        batch->test_valid[index + 1] = (valid >> 1) & 1;
+        batch->test_valid[index + 2] = (valid >> 2) & 1;
+        batch->test_valid[index + 3] = (valid >> 3) & 1;
+    }
+#endif
+    for (;
+         index < count;
+         ++index)
+    {
+        u64 window;
+        memcpy(&window, base + batch->test_offset[index], sizeof(window));
+        batch->test_valid[index] = (window & batch->test_mask[index]) == 0;
+    }
+}
+
+bool batch_piece_valid(Batch_Engine *batch, int lane,
+                       u8 tetromino, int rotation, int offset_row, int offset_col)
+{
+    u64 window = batch_load_window(batch_lane_rows(batch, lane), offset_row);
+    return (window & batch_piece_mask(tetromino, rotation, offset_col)) == 0;
+}
+
+//Bit n is set when board row n is full
+u32 batch_find_lines(const u16 *rows)
+{
+#ifdef __AVX2__
+    __m256i full = _mm256_set1_epi16((short)BATCH_FULL_ROW);
+    __m256i lo = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)rows), full);
+    __m256i hi = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)(rows + 16)), full);
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), 0xD8);
+    return (u32)_mm256_movemask_epi8(packed) & BATCH_BOARD_ROWS_MASK;
+#else
+    u32 lines = 0;
+    for (int row = 0;
+         row < HEIGHT;
+         ++row)
+    {
+        if (rows[row] == BATCH_FULL_ROW)
+        {
+            lines |= 1u << row;
+        }
+    }
+    return lines;
+#endif
+}
+
+//Removes the full rows, top to bottom so lower row indices stay put
+void batch_clear_lines(u16 *rows, u32 lines)
+{
+#ifdef __AVX2__
+    __m256i lo = _mm256_loadu_si256((const __m256i *)rows);
+    __m256i hi = _mm256_loadu_si256((const __m256i *)(rows + 16));
+    __m256i index_lo = _mm256_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7,
+                                         8, 9, 10, 11, 12, 13, 14, 15);
+    __m256i index_hi = _mm256_add_epi16(index_lo, _mm256_set1_epi16(16));
+    __m256i top_row = _mm256_setr_epi16((short)BATCH_WALL_ROW, 0, 0, 0, 0, 0, 0, 0,
+                                        0, 0, 0, 0, 0, 0, 0, 0);
+    while (lines)
+    {
+        int row = __builtin_ctz(lines);
+        lines &= lines - 1;
+
+        //Every row moves down one slot, the top row becomes empty
+        __m256i shifted_lo = _mm256_alignr_epi8(lo, _mm256_permute2x128_si256(lo, lo, 0x08), 14);
+        __m256i shifted_hi = _mm256_alignr_epi8(hi, _mm256_permute2x128_si256(hi, lo, 0x03), 14);
+        shifted_lo = _mm256_or_si256(shifted_lo, top_row);
+
+        __m256i limit = _mm256_set1_epi16((short)(row + 1));
+        lo = _mm256_blendv_epi8(lo, shifted_lo, _mm256_cmpgt_epi16(limit, index_lo));
+        hi = _mm256_blendv_epi8(hi, shifted_hi, _mm256_cmpgt_epi16(limit, index_hi));
+    }
+    _mm256_storeu_si256((__m256i *)rows, lo);
+    _mm256_storeu_si256((__m256i *)(rows + 16), hi);
+#else
+    while (lines)
+    {
+        int row = 0;
+        while (!(lines & (1u << row)))
+        {
+            ++row;
+        }
+        lines &= lines - 1;
+
+        memmove(rows + 1, rows, row * sizeof(u16));
+        rows[0] = BATCH_WALL_ROW;
+    }
+#endif
+}
+
+void batch_merge_piece(Batch_Engine *batch, int lane)
+{
+    u16 *rows = batch_lane_rows(batch, lane);
+    int offset_row = batch->offset_row[lane];
+    u64 window = batch_load_window(rows, offset_row);
+    window |= batch_piece_mask(batch->tetromino[lane],
+                               batch->rotation[lane],
+                               batch->offset_col[lane]);
+    batch_store_window(rows, offset_row, window);
+}
+
+//Same draws in the same order as spawn_piece
+void batch_spawn_piece(Batch_Engine *batch, int lane, bool start = false)
+{
+    u32 *rng = batch->rng_state + lane;
+    int piece_count = (int)ARRAY_COUNT(TETROMINOS) - 1;
+    if (start)
+    {
+        batch->tetromino[lane] = (u8)(1 + random_next(rng) % piece_count);
+        batch->next_tetromino[lane] = (u8)(1 + random_next(rng) % piece_count);
+    }
+    else
+    {
+        batch->tetromino[lane] = batch->next_tetromino[lane];
+        batch->next_tetromino[lane] = (u8)(1 + random_next(rng) % piece_count);
+    }
+    batch->rotation[lane] = 0;
+    batch->offset_row[lane] = 0;
+    batch->offset_col[lane] = WIDTH / 2;
+    batch->next_drop_time[lane] = batch->time[lane] + get_time_to_next_drop(batch->level[lane]);
+}
+
+//Applies the result of a one-row drop test, mirroring soft_drop
+bool batch_finish_drop(Batch_Engine *batch, int lane, bool valid)
+{
+    if (!valid)
+    {
+        batch_merge_piece(batch, lane);
+        batch_spawn_piece(batch, lane);
+        return false;
+    }
+    ++batch->offset_row[lane];
+    batch->next_drop_time[lane] = batch->time[lane] + get_time_to_next_drop(batch->level[lane]);
+    return true;
+}
+
+enum Batch_Drop
+{
+    BATCH_DROP_SOFT,
+    BATCH_DROP_HARD,
+    BATCH_DROP_GRAVITY
+};
+
+//Drops every listed lane one row; hard drops repeat until the piece locks,
+//gravity repeats until the lane's drop timer has caught up
+void batch_run_drops(Batch_Engine *batch, int count, Batch_Drop drop)
+{
+    s32 *lanes = batch->drop_lane;
+    while (count)
+    {
+        batch->test_count = 0;
+        for (int i = 0;
+             i < count;
+             ++i)
+        {
+            int lane = lanes[i];
+            batch_test_push(batch, lane,
+                            batch->tetromino[lane],
+                            batch->rotation[lane],
+                            batch->offset_row[lane] + 1,
+                            batch->offset_col[lane]);
+        }
+        batch_test_run(batch);
+
+        int remaining = 0;
+        for (int i = 0;
+             i < count;
+             ++i)
+        {
+            int lane = lanes[i];
+            bool dropped = batch_finish_drop(batch, lane, batch->test_valid[i]);
+            bool again = false;
+            if (drop == BATCH_DROP_HARD)
+            {
+                again = dropped;
+            }
+            else if (drop == BATCH_DROP_GRAVITY)
+            {
+                again = batch->time[lane] >= batch->next_drop_time[lane];
+            }
+            if (again)
+            {
+                lanes[remaining++] = lane;
+            }
+        }
+        count = remaining;
+    }
+}
+
+void batch_hold_piece(Batch_Engine *batch, int lane)
+{
+    if (!batch->hold_place[lane])
+    {
+        batch->hold_tetromino[lane] = batch->tetromino[lane];
+        batch_spawn_piece(batch, lane);
+        batch->hold_place[lane] = 1;
+    }
+    else if (batch_piece_valid(batch, lane,
+                               batch->hold_tetromino[lane],
+                               batch->rotation[lane],
+                               batch->offset_row[lane],
+                               batch->offset_col[lane]))
+    {
+        u8 temp = batch->tetromino[lane];
+        batch->tetromino[lane] = batch->hold_tetromino[lane];
+        batch->hold_tetromino[lane] = temp;
+    }
+}
+
+void batch_push_hold(Batch_Engine *batch, int lane)
+{
+    if (batch->hold_place[lane])
+    {
+        batch->next_tetromino[lane] = batch->hold_tetromino[lane];
+        batch->hold_tetromino[lane] = 0;
+        batch->hold_place[lane] = 0;
+    }
+}
+
+//Mirrors update_game_start pressing space: fresh board, first two pieces, play phase
+void batch_reset(Batch_Engine *batch, int lane, u32 seed, int start_level)
+{
+    u16 *rows = batch_lane_rows(batch, lane);
+    for (int row = 0;
+         row < HEIGHT;
+         ++row)
+    {
+        rows[row] = BATCH_WALL_ROW;
+    }
+
+    batch->rng_state[lane] = seed;
+    batch->frame[lane] = 1;
+    batch->time[lane] = batch->frame[lane] * TARGET_SECONDS_PER_FRAME;
+    batch->start_level[lane] = start_level;
+    batch->level[lane] = start_level;
+    batch->line_count[lane] = 0;
+    batch->points[lane] = 0;
+    batch->lines[lane] = 0;
+    batch->pending_line_count[lane] = 0;
+    batch->hold_tetromino[lane] = 0;
+    batch->hold_place[lane] = 0;
+    batch->pause[lane] = 0;
+    batch->prev_buttons[lane] = 0;
+    batch->highlight_end_time[lane] = 0;
+    batch_spawn_piece(batch, lane, true);
+    batch->phase[lane] = GAME_PHASE_PLAY;
+}
+
+//Advances every playing lane one frame with the per-lane button masks.
+//Each stage of update_game_play runs over all lanes before the next one.
+void batch_step(Batch_Engine *batch, const u16 *buttons)
+{
+    s32 *play = batch->play_lane;
+    int play_count = 0;
+    for (int lane = 0;
+         lane < batch->count;
+         ++lane)
+    {
+        u8 phase = batch->phase[lane];
+        if (phase != GAME_PHASE_PLAY && phase != GAME_PHASE_LINE)
+        {
+            continue;
+        }
+
+        ++batch->frame[lane];
+        float time = batch->frame[lane] * TARGET_SECONDS_PER_FRAME;
+        batch->time[lane] = time;
+        batch->pressed[lane] = buttons[lane] & ~batch->prev_buttons[lane];
+        batch->prev_buttons[lane] = buttons[lane];
+
+        if (phase == GAME_PHASE_PLAY)
+        {
+            play[play_count++] = lane;
+        }
+        else if (time >= batch->highlight_end_time[lane])
+        {
+            int line_count = batch->pending_line_count[lane];
+            batch_clear_lines(batch_lane_rows(batch, lane), batch->lines[lane]);
+            batch->line_count[lane] += line_count;
+            batch->points[lane] += compute_points(batch->level[lane], line_count);
+            if (batch->line_count[lane] >= get_lines_for_next_level(batch->start_level[lane],
+                                                                   batch->level[lane]))
+            {
+                ++batch->level[lane];
+            }
+            batch->phase[lane] = GAME_PHASE_PLAY;
+        }
+    }
+
+    batch->test_count = 0;
+    for (int i = 0;
+         i < play_count;
+         ++i)
+    {
+        int lane = play[i];
+        u16 pressed = batch->pressed[lane];
+        if (pressed & INPUT_P)
+        {
+            batch->pause[lane] = (batch->pause[lane] + 1) % 2;
+        }
+
+        int offset_col = batch->offset_col[lane];
+        int rotation = batch->rotation[lane];
+        if (!batch->pause[lane])
+        {
+            offset_col -= (pressed & INPUT_LEFT) != 0;
+            offset_col += (pressed & INPUT_RIGHT) != 0;
+            rotation = (rotation + ((pressed & INPUT_UP) != 0)) % 4;
+        }
+        batch_test_push(batch, lane, batch->tetromino[lane], rotation,
+                        batch->offset_row[lane], offset_col);
+    }
+    batch_test_run(batch);
+    for (int i = 0;
+         i < batch->test_count;
+         ++i)
+    {
+        if (batch->test_valid[i])
+        {
+            int lane = batch->test_lane[i];
+            batch->offset_col[lane] = batch->test_col[i];
+            batch->rotation[lane] = batch->test_rotation[i];
+        }
+    }
+
+    int drop_count = 0;
+    for (int i = 0;
+         i < play_count;
+         ++i)
+    {
+        int lane = play[i];
+        if (!batch->pause[lane] && (batch->pressed[lane] & INPUT_DOWN))
+        {
+            batch->drop_lane[drop_count++] = lane;
+        }
+    }
+    batch_run_drops(batch, drop_count, BATCH_DROP_SOFT);
+
+    drop_count = 0;
+    for (int i = 0;
+         i < play_count;
+         ++i)
+    {
+        int lane = play[i];
+        if (!batch->pause[lane] && (batch->pressed[lane] & INPUT_SPACE))
+        {
+            batch->drop_lane[drop_count++] = lane;
+        }
+    }
+    batch_run_drops(batch, drop_count, BATCH_DROP_HARD);
+
+    drop_count = 0;
+    for (int i = 0;
+         i < play_count;
+         ++i)
+    {
+        int lane = play[i];
+        if (!batch->pause[lane] && batch->time[lane] >= batch->next_drop_time[lane])
+        {
+            batch->drop_lane[drop_count++] = lane;
+        }
+    }
+    batch_run_drops(batch, drop_count, BATCH_DROP_GRAVITY);
+
+    for (int i = 0;
+         i < play_count;
+         ++i)
+    {
+        int lane = play[i];
+        u16 pressed = batch->pressed[lane];
+        if (batch->pause[lane])
+        {
+            pressed = 0;
+        }
+        if (pressed & INPUT_G)
+        {
+            batch_hold_piece(batch, lane);
+        }
+        if (pressed & INPUT_H)
+        {
+            batch_push_hold(batch, lane);
+        }
+
+        const u16 *rows = batch_lane_rows(batch, lane);
+        u32 lines = batch_find_lines(rows);
+        batch->lines[lane] = lines;
+        batch->pending_line_count[lane] = __builtin_popcount(lines);
+        if (lines)
+        {
+            batch->phase[lane] = GAME_PHASE_LINE;
+            batch->highlight_end_time[lane] = batch->time[lane] + 0.5f;
+        }
+
+        if (rows[0] & BATCH_CELL_BITS)
+        {
+            batch->phase[lane] = GAME_PHASE_GAMEOVER;
+        }
+    }
+}
+
+#endif
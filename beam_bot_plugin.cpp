@@ -0,0 +1,64 @@
+//The beam search bot from bot.h as a tournament plugin, one search thread per instance.
+//Build: g++ -O2 -mavx2 -shared -fPIC beam_bot_plugin.cpp -o beam_bot.so
+//       (on Windows: g++ -O2 -mavx2 -shared beam_bot_plugin.cpp -o beam_bot.dll)
+
+#include "game.h"
+#include "bot.h"
+#include "bot_plugin.h"
+
+//The beam search draws no random numbers, so it has no use for the seed
+void *beam_plugin_create(uint32_t)
+{
+    Bot_Config config = bot_default_config();
+    config.threads = 1;
+    //The host's budget is what counts; decide narrows this to it on every call
+    config.time_budget_ms = 1e9f;
+    return bot_create(&config);
+}
+
+void beam_plugin_destroy(void *bot)
+{
+    bot_destroy((Bot *)bot);
+}
+
+int beam_plugin_decide(void *data, const Bot_Plugin_View *view, Bot_Plugin_Move *move)
+{
+    Bot *bot = (Bot *)data;
+    //Leave a margin for the host's own bookkeeping inside the timed call
+    bot->config.time_budget_ms = view->budget_us * 0.0008f;
+
+    Game_State game = {};
+    memcpy(game.board, view->board, sizeof(game.board));
+    game.piece.tetromino_index = view->piece.tetromino;
+    game.piece.rotation = view->piece.rotation;
+    game.piece.offset_row = view->piece.offset_row;
+    game.piece.offset_col = view->piece.offset_col;
+    game.nextPiece.tetromino_index = view->next;
+    game.holdPiece.tetromino_index = view->hold;
+    game.holdPlace = view->hold != 0;
+    game.level = view->level;
+
+    Bot_Move decided;
+    if (!bot_decide(bot, &game, view->hold_allowed != 0, &decided))
+    {
+        return 0;
+    }
+    move->use_hold = decided.use_hold;
+    move->rotation = decided.rotation;
+    move->offset_row = decided.offset_row;
+    move->offset_col = decided.offset_col;
+    return 1;
+}
+
+const Bot_Plugin BEAM_PLUGIN = {
+    BOT_PLUGIN_ABI_VERSION,
+    "beam",
+    beam_plugin_create,
+    beam_plugin_destroy,
+    beam_plugin_decide
+};
+
+extern "C" BOT_PLUGIN_EXPORT const Bot_Plugin *bot_plugin_entry(void)
+{
+    return &BEAM_PLUGIN;
+}
@@ -0,0 +1,334 @@
+//Builds the opening book read by opening_book.h: every position the first pieces of a game
+//can lead to, with the move a slow, wide bot search picks for it.
+//Build: g++ -O2 book_gen.cpp -o book_gen -pthread
+//Usage: book_gen [--pieces n] [--beam n] [--budget ms] [--threads n] [--out file]
+//
+//Positions are expanded level by level from the empty board over every hand and next
+//piece, following the book's own move and branching over the piece that comes in next.
+//Each piece multiplies the positions by about seven, and by 49 where the bot holds into
+//an empty slot, so a few pieces deep is already tens of thousands of searches.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+#include "game.h"
+#include "bot.h"
+
+struct Book_Position
+{
+    u16 rows[BATCH_ROWS];
+    u8 hand;
+    u8 next;
+    u8 hold;
+    u8 depth;
+    bool decided;
+    Bot_Move move;
+};
+
+struct Book_Generator
+{
+    std::vector<Book_Position> positions;
+    std::unordered_map<u64, int> index;
+    Bot *bots[BOT_MAX_WORKERS];
+    int first;
+    int last;
+};
+
+void add_position(Book_Generator *gen, const u16 *rows, u8 hand, u8 next, u8 hold, int depth)
+{
+    u64 key = opening_book_key(rows, hand, next, hold);
+    if (gen->index.count(key))
+    {
+        return;
+    }
+    Book_Position position = {};
+    memcpy(position.rows, rows, sizeof(position.rows));
+    position.hand = hand;
+    position.next = next;
+    position.hold = hold;
+    position.depth = (u8)depth;
+    gen->index[key] = (int)gen->positions.size();
+    gen->positions.push_back(position);
+}
+
+void decide_task(void *data, int task, int worker)
+{
+    Book_Generator *gen = (Book_Generator *)data;
+    Book_Position *position = &gen->positions[gen->first + task];
+
+    Game_State game = {};
+    for (int row = 0;
+         row < HEIGHT;
+         ++row)
+    {
+        for (int col = 0;
+             col < WIDTH;
+             ++col)
+        {
+            if (position->rows[row] & (1 << (col + BATCH_COL_SHIFT)))
+            {
+                matrix_set(game.board, WIDTH, row, col, 1);
+            }
+        }
+    }
+    game.piece.tetromino_index = position->hand;
+    game.nextPiece.tetromino_index = position->next;
+    game.holdPiece.tetromino_index = position->hold;
+    game.holdPlace = position->hold != 0;
+    position->decided = bot_decide(gen->bots[worker], &game, true, &position->move);
+}
+
+//Queues the positions a decided move leads to, one for each piece that can come in next
+void expand_position(Book_Generator *gen, int position_index)
+{
+    Book_Position position = gen->positions[position_index];
+    const Bot_Move *move = &position.move;
+    Bot_Placement placement;
+    placement.rotation = move->rotation;
+    placement.offset_row = move->offset_row;
+    placement.offset_col = move->offset_col;
+    u16 rows[BATCH_ROWS];
+    memcpy(rows, position.rows, sizeof(rows));
+    if (bot_place(rows, move->tetromino, &placement) < 0)
+    {
+        return;
+    }
+
+    int depth = position.depth + 1;
+    for (u8 piece = 1;
+         piece <= 7;
+         ++piece)
+    {
+        if (!move->use_hold)
+        {
+            add_position(gen, rows, position.next, piece, position.hold, depth);
+        }
+        else if (position.hold)
+        {
+            add_position(gen, rows, position.next, piece, position.hand, depth);
+        }
+        else
+        {
+            //Holding into an empty slot brought in the next piece, so both of the new ones are unknown
+            for (u8 after = 1;
+                 after <= 7;
+                 ++after)
+            {
+                add_position(gen, rows, piece, after, position.hand, depth);
+            }
+        }
+    }
+}
+
+struct Book_Slot_Move
+{
+    u64 key;
+    const Book_Position *position;
+    bool after_hold;
+};
+
+bool write_book(const char *path, const std::vector<Book_Slot_Move> &moves, int max_depth)
+{
+    u32 slot_count = 1;
+    while (slot_count < moves.size() * 2)
+    {
+        slot_count <<= 1;
+    }
+    Opening_Book_Entry *entries = (Opening_Book_Entry *)calloc(slot_count, sizeof(Opening_Book_Entry));
+    for (const Book_Slot_Move &slot_move : moves)
+    {
+        u32 slot = (u32)slot_move.key & (slot_count - 1);
+        while (entries[slot].key)
+        {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        const Book_Position *position = slot_move.position;
+        Opening_Book_Entry *entry = entries + slot;
+        entry->key = slot_move.key;
+        entry->use_hold = slot_move.after_hold ? 0 : position->move.use_hold;
+        entry->tetromino = position->move.tetromino;
+        entry->rotation = position->move.rotation;
+        entry->offset_row = position->move.offset_row;
+        entry->offset_col = position->move.offset_col;
+        entry->depth = position->depth;
+    }
+
+    Opening_Book_Header header = {};
+    header.magic = OPENING_BOOK_MAGIC;
+    header.version = OPENING_BOOK_VERSION;
+    header.slot_count = slot_count;
+    header.entry_count = (u32)moves.size();
+    header.max_depth = (u32)max_depth;
+
+    FILE *file = fopen(path, "wb");
+    bool written = file &&
+                   fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(entries, sizeof(Opening_Book_Entry), slot_count, file) == slot_count;
+    if (file && fclose(file) != 0)
+    {
+        written = false;
+    }
+    free(entries);
+    return written;
+}
+
+int main(int argc, char **argv)
+{
+    int pieces = 4;
+    int threads = 0;
+    const char *out = "opening.book";
+    Bot_Config config = bot_default_config();
+    config.beam_width = 256;
+    config.time_budget_ms = 200.0f;
+    for (int i = 1;
+         i + 1 < argc;
+         i += 2)
+    {
+        if (strcmp(argv[i], "--pieces") == 0)
+        {
+            pieces = max(1, min(atoi(argv[i + 1]), 16));
+        }
+        else if (strcmp(argv[i], "--beam") == 0)
+        {
+            config.beam_width = max(1, atoi(argv[i + 1]));
+        }
+        else if (strcmp(argv[i], "--budget") == 0)
+        {
+            config.time_budget_ms = (float)atof(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0)
+        {
+            threads = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "--out") == 0)
+        {
+            out = argv[i + 1];
+        }
+        else
+        {
+            fprintf(stderr, "usage: book_gen [--pieces n] [--beam n] [--budget ms] [--threads n] [--out file]\n");
+            return 1;
+        }
+    }
+    if (argc % 2 == 0)
+    {
+        fprintf(stderr, "usage: book_gen [--pieces n] [--beam n] [--budget ms] [--threads n] [--out file]\n");
+        return 1;
+    }
+
+    //Positions are spread over the workers, each with a single-threaded bot of its own
+    Thread_Pool *pool = thread_pool_create(threads);
+    int worker_count = min(pool->worker_count, BOT_MAX_WORKERS);
+    if (worker_count != pool->worker_count)
+    {
+        thread_pool_destroy(pool);
+        pool = thread_pool_create(worker_count);
+    }
+    config.threads = 1;
+    Book_Generator *gen = new Book_Generator();
+    for (int worker = 0;
+         worker < worker_count;
+         ++worker)
+    {
+        gen->bots[worker] = bot_create(&config);
+    }
+
+    u16 empty_rows[BATCH_ROWS];
+    u8 empty_board[WIDTH * HEIGHT] = {};
+    bot_rows_from_board(empty_rows, empty_board);
+    for (u8 hand = 1;
+         hand <= 7;
+         ++hand)
+    {
+        for (u8 next = 1;
+             next <= 7;
+             ++next)
+        {
+            add_position(gen, empty_rows, hand, next, 0, 0);
+        }
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    gen->first = 0;
+    for (int depth = 0;
+         depth < pieces;
+         ++depth)
+    {
+        gen->last = (int)gen->positions.size();
+        thread_pool_run(pool, gen->last - gen->first, decide_task, gen);
+        if (depth + 1 < pieces)
+        {
+            for (int i = gen->first;
+                 i < gen->last;
+                 ++i)
+            {
+                if (gen->positions[i].decided)
+                {
+                    expand_position(gen, i);
+                }
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        fprintf(stderr, "piece %d: %d positions, %.1f s\n", depth + 1, gen->last - gen->first, seconds);
+        gen->first = gen->last;
+    }
+
+    //After a hold the bot is asked again, with the held piece swapped out and hold no longer
+    //allowed; the answer is the spot it already chose, so those positions go in too.
+    //Positions the search decided directly take precedence.
+    std::vector<Book_Slot_Move> moves;
+    std::unordered_map<u64, bool> keys;
+    for (const Book_Position &position : gen->positions)
+    {
+        if (position.decided)
+        {
+            u64 key = opening_book_key(position.rows, position.hand, position.next, position.hold);
+            moves.push_back({ key, &position, false });
+            keys[key] = true;
+        }
+    }
+    for (const Book_Position &position : gen->positions)
+    {
+        if (!position.decided || !position.move.use_hold)
+        {
+            continue;
+        }
+        for (u8 piece = 1;
+             piece <= 7;
+             ++piece)
+        {
+            u64 key = position.hold ?
+                      opening_book_key(position.rows, position.hold, position.next, position.hand) :
+                      opening_book_key(position.rows, position.next, piece, position.hand);
+            if (!keys.count(key))
+            {
+                moves.push_back({ key, &position, true });
+                keys[key] = true;
+            }
+        }
+    }
+
+    bool written = write_book(out, moves, pieces);
+    if (written)
+    {
+        printf("%zu entries written to %s\n", moves.size(), out);
+    }
+    else
+    {
+        fprintf(stderr, "could not write %s\n", out);
+    }
+
+    for (int worker = 0;
+         worker < worker_count;
+         ++worker)
+    {
+        bot_destroy(gen->bots[worker]);
+    }
+    delete gen;
+    thread_pool_destroy(pool);
+    return written ? 0 : 1;
+}
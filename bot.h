@@ -0,0 +1,796 @@
+#ifndef BOT_H
+#define BOT_H
+
+#include <algorithm>
+#include <chrono>
+
+#include "arena.h"
+#include "thread_pool.h"
+#include "batch_engine.h"
+#include "finesse.h"
+#include "opening_book.h"
+#include "nn_eval.h"
+
+//Beam search over placements of the current, next and hold pieces.
+//Each ply keeps the best beam_width boards; nodes are expanded in parallel and
+//allocated from per-worker arenas that are reset at the start of every search.
+//An optional last ply averages the best placement over all seven pieces.
+//With an opening book attached, positions it covers are answered without searching.
+//With a network attached, boards are scored by it instead of the weighted features,
+//a whole piece's placements at a time; the points weight still prices line clears.
+
+#define BOT_MAX_PLACEMENTS 64
+#define BOT_MAX_CHILDREN (BOT_MAX_PLACEMENTS * 2)
+#define BOT_MAX_WORKERS 64
+#define BOT_ARENA_SIZE (8 << 20)
+#define BOT_LOST_SCORE -1e9f
+
+enum Bot_Weight
+{
+    BOT_WEIGHT_HEIGHT,
+    BOT_WEIGHT_MAX_HEIGHT,
+    BOT_WEIGHT_HOLES,
+    BOT_WEIGHT_BUMPINESS,
+    BOT_WEIGHT_WELLS,
+    BOT_WEIGHT_POINTS,
+    BOT_WEIGHT_COUNT
+};
+
+const float BOT_DEFAULT_WEIGHTS[BOT_WEIGHT_COUNT] = {
+    -0.51f,
+    -0.10f,
+    -0.36f,
+    -0.18f,
+    -0.05f,
+    0.76f
+};
+
+struct Bot_Config
+{
+    int beam_width;
+    float time_budget_ms;
+    int threads;
+    bool chance_ply;
+    float weights[BOT_WEIGHT_COUNT];
+};
+
+Bot_Config bot_default_config()
+{
+    Bot_Config config = {};
+    config.beam_width = 32;
+    config.time_budget_ms = 4.0f;
+    config.threads = 0;
+    config.chance_ply = true;
+    memcpy(config.weights, BOT_DEFAULT_WEIGHTS, sizeof(config.weights));
+    return config;
+}
+
+//Where the piece in hand, or the one taken from hold, comes to rest
+struct Bot_Move
+{
+    u8 use_hold;
+    u8 tetromino;
+    u8 rotation;
+    s8 offset_row;
+    s8 offset_col;
+};
+
+struct Bot_Placement
+{
+    u8 rotation;
+    s8 offset_row;
+    s8 offset_col;
+};
+
+struct Bot_Node
+{
+    u16 rows[BATCH_ROWS];
+    float reward;
+    float score;
+    u8 hand;
+    u8 hold;
+    u8 queue_used;
+    Bot_Move first;
+};
+
+struct Bot
+{
+    Bot_Config config;
+    Thread_Pool *pool;
+    Arena arenas[BOT_MAX_WORKERS];
+
+    Bot_Node **beam;
+    int beam_count;
+    Bot_Node **children[BOT_MAX_WORKERS];
+    int child_count[BOT_MAX_WORKERS];
+    int child_capacity;
+    Bot_Node **merged;
+
+    u8 queue[1];
+    int queue_count;
+    bool allow_hold;
+    std::chrono::steady_clock::time_point deadline;
+    std::atomic<bool> out_of_time;
+
+    //Owned by the caller, may be null
+    const Opening_Book *book;
+    const Nn_Model *model;
+};
+
+void bot_rows_from_board(u16 *rows, const u8 *board)
+{
+    for (int row = 0;
+         row < BATCH_ROWS;
+         ++row)
+    {
+        rows[row] = row < HEIGHT ? BATCH_WALL_ROW : BATCH_FULL_ROW;
+    }
+    for (int row = 0;
+         row < HEIGHT;
+         ++row)
+    {
+        for (int col = 0;
+             col < WIDTH;
+             ++col)
+        {
+            if (matrix_get(board, WIDTH, row, col))
+            {
+                rows[row] |= 1 << (col + BATCH_COL_SHIFT);
+            }
+        }
+    }
+}
+
+bool bot_piece_fits(const u16 *rows, u8 tetromino, int rotation, int offset_row, int offset_col)
+{
+    return (batch_load_window(rows, offset_row) &
+            batch_piece_mask(tetromino, rotation, offset_col)) == 0;
+}
+
+//Every resting spot reachable by rotating and shifting at the spawn row, then dropping
+int bot_generate_placements(const u16 *rows, u8 tetromino, Bot_Placement *placements)
+{
+    const int min_col = -BATCH_COL_SHIFT;
+    const int max_col = WIDTH - 1;
+    if (!bot_piece_fits(rows, tetromino, 0, 0, WIDTH / 2))
+    {
+        return 0;
+    }
+
+    u16 visited[4] = {};
+    u8 queue_rotation[4 * 16];
+    s8 queue_col[4 * 16];
+    int head = 0;
+    int tail = 0;
+    visited[0] |= 1 << (WIDTH / 2 - min_col);
+    queue_rotation[tail] = 0;
+    queue_col[tail++] = WIDTH / 2;
+    while (head < tail)
+    {
+        int rotation = queue_rotation[head];
+        int col = queue_col[head++];
+        int next_rotation[3] = { rotation, rotation, (rotation + 1) % 4 };
+        int next_col[3] = { col - 1, col + 1, col };
+        for (int i = 0;
+             i < 3;
+             ++i)
+        {
+            int r = next_rotation[i];
+            int c = next_col[i];
+            if (c < min_col || c > max_col || (visited[r] & (1 << (c - min_col))))
+            {
+                continue;
+            }
+            if (bot_piece_fits(rows, tetromino, r, 0, c))
+            {
+                visited[r] |= 1 << (c - min_col);
+                queue_rotation[tail] = (u8)r;
+                queue_col[tail++] = (s8)c;
+            }
+        }
+    }
+
+    //Rotations of symmetric pieces often land on identical cells, keep one of each
+    u64 landed_mask[BOT_MAX_PLACEMENTS];
+    int count = 0;
+    for (int i = 0;
+         i < tail;
+         ++i)
+    {
+        int rotation = queue_rotation[i];
+        int col = queue_col[i];
+        int row = 0;
+        while (bot_piece_fits(rows, tetromino, rotation, row + 1, col))
+        {
+            ++row;
+        }
+
+        u64 mask = batch_piece_mask(tetromino, rotation, col);
+        bool duplicate = false;
+        for (int j = 0;
+             j < count && !duplicate;
+             ++j)
+        {
+            duplicate = placements[j].offset_row == row && landed_mask[j] == mask;
+        }
+        if (!duplicate)
+        {
+            landed_mask[count] = mask;
+            placements[count].rotation = (u8)rotation;
+            placements[count].offset_row = (s8)row;
+            placements[count].offset_col = (s8)col;
+            ++count;
+        }
+    }
+    return count;
+}
+
+//Locks the piece and clears lines; returns -1 when it tops out like update_game_play would
+int bot_place(u16 *rows, u8 tetromino, const Bot_Placement *placement)
+{
+    u64 window = batch_load_window(rows, placement->offset_row);
+    window |= batch_piece_mask(tetromino, placement->rotation, placement->offset_col);
+    batch_store_window(rows, placement->offset_row, window);
+    if (rows[0] & BATCH_CELL_BITS)
+    {
+        return -1;
+    }
+
+    u32 lines = batch_find_lines(rows);
+    if (lines)
+    {
+        batch_clear_lines(rows, lines);
+    }
+    return __builtin_popcount(lines);
+}
+
+float bot_evaluate(const u16 *rows, const float *weights)
+{
+    int heights[WIDTH] = {};
+    u16 covered = 0;
+    int holes = 0;
+    for (int row = 0;
+         row < HEIGHT;
+         ++row)
+    {
+        u16 cells = rows[row] & BATCH_CELL_BITS;
+        holes += __builtin_popcount(covered & ~cells);
+        u16 first = cells & ~covered;
+        while (first)
+        {
+            int col = __builtin_ctz(first) - BATCH_COL_SHIFT;
+            heights[col] = HEIGHT - row;
+            first &= first - 1;
+        }
+        covered |= cells;
+    }
+
+    int total_height = 0;
+    int max_height = 0;
+    int bumpiness = 0;
+    int wells = 0;
+    for (int col = 0;
+         col < WIDTH;
+         ++col)
+    {
+        total_height += heights[col];
+        max_height = max(max_height, heights[col]);
+        if (col > 0)
+        {
+            int diff = heights[col] - heights[col - 1];
+            bumpiness += diff < 0 ? -diff : diff;
+        }
+        int left = col > 0 ? heights[col - 1] : HEIGHT;
+        int right = col < WIDTH - 1 ? heights[col + 1] : HEIGHT;
+        int depth = min(left, right) - heights[col];
+        if (depth > 0)
+        {
+            wells += depth;
+        }
+    }
+
+    return weights[BOT_WEIGHT_HEIGHT] * total_height +
+           weights[BOT_WEIGHT_MAX_HEIGHT] * max_height +
+           weights[BOT_WEIGHT_HOLES] * holes +
+           weights[BOT_WEIGHT_BUMPINESS] * bumpiness +
+           weights[BOT_WEIGHT_WELLS] * wells;
+}
+
+//Line reward in compute_points proportions, so tetrises are worth chasing
+float bot_line_reward(int lines, const float *weights)
+{
+    return weights[BOT_WEIGHT_POINTS] * compute_points(0, lines) / 40.0f;
+}
+
+Bot_Node *bot_push_child(Bot *bot, int worker)
+{
+    if (bot->child_count[worker] == bot->child_capacity)
+    {
+        return 0;
+    }
+    Bot_Node *child = (Bot_Node *)arena_push(bot->arenas + worker, sizeof(Bot_Node));
+    if (child)
+    {
+        bot->children[worker][bot->child_count[worker]++] = child;
+    }
+    return child;
+}
+
+//Adds the network's score to the children pushed since first
+void bot_evaluate_children(Bot *bot, int worker, int first)
+{
+    Bot_Node **children = bot->children[worker] + first;
+    int count = min(bot->child_count[worker] - first, BOT_MAX_PLACEMENTS);
+    Nn_Position positions[BOT_MAX_PLACEMENTS];
+    float scores[BOT_MAX_PLACEMENTS];
+    for (int i = 0;
+         i < count;
+         ++i)
+    {
+        positions[i].rows = children[i]->rows;
+        positions[i].hand = children[i]->hand;
+        positions[i].hold = children[i]->hold;
+    }
+    nn_evaluate_batch(bot->model, positions, count, scores);
+    for (int i = 0;
+         i < count;
+         ++i)
+    {
+        children[i]->score += scores[i];
+    }
+}
+
+void bot_expand_piece(Bot *bot, int worker, const Bot_Node *node,
+                      u8 tetromino, u8 hand, u8 hold, u8 queue_used, bool use_hold)
+{
+    const float *weights = bot->config.weights;
+    int first_child = bot->child_count[worker];
+    Bot_Placement placements[BOT_MAX_PLACEMENTS];
+    int count = bot_generate_placements(node->rows, tetromino, placements);
+    for (int i = 0;
+         i < count;
+         ++i)
+    {
+        u16 rows[BATCH_ROWS];
+        memcpy(rows, node->rows, sizeof(rows));
+        int lines = bot_place(rows, tetromino, placements + i);
+        if (lines < 0)
+        {
+            continue;
+        }
+
+        Bot_Node *child = bot_push_child(bot, worker);
+        if (!child)
+        {
+            break;
+        }
+        memcpy(child->rows, rows, sizeof(rows));
+        child->reward = node->reward + bot_line_reward(lines, weights);
+        child->score = child->reward + (bot->model ? 0 : bot_evaluate(rows, weights));
+        child->hand = hand;
+        child->hold = hold;
+        child->queue_used = queue_used;
+        if (node->first.tetromino)
+        {
+            child->first = node->first;
+        }
+        else
+        {
+            child->first.use_hold = use_hold;
+            child->first.tetromino = tetromino;
+            child->first.rotation = placements[i].rotation;
+            child->first.offset_row = placements[i].offset_row;
+            child->first.offset_col = placements[i].offset_col;
+        }
+    }
+    if (bot->model)
+    {
+        bot_evaluate_children(bot, worker, first_child);
+    }
+}
+
+//Children for placing the piece in hand, swapping with hold, or filling an empty hold
+void bot_expand_task(void *data, int task, int worker)
+{
+    Bot *bot = (Bot *)data;
+    const Bot_Node *node = bot->beam[task];
+    bool root = node->first.tetromino == 0;
+    if (!root && std::chrono::steady_clock::now() > bot->deadline)
+    {
+        bot->out_of_time.store(true, std::memory_order_relaxed);
+        return;
+    }
+
+    if (!node->hand)
+    {
+        //Nothing more is known about this line, carry it over as it is
+        Bot_Node *child = bot_push_child(bot, worker);
+        if (child)
+        {
+            *child = *node;
+        }
+        return;
+    }
+
+    u8 queue_used = node->queue_used;
+    u8 upcoming = queue_used < bot->queue_count ? bot->queue[queue_used] : 0;
+    bool allow_hold = !root || bot->allow_hold;
+
+    bot_expand_piece(bot, worker, node, node->hand, upcoming, node->hold,
+                     (u8)(queue_used + 1), false);
+    if (allow_hold && node->hold && node->hold != node->hand)
+    {
+        bot_expand_piece(bot, worker, node, node->hold, upcoming, node->hand,
+                         (u8)(queue_used + 1), true);
+    }
+    if (allow_hold && !node->hold && upcoming)
+    {
+        //The piece after the one taken from the queue is not known yet
+        bot_expand_piece(bot, worker, node, upcoming, 0, node->hand,
+                         (u8)bot->queue_count, true);
+    }
+}
+
+//Replaces each node's score with the average of its best placement over every piece
+void bot_chance_task(void *data, int task, int)
+{
+    Bot *bot = (Bot *)data;
+    Bot_Node *node = bot->beam[task];
+    const float *weights = bot->config.weights;
+    if (std::chrono::steady_clock::now() > bot->deadline)
+    {
+        bot->out_of_time.store(true, std::memory_order_relaxed);
+        return;
+    }
+
+    float total = 0;
+    for (u8 tetromino = 1;
+         tetromino < ARRAY_COUNT(TETROMINOS);
+         ++tetromino)
+    {
+        Bot_Placement placements[BOT_MAX_PLACEMENTS];
+        int count = bot_generate_placements(node->rows, tetromino, placements);
+        float best = BOT_LOST_SCORE;
+        u16 rows[BOT_MAX_PLACEMENTS][BATCH_ROWS];
+        Nn_Position positions[BOT_MAX_PLACEMENTS];
+        float rewards[BOT_MAX_PLACEMENTS];
+        int placed = 0;
+        for (int i = 0;
+             i < count;
+             ++i)
+        {
+            memcpy(rows[placed], node->rows, sizeof(rows[placed]));
+            int lines = bot_place(rows[placed], tetromino, placements + i);
+            if (lines < 0)
+            {
+                continue;
+            }
+            if (!bot->model)
+            {
+                best = std::max(best, bot_line_reward(lines, weights) + bot_evaluate(rows[placed], weights));
+                continue;
+            }
+            //The piece after this one is not known
+            positions[placed].rows = rows[placed];
+            positions[placed].hand = 0;
+            positions[placed].hold = node->hold;
+            rewards[placed] = bot_line_reward(lines, weights);
+            ++placed;
+        }
+        if (placed)
+        {
+            float scores[BOT_MAX_PLACEMENTS];
+            nn_evaluate_batch(bot->model, positions, placed, scores);
+            for (int i = 0;
+                 i < placed;
+                 ++i)
+            {
+                best = std::max(best, rewards[i] + scores[i]);
+            }
+        }
+        total += best;
+    }
+    node->score = node->reward + total / (ARRAY_COUNT(TETROMINOS) - 1);
+}
+
+bool bot_node_better(const Bot_Node *a, const Bot_Node *b)
+{
+    return a->score > b->score;
+}
+
+Bot *bot_create(const Bot_Config *config)
+{
+    batch_init_piece_masks();
+
+    Bot *bot = new Bot();
+    bot->config = *config;
+    bot->pool = thread_pool_create(config->threads);
+    if (bot->pool->worker_count > BOT_MAX_WORKERS)
+    {
+        thread_pool_destroy(bot->pool);
+        bot->pool = thread_pool_create(BOT_MAX_WORKERS);
+    }
+
+    //Worst case every node of a ply lands on the same worker
+    int beam_width = max(config->beam_width, 1);
+    bot->child_capacity = beam_width * BOT_MAX_CHILDREN;
+    bot->beam = new Bot_Node *[bot->child_capacity];
+    bot->merged = new Bot_Node *[bot->child_capacity * bot->pool->worker_count];
+    for (int worker = 0;
+         worker < bot->pool->worker_count;
+         ++worker)
+    {
+        arena_init(bot->arenas + worker, BOT_ARENA_SIZE);
+        bot->children[worker] = new Bot_Node *[bot->child_capacity];
+    }
+    return bot;
+}
+
+void bot_destroy(Bot *bot)
+{
+    for (int worker = 0;
+         worker < bot->pool->worker_count;
+         ++worker)
+    {
+        arena_free(bot->arenas + worker);
+        delete[] bot->children[worker];
+    }
+    delete[] bot->beam;
+    delete[] bot->merged;
+    thread_pool_destroy(bot->pool);
+    delete bot;
+}
+
+//The book's move for this position, if it has one that still makes sense here.
+//A key collision or a book written against other piece shapes must not crash the game,
+//so the spot is checked to be free and resting before it is trusted.
+bool bot_book_move(const Opening_Book *book, const Game_State *game, bool allow_hold, Bot_Move *move)
+{
+    u16 rows[BATCH_ROWS];
+    bot_rows_from_board(rows, game->board);
+    u8 hand = game->piece.tetromino_index;
+    u8 next = game->nextPiece.tetromino_index;
+    u8 hold = game->holdPlace ? game->holdPiece.tetromino_index : 0;
+    const Opening_Book_Entry *entry = opening_book_find(book, opening_book_key(rows, hand, next, hold));
+    if (!entry || (entry->use_hold && !allow_hold))
+    {
+        return false;
+    }
+
+    u8 placed = entry->use_hold ? (hold ? hold : next) : hand;
+    if (entry->tetromino != placed || entry->rotation > 3 ||
+        entry->offset_row < 0 || entry->offset_row >= HEIGHT ||
+        entry->offset_col < -BATCH_COL_SHIFT || entry->offset_col > WIDTH - 1 ||
+        !bot_piece_fits(rows, placed, entry->rotation, entry->offset_row, entry->offset_col) ||
+        bot_piece_fits(rows, placed, entry->rotation, entry->offset_row + 1, entry->offset_col))
+    {
+        return false;
+    }
+
+    move->use_hold = entry->use_hold != 0;
+    move->tetromino = entry->tetromino;
+    move->rotation = entry->rotation;
+    move->offset_row = entry->offset_row;
+    move->offset_col = entry->offset_col;
+    return true;
+}
+
+//Picks a placement for the piece in play; false when every placement tops out
+bool bot_decide(Bot *bot, const Game_State *game, bool allow_hold, Bot_Move *move)
+{
+    TRACE_ZONE("bot_decide");
+    if (bot->book && bot_book_move(bot->book, game, allow_hold, move))
+    {
+        return true;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    bot->deadline = start + std::chrono::microseconds((s64)(bot->config.time_budget_ms * 1000));
+    bot->out_of_time.store(false, std::memory_order_relaxed);
+    bot->allow_hold = allow_hold;
+    bot->queue[0] = game->nextPiece.tetromino_index;
+    bot->queue_count = bot->queue[0] ? 1 : 0;
+
+    int worker_count = bot->pool->worker_count;
+    for (int worker = 0;
+         worker < worker_count;
+         ++worker)
+    {
+        arena_reset(bot->arenas + worker);
+    }
+
+    Bot_Node *root = (Bot_Node *)arena_push(bot->arenas, sizeof(Bot_Node));
+    *root = {};
+    bot_rows_from_board(root->rows, game->board);
+    root->hand = game->piece.tetromino_index;
+    root->hold = game->holdPlace ? game->holdPiece.tetromino_index : 0;
+    bot->beam[0] = root;
+    bot->beam_count = 1;
+
+    int beam_width = max(bot->config.beam_width, 1);
+    for (;;)
+    {
+        for (int worker = 0;
+             worker < worker_count;
+             ++worker)
+        {
+            bot->child_count[worker] = 0;
+        }
+        thread_pool_run(bot->pool, bot->beam_count, bot_expand_task, bot);
+
+        int merged_count = 0;
+        for (int worker = 0;
+             worker < worker_count;
+             ++worker)
+        {
+            memcpy(bot->merged + merged_count, bot->children[worker],
+                   bot->child_count[worker] * sizeof(Bot_Node *));
+            merged_count += bot->child_count[worker];
+        }
+        if (merged_count == 0)
+        {
+            break;
+        }
+        //A ply the deadline cut short only expanded part of the beam; the last complete ply
+        //ranks better, unless this was the first
+        if (bot->out_of_time.load(std::memory_order_relaxed) && bot->beam[0] != root)
+        {
+            break;
+        }
+
+        int keep = min(merged_count, beam_width);
+        std::partial_sort(bot->merged, bot->merged + keep, bot->merged + merged_count,
+                          bot_node_better);
+        memcpy(bot->beam, bot->merged, keep * sizeof(Bot_Node *));
+        bot->beam_count = keep;
+
+        bool open = false;
+        for (int i = 0;
+             i < keep && !open;
+             ++i)
+        {
+            open = bot->beam[i]->hand != 0;
+        }
+        if (!open || bot->out_of_time.load(std::memory_order_relaxed))
+        {
+            break;
+        }
+    }
+
+    if (bot->beam[0] == root)
+    {
+        return false;
+    }
+
+    if (bot->config.chance_ply && !bot->out_of_time.load(std::memory_order_relaxed))
+    {
+        thread_pool_run(bot->pool, bot->beam_count, bot_chance_task, bot);
+        //A cut-short chance ply scores nodes unevenly, fall back to the plain ranking
+        if (!bot->out_of_time.load(std::memory_order_relaxed))
+        {
+            std::sort(bot->beam, bot->beam + bot->beam_count, bot_node_better);
+        }
+    }
+
+    *move = bot->beam[0]->first;
+    return true;
+}
+
+//Puts the piece straight onto a decided spot and hard drops it, for headless games.
+//Runs the frames of a line clear too, so the next piece is in play on return.
+//False when a hold did not bring the expected piece and the move has to be decided again.
+bool bot_apply_move(Game_State *game, const Bot_Move *move)
+{
+    if (move->use_hold)
+    {
+        hold_piece(game);
+    }
+    if (game->piece.tetromino_index != move->tetromino)
+    {
+        return false;
+    }
+
+    game->piece.rotation = move->rotation;
+    game->piece.offset_row = move->offset_row;
+    game->piece.offset_col = move->offset_col;
+
+    Input_State input = unpack_input(INPUT_SPACE, 0);
+    step_game(game, &input);
+    input = unpack_input(0, INPUT_SPACE);
+    while (game->phase == GAME_PHASE_LINE)
+    {
+        step_game(game, &input);
+    }
+    return true;
+}
+
+//Turns a decided move into key presses for the live game, one tap every other frame.
+//Taps follow a finesse path, replanned whenever the piece is not where the path expects.
+struct Bot_Player
+{
+    Bot *bot;
+    Bot_Move move;
+    bool has_move;
+    bool hold_used;
+    bool pending_hold;
+    u32 piece_count;
+
+    Finesse_Path path;
+    bool has_path;
+    int path_step;
+    Piece_State expected;
+};
+
+u16 bot_player_buttons(Bot_Player *player, const Game_State *game, u16 prev_buttons)
+{
+    if (game->phase != GAME_PHASE_PLAY || game->pause)
+    {
+        return 0;
+    }
+
+    if (player->pending_hold)
+    {
+        //A hold into an empty slot spawns a piece, a swap does not; either way this piece is held
+        player->pending_hold = false;
+        player->piece_count = game->piece_count;
+    }
+    if (player->piece_count != game->piece_count)
+    {
+        player->piece_count = game->piece_count;
+        player->hold_used = false;
+        player->has_move = false;
+    }
+
+    if (!player->has_move)
+    {
+        player->has_move = bot_decide(player->bot, game, !player->hold_used, &player->move);
+        player->has_path = false;
+        if (!player->has_move)
+        {
+            return INPUT_SPACE;
+        }
+    }
+    if (prev_buttons)
+    {
+        return 0;
+    }
+
+    const Bot_Move *move = &player->move;
+    if (move->use_hold && !player->hold_used)
+    {
+        player->hold_used = true;
+        player->pending_hold = true;
+        player->has_move = false;
+        return INPUT_G;
+    }
+    if (game->piece.tetromino_index != move->tetromino)
+    {
+        player->has_move = false;
+        return 0;
+    }
+
+    Piece_State piece = game->piece;
+    if (!player->has_path ||
+        piece.rotation != player->expected.rotation ||
+        piece.offset_col != player->expected.offset_col)
+    {
+        player->has_path = finesse_find(game->board, &piece, move->rotation, move->offset_col,
+                                        &player->path);
+        player->path_step = 0;
+        player->expected = piece;
+        if (!player->has_path)
+        {
+            return INPUT_SPACE;
+        }
+    }
+    if (player->path_step == player->path.step_count)
+    {
+        return INPUT_SPACE;
+    }
+
+    u8 step = player->path.steps[player->path_step++];
+    finesse_apply_step(game->board, &player->expected, step);
+    return step;
+}
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef BOT_PLUGIN_H
+#define BOT_PLUGIN_H
+
+#include <stdint.h>
+
+/*
+Plain C interface for bots built as shared libraries, loaded by tournament.cpp.
+A plugin exports one function, bot_plugin_entry, returning a static Bot_Plugin.
+
+The host calls decide once for every piece with a read-only view of the game and
+expects a resting spot for the piece in play, or for the one a hold would bring in.
+decide is timed in thread CPU time; a call over the budget, a zero return or a spot
+the piece cannot get to by shifting and rotating from its spawn just drops the piece
+where it spawned.
+
+Instances are created per game and may run on several threads at once, so plugins
+must not share mutable state between instances.
+
+Version 1 is frozen: later versions only append fields, and View.size tells how much
+of the view the host filled in.
+*/
+
+#define BOT_PLUGIN_ABI_VERSION 1
+#define BOT_PLUGIN_WIDTH 10
+#define BOT_PLUGIN_HEIGHT 22
+#define BOT_PLUGIN_ENTRY_NAME "bot_plugin_entry"
+
+#ifdef _WIN32
+#define BOT_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define BOT_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+Tetrominos are numbered 1 to 7: I, O, T, S, Z, J, L. A piece sits in a 4x4 box whose
+top-left cell is (offset_row, offset_col); row 0 is the top of the well, which has two
+hidden rows above the twenty visible ones.
+*/
+typedef struct Bot_Plugin_Piece
+{
+    uint8_t tetromino;
+    uint8_t rotation;
+    int8_t offset_row;
+    int8_t offset_col;
+} Bot_Plugin_Piece;
+
+typedef struct Bot_Plugin_View
+{
+    uint32_t size;
+
+    /* HEIGHT x WIDTH cells, row-major from the top, zero is empty */
+    const uint8_t *board;
+    /* [tetromino][rotation][row * 4 + col], non-zero where the piece has a cell */
+    const uint8_t (*shapes)[4][16];
+
+    Bot_Plugin_Piece piece;
+    uint8_t next;
+    /* Zero when nothing is held */
+    uint8_t hold;
+    uint8_t hold_allowed;
+
+    int32_t level;
+    int32_t line_count;
+    int32_t points;
+    uint32_t piece_count;
+    /* CPU time the host allows for this call */
+    uint32_t budget_us;
+} Bot_Plugin_View;
+
+/* Where the piece comes to rest; with use_hold, the piece is the one the hold brings in */
+typedef struct Bot_Plugin_Move
+{
+    uint8_t use_hold;
+    uint8_t rotation;
+    int8_t offset_row;
+    int8_t offset_col;
+} Bot_Plugin_Move;
+
+typedef struct Bot_Plugin
+{
+    uint32_t abi_version;
+    const char *name;
+    void *(*create)(uint32_t seed);
+    void (*destroy)(void *bot);
+    /* Non-zero when move was filled in */
+    int (*decide)(void *bot, const Bot_Plugin_View *view, Bot_Plugin_Move *move);
+} Bot_Plugin;
+
+typedef const Bot_Plugin *Bot_Plugin_Entry(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
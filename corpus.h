@@ -0,0 +1,510 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "mapped_file.h"
+
+//Persistent store of finished games for search and re-simulation.
+//Each game is the Game_State it started from plus its run-length encoded buttons, one
+//entry per step_game tick, appended to segment files in a directory. A memory-mapped
+//index keeps one u32 column per summary field so range queries scan only what they test.
+//Records hold Game_State as raw bytes, so a corpus is only readable by the build that
+//wrote it; the stored state size catches the common case of a changed layout.
+
+#define CORPUS_INDEX_MAGIC 0x58444E49
+#define CORPUS_RECORD_MAGIC 0x59414C50
+#define CORPUS_VERSION 1
+#define CORPUS_SEGMENT_BYTES (256u << 20)
+#define CORPUS_MAX_SEGMENTS 4096
+#define CORPUS_INITIAL_CAPACITY 4096
+
+enum Corpus_Column
+{
+    CORPUS_SEED,
+    CORPUS_START_LEVEL,
+    CORPUS_FINAL_LEVEL,
+    CORPUS_LINES,
+    CORPUS_POINTS,
+    CORPUS_DURATION,
+    CORPUS_SEGMENT,
+    CORPUS_OFFSET,
+    CORPUS_COLUMN_COUNT
+};
+
+const char *CORPUS_COLUMN_NAMES[CORPUS_COLUMN_COUNT] = {
+    "seed",
+    "start_level",
+    "final_level",
+    "lines",
+    "points",
+    "duration",
+    "segment",
+    "offset"
+};
+
+//Followed in the file by capacity values of each column in turn
+struct Corpus_Index_Header
+{
+    u32 magic;
+    u32 version;
+    u32 column_count;
+    u32 count;
+    u32 capacity;
+    u32 reserved[3];
+};
+
+struct Replay_Run
+{
+    u16 buttons;
+    u16 ticks;
+};
+
+struct Replay_Header
+{
+    u32 magic;
+    u32 state_size;
+    u32 tick_count;
+    u32 run_count;
+    u16 prev_buttons;
+    u16 reserved;
+    Game_State initial;
+};
+
+struct Corpus
+{
+    char directory[512];
+    Mapped_File index;
+    FILE *segment_file;
+    u32 segment;
+    u32 segment_size;
+    Mapped_File segments[CORPUS_MAX_SEGMENTS];
+};
+
+Corpus_Index_Header *corpus_header(Corpus *corpus)
+{
+    return (Corpus_Index_Header *)corpus->index.data;
+}
+
+u32 *corpus_column(Corpus *corpus, int column)
+{
+    Corpus_Index_Header *header = corpus_header(corpus);
+    return (u32 *)(corpus->index.data + sizeof(Corpus_Index_Header)) + (size_t)column * header->capacity;
+}
+
+u32 corpus_count(Corpus *corpus)
+{
+    return corpus_header(corpus)->count;
+}
+
+void corpus_segment_path(const Corpus *corpus, u32 segment, char *path, int size)
+{
+    snprintf(path, size, "%s/segment_%04u.dat", corpus->directory, segment);
+}
+
+bool corpus_open_segment(Corpus *corpus, u32 segment)
+{
+    char path[600];
+    corpus_segment_path(corpus, segment, path, sizeof(path));
+    if (corpus->segment_file)
+    {
+        fclose(corpus->segment_file);
+    }
+    corpus->segment_file = fopen(path, "ab");
+    if (!corpus->segment_file)
+    {
+        return false;
+    }
+    fseek(corpus->segment_file, 0, SEEK_END);
+    corpus->segment = segment;
+    corpus->segment_size = (u32)ftell(corpus->segment_file);
+    return true;
+}
+
+bool corpus_index_valid(Corpus *corpus)
+{
+    Corpus_Index_Header *header = corpus_header(corpus);
+    return corpus->index.size >= sizeof(Corpus_Index_Header) &&
+           header->magic == CORPUS_INDEX_MAGIC && header->version == CORPUS_VERSION &&
+           header->column_count == CORPUS_COLUMN_COUNT &&
+           corpus->index.size >= sizeof(Corpus_Index_Header) +
+                                 (size_t)CORPUS_COLUMN_COUNT * header->capacity * sizeof(u32);
+}
+
+//Creates the directory and an empty index when needed; null when either cannot be opened
+Corpus *corpus_open(const char *directory)
+{
+    Corpus *corpus = new Corpus();
+    snprintf(corpus->directory, sizeof(corpus->directory), "%s", directory);
+    char path[600];
+    snprintf(path, sizeof(path), "%s/index.dat", directory);
+    if (!make_directory(directory) || !mapped_file_open(&corpus->index, path, true))
+    {
+        delete corpus;
+        return 0;
+    }
+
+    if (corpus->index.size == 0)
+    {
+        size_t size = sizeof(Corpus_Index_Header) +
+                      (size_t)CORPUS_COLUMN_COUNT * CORPUS_INITIAL_CAPACITY * sizeof(u32);
+        if (!mapped_file_resize(&corpus->index, size))
+        {
+            mapped_file_close(&corpus->index);
+            delete corpus;
+            return 0;
+        }
+        Corpus_Index_Header *header = corpus_header(corpus);
+        header->magic = CORPUS_INDEX_MAGIC;
+        header->version = CORPUS_VERSION;
+        header->column_count = CORPUS_COLUMN_COUNT;
+        header->capacity = CORPUS_INITIAL_CAPACITY;
+    }
+
+    if (!corpus_index_valid(corpus))
+    {
+        mapped_file_close(&corpus->index);
+        delete corpus;
+        return 0;
+    }
+
+    u32 count = corpus_header(corpus)->count;
+    u32 segment = count ? corpus_column(corpus, CORPUS_SEGMENT)[count - 1] : 0;
+    if (!corpus_open_segment(corpus, segment))
+    {
+        mapped_file_close(&corpus->index);
+        delete corpus;
+        return 0;
+    }
+    return corpus;
+}
+
+//For tools that only query and replay: nothing is created, and a missing or foreign
+//directory is null. The corpus can't be appended to.
+Corpus *corpus_open_read(const char *directory)
+{
+    Corpus *corpus = new Corpus();
+    snprintf(corpus->directory, sizeof(corpus->directory), "%s", directory);
+    char path[600];
+    snprintf(path, sizeof(path), "%s/index.dat", directory);
+    if (!mapped_file_open(&corpus->index, path, false))
+    {
+        delete corpus;
+        return 0;
+    }
+    if (!corpus_index_valid(corpus))
+    {
+        mapped_file_close(&corpus->index);
+        delete corpus;
+        return 0;
+    }
+    return corpus;
+}
+
+void corpus_close(Corpus *corpus)
+{
+    if (!corpus)
+    {
+        return;
+    }
+    for (int segment = 0;
+         segment < CORPUS_MAX_SEGMENTS;
+         ++segment)
+    {
+        if (corpus->segments[segment].data)
+        {
+            mapped_file_close(corpus->segments + segment);
+        }
+    }
+    if (corpus->segment_file)
+    {
+        fclose(corpus->segment_file);
+    }
+    mapped_file_close(&corpus->index);
+    delete corpus;
+}
+
+//Doubles the index, moving columns from the back so none overwrites one not yet moved
+bool corpus_grow_index(Corpus *corpus)
+{
+    u32 old_capacity = corpus_header(corpus)->capacity;
+    u32 new_capacity = old_capacity * 2;
+    size_t size = sizeof(Corpus_Index_Header) +
+                  (size_t)CORPUS_COLUMN_COUNT * new_capacity * sizeof(u32);
+    if (!mapped_file_resize(&corpus->index, size))
+    {
+        return false;
+    }
+
+    u32 *columns = (u32 *)(corpus->index.data + sizeof(Corpus_Index_Header));
+    u32 count = corpus_header(corpus)->count;
+    for (int column = CORPUS_COLUMN_COUNT - 1;
+         column > 0;
+         --column)
+    {
+        memmove(columns + (size_t)column * new_capacity,
+                columns + (size_t)column * old_capacity,
+                count * sizeof(u32));
+    }
+    corpus_header(corpus)->capacity = new_capacity;
+    return true;
+}
+
+//The record goes to disk before its index row, and the count is bumped last
+bool corpus_append(Corpus *corpus, const Replay_Header *replay, const Replay_Run *runs,
+                   const Game_State *final_state)
+{
+    u32 record_size = sizeof(Replay_Header) + replay->run_count * sizeof(Replay_Run);
+    if (corpus->segment_size > 0 && corpus->segment_size + record_size > CORPUS_SEGMENT_BYTES)
+    {
+        if (corpus->segment + 1 >= CORPUS_MAX_SEGMENTS ||
+            !corpus_open_segment(corpus, corpus->segment + 1))
+        {
+            return false;
+        }
+    }
+    if (corpus_header(corpus)->count == corpus_header(corpus)->capacity &&
+        !corpus_grow_index(corpus))
+    {
+        return false;
+    }
+
+    u32 offset = corpus->segment_size;
+    if (fwrite(replay, sizeof(Replay_Header), 1, corpus->segment_file) != 1 ||
+        fwrite(runs, sizeof(Replay_Run), replay->run_count, corpus->segment_file) != replay->run_count ||
+        fflush(corpus->segment_file) != 0)
+    {
+        return false;
+    }
+    corpus->segment_size += record_size;
+
+    u32 row = corpus_header(corpus)->count;
+    corpus_column(corpus, CORPUS_SEED)[row] = replay->initial.rng_state;
+    corpus_column(corpus, CORPUS_START_LEVEL)[row] = (u32)final_state->start_level;
+    corpus_column(corpus, CORPUS_FINAL_LEVEL)[row] = (u32)final_state->level;
+    corpus_column(corpus, CORPUS_LINES)[row] = (u32)final_state->line_count;
+    corpus_column(corpus, CORPUS_POINTS)[row] = (u32)final_state->points;
+    corpus_column(corpus, CORPUS_DURATION)[row] = replay->tick_count;
+    corpus_column(corpus, CORPUS_SEGMENT)[row] = corpus->segment;
+    corpus_column(corpus, CORPUS_OFFSET)[row] = offset;
+    corpus_header(corpus)->count = row + 1;
+    return true;
+}
+
+//Inclusive bounds on one column
+struct Corpus_Range
+{
+    int column;
+    u32 min;
+    u32 max;
+};
+
+//Writes up to max_results matching game numbers in order and returns how many matched in all.
+//The first range scans its whole column, the rest only look at the survivors.
+u32 corpus_query(Corpus *corpus, const Corpus_Range *ranges, int range_count,
+                 u32 *results, u32 max_results)
+{
+    u32 count = corpus_count(corpus);
+    u32 *selection = (u32 *)malloc((count ? count : 1) * sizeof(u32));
+    u32 selected = 0;
+    if (range_count == 0)
+    {
+        for (u32 i = 0;
+             i < count;
+             ++i)
+        {
+            selection[selected++] = i;
+        }
+    }
+    else
+    {
+        const u32 *values = corpus_column(corpus, ranges[0].column);
+        u32 low = ranges[0].min;
+        u32 span = ranges[0].max - ranges[0].min;
+        for (u32 i = 0;
+             i < count;
+             ++i)
+        {
+            //One unsigned compare per row, and no branch for the compiler to trip over
+            selection[selected] = i;
+            selected += (values[i] - low) <= span;
+        }
+    }
+
+    for (int r = 1;
+         r < range_count;
+         ++r)
+    {
+        const u32 *values = corpus_column(corpus, ranges[r].column);
+        u32 low = ranges[r].min;
+        u32 span = ranges[r].max - ranges[r].min;
+        u32 kept = 0;
+        for (u32 i = 0;
+             i < selected;
+             ++i)
+        {
+            u32 row = selection[i];
+            selection[kept] = row;
+            kept += (values[row] - low) <= span;
+        }
+        selected = kept;
+    }
+
+    memcpy(results, selection, (selected < max_results ? selected : max_results) * sizeof(u32));
+    free(selection);
+    return selected;
+}
+
+//A game's record inside its mapped segment
+struct Replay_View
+{
+    const Replay_Header *header;
+    const Replay_Run *runs;
+};
+
+//Maps the game's segment on first use, and again when it has grown past the mapping
+bool corpus_replay(Corpus *corpus, u32 game, Replay_View *view)
+{
+    if (game >= corpus_count(corpus))
+    {
+        return false;
+    }
+    u32 segment = corpus_column(corpus, CORPUS_SEGMENT)[game];
+    u32 offset = corpus_column(corpus, CORPUS_OFFSET)[game];
+    Mapped_File *mapped = corpus->segments + segment;
+    if (!mapped->data || mapped->size < offset + sizeof(Replay_Header))
+    {
+        if (mapped->data)
+        {
+            mapped_file_close(mapped);
+        }
+        char path[600];
+        corpus_segment_path(corpus, segment, path, sizeof(path));
+        if (!mapped_file_open(mapped, path, false))
+        {
+            return false;
+        }
+    }
+
+    const Replay_Header *header = (const Replay_Header *)(mapped->data + offset);
+    if (mapped->size < offset + sizeof(Replay_Header) ||
+        header->magic != CORPUS_RECORD_MAGIC || header->state_size != sizeof(Game_State) ||
+        mapped->size < offset + sizeof(Replay_Header) + header->run_count * sizeof(Replay_Run))
+    {
+        return false;
+    }
+    view->header = header;
+    view->runs = (const Replay_Run *)(header + 1);
+    return true;
+}
+
+//Steps a copy of the starting state through the recorded buttons
+struct Replay_Player
+{
+    Replay_View view;
+    u32 run;
+    u32 tick_in_run;
+    u16 prev_buttons;
+};
+
+void replay_player_start(Replay_Player *player, const Replay_View *view, Game_State *game)
+{
+    player->view = *view;
+    player->run = 0;
+    player->tick_in_run = 0;
+    player->prev_buttons = view->header->prev_buttons;
+    *game = view->header->initial;
+}
+
+//False once every recorded tick has been played
+bool replay_player_step(Replay_Player *player, Game_State *game)
+{
+    const Replay_View *view = &player->view;
+    if (player->run == view->header->run_count)
+    {
+        return false;
+    }
+    u16 buttons = view->runs[player->run].buttons;
+    Input_State input = unpack_input(buttons, player->prev_buttons);
+    step_game(game, &input);
+    player->prev_buttons = buttons;
+    if (++player->tick_in_run == view->runs[player->run].ticks)
+    {
+        ++player->run;
+        player->tick_in_run = 0;
+    }
+    return true;
+}
+
+//Captures a live game from the press that starts it to its game over.
+//Call replay_record_input before each step_game and replay_record_state after it.
+struct Replay_Recorder
+{
+    Replay_Header header;
+    Replay_Run *runs;
+    u32 run_capacity;
+    bool recording;
+};
+
+void replay_record_input(Replay_Recorder *recorder, const Game_State *game, u16 buttons, u16 prev_buttons)
+{
+    Replay_Header *header = &recorder->header;
+    if (!recorder->recording)
+    {
+        if (game->phase != GAME_PHASE_START)
+        {
+            return;
+        }
+        //Every start screen tick is a candidate first tick, kept only if the game starts
+        header->magic = CORPUS_RECORD_MAGIC;
+        header->state_size = sizeof(Game_State);
+        header->tick_count = 0;
+        header->run_count = 0;
+        header->prev_buttons = prev_buttons;
+        header->initial = *game;
+    }
+
+    ++header->tick_count;
+    if (header->run_count > 0)
+    {
+        Replay_Run *last = recorder->runs + header->run_count - 1;
+        if (last->buttons == buttons && last->ticks < 0xFFFF)
+        {
+            ++last->ticks;
+            return;
+        }
+    }
+    if (header->run_count == recorder->run_capacity)
+    {
+        //Sized up front for thousands of pieces, so a game hardly ever grows it mid-play
+        recorder->run_capacity = recorder->run_capacity ? recorder->run_capacity * 2 : 16384;
+        recorder->runs = (Replay_Run *)realloc(recorder->runs,
+                                               recorder->run_capacity * sizeof(Replay_Run));
+    }
+    recorder->runs[header->run_count++] = { buttons, 1 };
+}
+
+//Appends the game to the corpus when it just ended; false only if that append failed
+bool replay_record_state(Replay_Recorder *recorder, Corpus *corpus, const Game_State *game)
+{
+    if (!recorder->recording)
+    {
+        recorder->recording = game->phase == GAME_PHASE_PLAY;
+        return true;
+    }
+    if (game->phase != GAME_PHASE_GAMEOVER)
+    {
+        return true;
+    }
+    recorder->recording = false;
+    return corpus_append(corpus, &recorder->header, recorder->runs, game);
+}
+
+void replay_recorder_free(Replay_Recorder *recorder)
+{
+    free(recorder->runs);
+    *recorder = {};
+}
+
+#endif
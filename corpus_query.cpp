@@ -0,0 +1,154 @@
+//Range queries over a replay corpus, optionally re-simulating every match.
+//Build: g++ -O2 corpus_query.cpp -o corpus_query
+//Usage: corpus_query directory [--column min:max]... [--limit n] [--verify]
+//Columns: seed, start_level, final_level, lines, points, duration. Either bound may be left out,
+//e.g. corpus_query replays --final_level 19: --points 300000:
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+
+#include "game.h"
+#include "corpus.h"
+
+bool parse_range(const char *text, Corpus_Range *range)
+{
+    const char *colon = strchr(text, ':');
+    if (!colon)
+    {
+        return false;
+    }
+    range->min = colon == text ? 0 : (u32)strtoul(text, 0, 10);
+    range->max = colon[1] ? (u32)strtoul(colon + 1, 0, 10) : 0xFFFFFFFF;
+    return range->min <= range->max;
+}
+
+//Plays the game back and checks it ends with the score the index has for it
+bool verify_game(Corpus *corpus, u32 game_index)
+{
+    Replay_View view;
+    if (!corpus_replay(corpus, game_index, &view))
+    {
+        return false;
+    }
+    Replay_Player player;
+    Game_State game;
+    replay_player_start(&player, &view, &game);
+    while (replay_player_step(&player, &game));
+    return game.phase == GAME_PHASE_GAMEOVER &&
+           (u32)game.points == corpus_column(corpus, CORPUS_POINTS)[game_index] &&
+           (u32)game.line_count == corpus_column(corpus, CORPUS_LINES)[game_index];
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: corpus_query directory [--column min:max]... [--limit n] [--verify]\n");
+        return 1;
+    }
+
+    Corpus_Range ranges[CORPUS_COLUMN_COUNT];
+    int range_count = 0;
+    u32 limit = 20;
+    bool verify = false;
+    for (int i = 2;
+         i < argc;
+         ++i)
+    {
+        if (strcmp(argv[i], "--verify") == 0)
+        {
+            verify = true;
+            continue;
+        }
+        if (i + 1 >= argc || strncmp(argv[i], "--", 2) != 0)
+        {
+            fprintf(stderr, "bad option %s\n", argv[i]);
+            return 1;
+        }
+        const char *name = argv[i] + 2;
+        const char *value = argv[++i];
+        if (strcmp(name, "limit") == 0)
+        {
+            limit = (u32)strtoul(value, 0, 10);
+            continue;
+        }
+
+        int column = -1;
+        for (int c = 0;
+             c < CORPUS_SEGMENT;
+             ++c)
+        {
+            if (strcmp(name, CORPUS_COLUMN_NAMES[c]) == 0)
+            {
+                column = c;
+            }
+        }
+        if (column < 0 || range_count == CORPUS_COLUMN_COUNT ||
+            !parse_range(value, ranges + range_count))
+        {
+            fprintf(stderr, "bad range --%s %s\n", name, value);
+            return 1;
+        }
+        ranges[range_count++].column = column;
+    }
+
+    Corpus *corpus = corpus_open_read(argv[1]);
+    if (!corpus)
+    {
+        fprintf(stderr, "could not open corpus %s\n", argv[1]);
+        return 1;
+    }
+
+    u32 *results = (u32 *)malloc((corpus_count(corpus) + 1) * sizeof(u32));
+    auto begin = std::chrono::steady_clock::now();
+    u32 matches = corpus_query(corpus, ranges, range_count, results, corpus_count(corpus));
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    printf("%u of %u games matched in %.3f ms\n", matches, corpus_count(corpus), ms);
+
+    printf("game");
+    for (int c = 0;
+         c < CORPUS_COLUMN_COUNT;
+         ++c)
+    {
+        printf(" %s", CORPUS_COLUMN_NAMES[c]);
+    }
+    printf("\n");
+    for (u32 i = 0;
+         i < matches && i < limit;
+         ++i)
+    {
+        printf("%u", results[i]);
+        for (int c = 0;
+             c < CORPUS_COLUMN_COUNT;
+             ++c)
+        {
+            printf(" %u", corpus_column(corpus, c)[results[i]]);
+        }
+        printf("\n");
+    }
+
+    int status = 0;
+    if (verify)
+    {
+        u32 failed = 0;
+        begin = std::chrono::steady_clock::now();
+        for (u32 i = 0;
+             i < matches;
+             ++i)
+        {
+            if (!verify_game(corpus, results[i]))
+            {
+                printf("game %u does not replay to its recorded result\n", results[i]);
+                ++failed;
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        printf("re-simulated %u games in %.2f s, %u mismatched\n", matches, seconds, failed);
+        status = failed ? 1 : 0;
+    }
+
+    free(results);
+    corpus_close(corpus);
+    return status;
+}
@@ -0,0 +1,591 @@
+#ifndef DELTA_STREAM_H
+#define DELTA_STREAM_H
+
+#include <atomic>
+
+//Compact Game_State stream for spectators: keyframes plus per-tick deltas.
+//One encoded packet is shared by every subscriber and freed by refcount.
+
+#define DELTA_PACKET_CAPACITY 256
+#define DELTA_POOL_SIZE 256
+#define DELTA_QUEUE_SIZE 64
+#define DELTA_MAX_SUBSCRIBERS 64
+#define DELTA_KEYFRAME_INTERVAL 600
+#define DELTA_MAX_CELL_CHANGES 48
+
+enum Delta_Packet_Type
+{
+    DELTA_PACKET_KEYFRAME = 1,
+    DELTA_PACKET_DELTA = 2
+};
+
+enum Delta_Field
+{
+    DELTA_FIELD_PIECE = 1 << 0,
+    DELTA_FIELD_NEXT = 1 << 1,
+    DELTA_FIELD_HOLD = 1 << 2,
+    DELTA_FIELD_CLEARED = 1 << 3,
+    DELTA_FIELD_CELLS = 1 << 4,
+    DELTA_FIELD_LINES = 1 << 5,
+    DELTA_FIELD_COUNTERS = 1 << 6,
+    DELTA_FIELD_FLAGS = 1 << 7
+};
+
+const u8 DELTA_KEYFRAME_FIELDS = DELTA_FIELD_PIECE | DELTA_FIELD_NEXT |
+                                 DELTA_FIELD_HOLD | DELTA_FIELD_LINES |
+                                 DELTA_FIELD_COUNTERS | DELTA_FIELD_FLAGS;
+
+struct Delta_Packet
+{
+    std::atomic<u32> refs;
+    u32 size;
+    u8 data[DELTA_PACKET_CAPACITY];
+};
+
+//Single-producer single-consumer queue of shared packets
+struct Delta_Subscriber
+{
+    Delta_Packet *queue[DELTA_QUEUE_SIZE];
+    std::atomic<u32> head;
+    std::atomic<u32> tail;
+};
+
+struct Delta_Encoder
+{
+    Delta_Packet pool[DELTA_POOL_SIZE];
+    u32 pool_cursor;
+
+    Delta_Subscriber *subscribers[DELTA_MAX_SUBSCRIBERS];
+    u32 subscriber_count;
+
+    Game_State last;
+    bool has_last;
+    bool force_keyframe;
+    u16 sequence;
+    u32 packets_since_keyframe;
+};
+
+struct Delta_Decoder
+{
+    Game_State state;
+    u16 sequence;
+    bool synced;
+};
+
+struct Delta_Writer
+{
+    u8 *data;
+    u32 size;
+};
+
+struct Delta_Reader
+{
+    const u8 *data;
+    u32 size;
+    u32 cursor;
+    bool failed;
+};
+
+void delta_write_u8(Delta_Writer *writer, u8 value)
+{
+    assert(writer->size < DELTA_PACKET_CAPACITY);
+    writer->data[writer->size++] = value;
+}
+
+void delta_write_varint(Delta_Writer *writer, u32 value)
+{
+    while (value >= 0x80)
+    {
+        delta_write_u8(writer, (u8)(value | 0x80));
+        value >>= 7;
+    }
+    delta_write_u8(writer, (u8)value);
+}
+
+u8 delta_read_u8(Delta_Reader *reader)
+{
+    if (reader->cursor >= reader->size)
+    {
+        reader->failed = true;
+        return 0;
+    }
+    return reader->data[reader->cursor++];
+}
+
+u32 delta_read_varint(Delta_Reader *reader)
+{
+    u32 value = 0;
+    for (int shift = 0;
+         shift < 35;
+         shift += 7)
+    {
+        u8 byte = delta_read_u8(reader);
+        value |= (u32)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return value;
+        }
+    }
+    reader->failed = true;
+    return 0;
+}
+
+//Packs a row flag array into a bit mask
+u32 delta_row_mask(const u8 *rows)
+{
+    u32 mask = 0;
+    for (int row = 0;
+         row < HEIGHT;
+         ++row)
+    {
+        if (rows[row])
+        {
+            mask |= 1u << row;
+        }
+    }
+    return mask;
+}
+
+void delta_write_mask(Delta_Writer *writer, u32 mask)
+{
+    delta_write_u8(writer, (u8)mask);
+    delta_write_u8(writer, (u8)(mask >> 8));
+    delta_write_u8(writer, (u8)(mask >> 16));
+}
+
+u32 delta_read_mask(Delta_Reader *reader)
+{
+    u32 mask = delta_read_u8(reader);
+    mask |= (u32)delta_read_u8(reader) << 8;
+    mask |= (u32)delta_read_u8(reader) << 16;
+    return mask;
+}
+
+//Piece index and rotation share one byte, offsets take one signed byte each
+void delta_write_piece(Delta_Writer *writer, const Piece_State *piece)
+{
+    delta_write_u8(writer, (u8)(piece->tetromino_index | (piece->rotation << 3)));
+    delta_write_u8(writer, (u8)(s8)piece->offset_row);
+    delta_write_u8(writer, (u8)(s8)piece->offset_col);
+}
+
+void delta_read_piece(Delta_Reader *reader, Piece_State *piece)
+{
+    u8 packed = delta_read_u8(reader);
+    piece->tetromino_index = packed & 0x7;
+    piece->rotation = (packed >> 3) & 0x3;
+    piece->offset_row = (s8)delta_read_u8(reader);
+    piece->offset_col = (s8)delta_read_u8(reader);
+}
+
+bool delta_piece_equal(const Piece_State *a, const Piece_State *b)
+{
+    return a->tetromino_index == b->tetromino_index &&
+           a->offset_row == b->offset_row &&
+           a->offset_col == b->offset_col &&
+           a->rotation == b->rotation;
+}
+
+u8 delta_pack_flags(const Game_State *game)
+{
+    return (u8)(game->phase |
+                (game->pause << 2) |
+                (game->holdPlace << 3) |
+                (game->muted << 4));
+}
+
+//Writes every field selected in the mask except the board, in field order
+void delta_write_fields(Delta_Writer *writer, const Game_State *game, u8 fields)
+{
+    if (fields & DELTA_FIELD_PIECE)
+    {
+        delta_write_piece(writer, &game->piece);
+    }
+    if (fields & DELTA_FIELD_NEXT)
+    {
+        delta_write_piece(writer, &game->nextPiece);
+    }
+    if (fields & DELTA_FIELD_HOLD)
+    {
+        delta_write_piece(writer, &game->holdPiece);
+    }
+    if (fields & DELTA_FIELD_LINES)
+    {
+        delta_write_mask(writer, delta_row_mask(game->lines));
+        delta_write_u8(writer, (u8)game->pending_line_count);
+    }
+    if (fields & DELTA_FIELD_COUNTERS)
+    {
+        delta_write_varint(writer, (u32)game->start_level);
+        delta_write_varint(writer, (u32)game->level);
+        delta_write_varint(writer, (u32)game->line_count);
+        delta_write_varint(writer, (u32)game->points);
+    }
+    if (fields & DELTA_FIELD_FLAGS)
+    {
+        delta_write_u8(writer, delta_pack_flags(game));
+    }
+}
+
+void delta_read_fields(Delta_Reader *reader, Game_State *game, u8 fields)
+{
+    if (fields & DELTA_FIELD_PIECE)
+    {
+        delta_read_piece(reader, &game->piece);
+    }
+    if (fields & DELTA_FIELD_NEXT)
+    {
+        delta_read_piece(reader, &game->nextPiece);
+    }
+    if (fields & DELTA_FIELD_HOLD)
+    {
+        delta_read_piece(reader, &game->holdPiece);
+    }
+    if (fields & DELTA_FIELD_LINES)
+    {
+        u32 mask = delta_read_mask(reader);
+        for (int row = 0;
+             row < HEIGHT;
+             ++row)
+        {
+            game->lines[row] = (mask >> row) & 1;
+        }
+        game->pending_line_count = delta_read_u8(reader);
+    }
+    if (fields & DELTA_FIELD_COUNTERS)
+    {
+        game->start_level = (int)delta_read_varint(reader);
+        game->level = (int)delta_read_varint(reader);
+        game->line_count = (int)delta_read_varint(reader);
+        game->points = (int)delta_read_varint(reader);
+    }
+    if (fields & DELTA_FIELD_FLAGS)
+    {
+        u8 flags = delta_read_u8(reader);
+        game->phase = (Game_Phase)(flags & 0x3);
+        game->pause = (flags >> 2) & 1;
+        game->holdPlace = (flags >> 3) & 1;
+        game->muted = (flags >> 4) & 1;
+    }
+}
+
+void delta_encode_keyframe(Delta_Writer *writer, const Game_State *game, u16 sequence)
+{
+    delta_write_u8(writer, DELTA_PACKET_KEYFRAME);
+    delta_write_u8(writer, (u8)sequence);
+    delta_write_u8(writer, (u8)(sequence >> 8));
+    delta_write_u8(writer, DELTA_KEYFRAME_FIELDS);
+    delta_write_fields(writer, game, DELTA_KEYFRAME_FIELDS);
+
+    //Cell values fit in a nibble
+    for (int index = 0;
+         index < WIDTH * HEIGHT;
+         index += 2)
+    {
+        delta_write_u8(writer, (u8)(game->board[index] | (game->board[index + 1] << 4)));
+    }
+}
+
+//Returns false when the board changed too much for a delta to pay off
+bool delta_encode_delta(Delta_Writer *writer, const Game_State *last,
+                        const Game_State *game, u16 sequence)
+{
+    u8 board[WIDTH * HEIGHT];
+    memcpy(board, last->board, sizeof(board));
+
+    u8 fields = 0;
+    u32 cleared_mask = 0;
+    if (last->phase == GAME_PHASE_LINE && game->phase != GAME_PHASE_LINE)
+    {
+        cleared_mask = delta_row_mask(last->lines);
+        if (cleared_mask)
+        {
+            fields |= DELTA_FIELD_CLEARED;
+            clear_lines(board, WIDTH, HEIGHT, last->lines);
+        }
+    }
+
+    u8 changed[DELTA_MAX_CELL_CHANGES];
+    int changed_count = 0;
+    for (int index = 0;
+         index < WIDTH * HEIGHT;
+         ++index)
+    {
+        if (board[index] != game->board[index])
+        {
+            if (changed_count == DELTA_MAX_CELL_CHANGES)
+            {
+                return false;
+            }
+            changed[changed_count++] = (u8)index;
+        }
+    }
+    if (changed_count)
+    {
+        fields |= DELTA_FIELD_CELLS;
+    }
+
+    if (!delta_piece_equal(&last->piece, &game->piece))
+    {
+        fields |= DELTA_FIELD_PIECE;
+    }
+    if (!delta_piece_equal(&last->nextPiece, &game->nextPiece))
+    {
+        fields |= DELTA_FIELD_NEXT;
+    }
+    if (!delta_piece_equal(&last->holdPiece, &game->holdPiece))
+    {
+        fields |= DELTA_FIELD_HOLD;
+    }
+    if (memcmp(last->lines, game->lines, HEIGHT) != 0 ||
+        last->pending_line_count != game->pending_line_count)
+    {
+        fields |= DELTA_FIELD_LINES;
+    }
+    if (last->start_level != game->start_level ||
+        last->level != game->level ||
+        last->line_count != game->line_count ||
+        last->points != game->points)
+    {
+        fields |= DELTA_FIELD_COUNTERS;
+    }
+    if (delta_pack_flags(last) != delta_pack_flags(game))
+    {
+        fields |= DELTA_FIELD_FLAGS;
+    }
+
+    delta_write_u8(writer, DELTA_PACKET_DELTA);
+    delta_write_u8(writer, (u8)sequence);
+    delta_write_u8(writer, (u8)(sequence >> 8));
+    delta_write_u8(writer, fields);
+    if (fields & DELTA_FIELD_CLEARED)
+    {
+        delta_write_mask(writer, cleared_mask);
+    }
+    if (fields & DELTA_FIELD_CELLS)
+    {
+        delta_write_u8(writer, (u8)changed_count);
+        for (int i = 0;
+             i < changed_count;
+             ++i)
+        {
+            delta_write_u8(writer, changed[i]);
+            delta_write_u8(writer, game->board[changed[i]]);
+        }
+    }
+    delta_write_fields(writer, game, fields);
+    return true;
+}
+
+Delta_Packet *delta_acquire_packet(Delta_Encoder *encoder)
+{
+    for (int i = 0;
+         i < DELTA_POOL_SIZE;
+         ++i)
+    {
+        Delta_Packet *packet = encoder->pool + encoder->pool_cursor;
+        encoder->pool_cursor = (encoder->pool_cursor + 1) % DELTA_POOL_SIZE;
+        if (packet->refs.load(std::memory_order_acquire) == 0)
+        {
+            return packet;
+        }
+    }
+    return 0;
+}
+
+void delta_packet_release(Delta_Packet *packet)
+{
+    packet->refs.fetch_sub(1, std::memory_order_release);
+}
+
+//Encodes the current state once and queues the same packet for every subscriber
+void delta_encode(Delta_Encoder *encoder, const Game_State *game)
+{
+    if (encoder->subscriber_count == 0)
+    {
+        encoder->has_last = false;
+        return;
+    }
+
+    Delta_Packet *packet = delta_acquire_packet(encoder);
+    if (!packet)
+    {
+        //Every packet is still held by a slow reader, resync them later
+        encoder->force_keyframe = true;
+        return;
+    }
+
+    Delta_Writer writer = { packet->data, 0 };
+    u16 sequence = encoder->sequence + 1;
+    bool keyframe = !encoder->has_last ||
+                    encoder->force_keyframe ||
+                    encoder->packets_since_keyframe >= DELTA_KEYFRAME_INTERVAL;
+    if (!keyframe && !delta_encode_delta(&writer, &encoder->last, game, sequence))
+    {
+        writer.size = 0;
+        keyframe = true;
+    }
+    if (keyframe)
+    {
+        delta_encode_keyframe(&writer, game, sequence);
+        encoder->packets_since_keyframe = 0;
+        encoder->force_keyframe = false;
+    }
+    else
+    {
+        ++encoder->packets_since_keyframe;
+    }
+
+    packet->size = writer.size;
+    packet->refs.store(encoder->subscriber_count, std::memory_order_relaxed);
+
+    u32 dropped = 0;
+    for (u32 i = 0;
+         i < encoder->subscriber_count;
+         ++i)
+    {
+        Delta_Subscriber *subscriber = encoder->subscribers[i];
+        u32 head = subscriber->head.load(std::memory_order_relaxed);
+        u32 tail = subscriber->tail.load(std::memory_order_acquire);
+        if (head - tail >= DELTA_QUEUE_SIZE)
+        {
+            ++dropped;
+            continue;
+        }
+        subscriber->queue[head % DELTA_QUEUE_SIZE] = packet;
+        subscriber->head.store(head + 1, std::memory_order_release);
+    }
+    if (dropped)
+    {
+        packet->refs.fetch_sub(dropped, std::memory_order_release);
+        encoder->force_keyframe = true;
+    }
+
+    encoder->last = *game;
+    encoder->has_last = true;
+    encoder->sequence = sequence;
+}
+
+void delta_subscribe(Delta_Encoder *encoder, Delta_Subscriber *subscriber)
+{
+    assert(encoder->subscriber_count < DELTA_MAX_SUBSCRIBERS);
+    subscriber->head.store(0, std::memory_order_relaxed);
+    subscriber->tail.store(0, std::memory_order_relaxed);
+    encoder->subscribers[encoder->subscriber_count++] = subscriber;
+    encoder->force_keyframe = true;
+}
+
+//Call from the encoding thread once the subscriber has stopped popping
+void delta_unsubscribe(Delta_Encoder *encoder, Delta_Subscriber *subscriber)
+{
+    for (u32 i = 0;
+         i < encoder->subscriber_count;
+         ++i)
+    {
+        if (encoder->subscribers[i] == subscriber)
+        {
+            encoder->subscribers[i] = encoder->subscribers[--encoder->subscriber_count];
+            break;
+        }
+    }
+
+    u32 head = subscriber->head.load(std::memory_order_acquire);
+    u32 tail = subscriber->tail.load(std::memory_order_relaxed);
+    for (;
+         tail != head;
+         ++tail)
+    {
+        delta_packet_release(subscriber->queue[tail % DELTA_QUEUE_SIZE]);
+    }
+    subscriber->tail.store(tail, std::memory_order_release);
+}
+
+//Returns the next shared packet or null; release it once it has been sent
+Delta_Packet *delta_subscriber_pop(Delta_Subscriber *subscriber)
+{
+    u32 tail = subscriber->tail.load(std::memory_order_relaxed);
+    if (tail == subscriber->head.load(std::memory_order_acquire))
+    {
+        return 0;
+    }
+    Delta_Packet *packet = subscriber->queue[tail % DELTA_QUEUE_SIZE];
+    subscriber->tail.store(tail + 1, std::memory_order_release);
+    return packet;
+}
+
+//Applies one packet; returns false until a keyframe resynchronizes the stream
+bool delta_decode(Delta_Decoder *decoder, const u8 *data, u32 size)
+{
+    Delta_Reader reader = { data, size, 0, false };
+    u8 type = delta_read_u8(&reader);
+    u16 sequence = delta_read_u8(&reader);
+    sequence |= (u16)(delta_read_u8(&reader) << 8);
+    u8 fields = delta_read_u8(&reader);
+    if (reader.failed)
+    {
+        return false;
+    }
+
+    Game_State *game = &decoder->state;
+    if (type == DELTA_PACKET_KEYFRAME)
+    {
+        *game = {};
+        delta_read_fields(&reader, game, fields);
+        for (int index = 0;
+             index < WIDTH * HEIGHT;
+             index += 2)
+        {
+            u8 packed = delta_read_u8(&reader);
+            game->board[index] = packed & 0xF;
+            game->board[index + 1] = packed >> 4;
+        }
+    }
+    else if (type == DELTA_PACKET_DELTA)
+    {
+        if (!decoder->synced || sequence != (u16)(decoder->sequence + 1))
+        {
+            decoder->synced = false;
+            return false;
+        }
+        if (fields & DELTA_FIELD_CLEARED)
+        {
+            u32 mask = delta_read_mask(&reader);
+            u8 lines[HEIGHT];
+            for (int row = 0;
+                 row < HEIGHT;
+                 ++row)
+            {
+                lines[row] = (mask >> row) & 1;
+            }
+            clear_lines(game->board, WIDTH, HEIGHT, lines);
+        }
+        if (fields & DELTA_FIELD_CELLS)
+        {
+            u8 count = delta_read_u8(&reader);
+            for (int i = 0;
+                 i < count;
+                 ++i)
+            {
+                u8 index = delta_read_u8(&reader);
+                u8 value = delta_read_u8(&reader);
+                if (index >= WIDTH * HEIGHT)
+                {
+                    reader.failed = true;
+                    break;
+                }
+                game->board[index] = value;
+            }
+        }
+        delta_read_fields(&reader, game, fields);
+    }
+    else
+    {
+        reader.failed = true;
+    }
+
+    decoder->synced = !reader.failed;
+    decoder->sequence = sequence;
+    return decoder->synced;
+}
+
+#endif
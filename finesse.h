@@ -0,0 +1,255 @@
+#ifndef FINESSE_H
+#define FINESSE_H
+
+//Shortest left/right/rotate press sequences that bring a fresh piece to a placement.
+//Steps are button masks for one frame; a shift and a rotation can share a frame,
+//exactly as update_game_play tests them together. Sequences are minimal in key
+//presses first and frames second. Placements count as equal when the piece lands
+//on the same cells, so e.g. either flat orientation of an I piece will do.
+//Empty-board answers come from finesse_table.h; other boards fall back to a search.
+
+#define FINESSE_MIN_COL -3
+#define FINESSE_COL_COUNT (WIDTH - FINESSE_MIN_COL)
+#define FINESSE_MAX_STEPS 8
+#define FINESSE_UNREACHABLE 0xFF
+
+struct Finesse_Path
+{
+    u8 step_count;
+    u8 press_count;
+    u8 steps[FINESSE_MAX_STEPS];
+};
+
+#ifndef FINESSE_GENERATOR
+#include "finesse_table.h"
+#endif
+
+const u8 FINESSE_STEPS[] = {
+    INPUT_LEFT,
+    INPUT_RIGHT,
+    INPUT_UP,
+    INPUT_LEFT | INPUT_UP,
+    INPUT_RIGHT | INPUT_UP
+};
+
+//Applies one frame of presses the way update_game_play does; false if it was blocked
+bool finesse_apply_step(const u8 *board, Piece_State *piece, u8 step)
+{
+    Piece_State candidate = *piece;
+    candidate.offset_col -= (step & INPUT_LEFT) ? 1 : 0;
+    candidate.offset_col += (step & INPUT_RIGHT) ? 1 : 0;
+    if (step & INPUT_UP)
+    {
+        candidate.rotation = (candidate.rotation + 1) % 4;
+    }
+    if (!check_piece_valid(&candidate, board, WIDTH, HEIGHT))
+    {
+        return false;
+    }
+    *piece = candidate;
+    return true;
+}
+
+//The four board cells the piece comes to rest on when hard dropped, packed one per byte
+u32 finesse_landing(const u8 *board, Piece_State piece)
+{
+    while (check_piece_valid(&piece, board, WIDTH, HEIGHT))
+    {
+        ++piece.offset_row;
+    }
+    --piece.offset_row;
+
+    const Tetromino *tetromino = TETROMINOS + piece.tetromino_index;
+    u32 cells = 0;
+    for (int row = 0;
+         row < tetromino->side;
+         ++row)
+    {
+        for (int col = 0;
+             col < tetromino->side;
+             ++col)
+        {
+            if (tetromino_rotate(tetromino, row, col, piece.rotation))
+            {
+                int index = (piece.offset_row + row) * WIDTH + piece.offset_col + col;
+                cells = (cells << 8) | (u32)index;
+            }
+        }
+    }
+    return cells;
+}
+
+//Cheapest path from the piece's current spot to anything landing like rotation/col would.
+//Searches shifts and rotations at the piece's current row, ignoring gravity.
+bool finesse_search(const u8 *board, const Piece_State *piece, int rotation, int col,
+                    Finesse_Path *path)
+{
+    const int state_count = 4 * FINESSE_COL_COUNT;
+    Piece_State target = *piece;
+    target.rotation = rotation;
+    target.offset_col = col;
+    if (col < FINESSE_MIN_COL || col >= WIDTH ||
+        !check_piece_valid(piece, board, WIDTH, HEIGHT) ||
+        !check_piece_valid(&target, board, WIDTH, HEIGHT))
+    {
+        return false;
+    }
+    u32 target_cells = finesse_landing(board, target);
+
+    //Dijkstra over at most 52 states, with presses weighted far above frames
+    u16 cost[state_count];
+    s8 parent[state_count];
+    u8 parent_step[state_count];
+    bool done[state_count] = {};
+    for (int i = 0;
+         i < state_count;
+         ++i)
+    {
+        cost[i] = 0xFFFF;
+    }
+    int start = piece->rotation * FINESSE_COL_COUNT + piece->offset_col - FINESSE_MIN_COL;
+    cost[start] = 0;
+    parent[start] = -1;
+
+    for (;;)
+    {
+        int best = -1;
+        for (int i = 0;
+             i < state_count;
+             ++i)
+        {
+            if (!done[i] && cost[i] != 0xFFFF && (best < 0 || cost[i] < cost[best]))
+            {
+                best = i;
+            }
+        }
+        if (best < 0)
+        {
+            return false;
+        }
+        done[best] = true;
+
+        Piece_State current = *piece;
+        current.rotation = best / FINESSE_COL_COUNT;
+        current.offset_col = best % FINESSE_COL_COUNT + FINESSE_MIN_COL;
+        if (finesse_landing(board, current) == target_cells)
+        {
+            int count = 0;
+            int presses = 0;
+            for (int state = best;
+                 state != start;
+                 state = parent[state])
+            {
+                ++count;
+                presses += __builtin_popcount(parent_step[state]);
+            }
+            if (count > FINESSE_MAX_STEPS)
+            {
+                return false;
+            }
+            path->step_count = (u8)count;
+            path->press_count = (u8)presses;
+            for (int state = best;
+                 state != start;
+                 state = parent[state])
+            {
+                path->steps[--count] = parent_step[state];
+            }
+            return true;
+        }
+
+        for (int i = 0;
+             i < (int)ARRAY_COUNT(FINESSE_STEPS);
+             ++i)
+        {
+            u8 step = FINESSE_STEPS[i];
+            Piece_State next = current;
+            if (!finesse_apply_step(board, &next, step) || next.offset_col < FINESSE_MIN_COL)
+            {
+                continue;
+            }
+            int state = next.rotation * FINESSE_COL_COUNT + next.offset_col - FINESSE_MIN_COL;
+            u16 next_cost = (u16)(cost[best] + __builtin_popcount(step) * 16 + 1);
+            if (!done[state] && next_cost < cost[state])
+            {
+                cost[state] = next_cost;
+                parent[state] = (s8)best;
+                parent_step[state] = step;
+            }
+        }
+    }
+}
+
+#ifndef FINESSE_GENERATOR
+
+//True when the steps play out unblocked on this board and land where the target would
+bool finesse_path_works(const u8 *board, Piece_State piece, const Finesse_Path *path,
+                        int rotation, int col)
+{
+    Piece_State target = piece;
+    target.rotation = rotation;
+    target.offset_col = col;
+    if (!check_piece_valid(&target, board, WIDTH, HEIGHT))
+    {
+        return false;
+    }
+    for (int i = 0;
+         i < path->step_count;
+         ++i)
+    {
+        if (!finesse_apply_step(board, &piece, path->steps[i]))
+        {
+            return false;
+        }
+    }
+    if (piece.rotation == rotation && piece.offset_col == col)
+    {
+        return true;
+    }
+    return finesse_landing(board, piece) == finesse_landing(board, target);
+}
+
+//Table lookup for a piece still at its spawn spot, searching only when the stack is in the way
+bool finesse_find(const u8 *board, const Piece_State *piece, int rotation, int col,
+                  Finesse_Path *path)
+{
+    if (col < FINESSE_MIN_COL || col >= WIDTH)
+    {
+        return false;
+    }
+    if (piece->rotation == 0 && piece->offset_col == WIDTH / 2)
+    {
+        const Finesse_Path *entry =
+            &FINESSE_TABLE[piece->tetromino_index][rotation][col - FINESSE_MIN_COL];
+        if (entry->step_count != FINESSE_UNREACHABLE &&
+            finesse_path_works(board, *piece, entry, rotation, col))
+        {
+            *path = *entry;
+            return true;
+        }
+    }
+    return finesse_search(board, piece, rotation, col, path);
+}
+
+//Presses a player spent beyond the minimum for the placement a piece locked in.
+//The board is the one the piece spawned on; -1 when the placement needed a tuck or slide.
+int finesse_errors(const u8 *board, const Piece_State *locked, int press_count)
+{
+    Piece_State spawn = {};
+    spawn.tetromino_index = locked->tetromino_index;
+    spawn.offset_col = WIDTH / 2;
+    Piece_State dropped = *locked;
+    dropped.offset_row = 0;
+    Finesse_Path path;
+    if (!check_piece_valid(&dropped, board, WIDTH, HEIGHT) ||
+        finesse_landing(board, dropped) != finesse_landing(board, *locked) ||
+        !finesse_find(board, &spawn, locked->rotation, locked->offset_col, &path))
+    {
+        return -1;
+    }
+    return max(press_count - path.press_count, 0);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,70 @@
+//Writes finesse_table.h: the minimal presses from spawn to every placement on an empty board.
+//Build: g++ -O2 finesse_gen.cpp -o finesse_gen
+//Usage: finesse_gen > finesse_table.h  (rerun whenever the tetrominos or spawn column change)
+
+#include <cstdio>
+
+#include "game.h"
+#define FINESSE_GENERATOR
+#include "finesse.h"
+
+int main()
+{
+    u8 board[WIDTH * HEIGHT] = {};
+
+    printf("#ifndef FINESSE_TABLE_H\r\n");
+    printf("#define FINESSE_TABLE_H\r\n\r\n");
+    printf("//Generated by finesse_gen.cpp, do not edit.\r\n");
+    printf("//Indexed by tetromino, rotation and offset_col - FINESSE_MIN_COL;\r\n");
+    printf("//{ step_count, press_count, { steps } }, where steps are Input_Button masks.\r\n\r\n");
+    printf("const Finesse_Path FINESSE_TABLE[%d][4][FINESSE_COL_COUNT] = {\r\n",
+           (int)ARRAY_COUNT(TETROMINOS));
+
+    int longest = 0;
+    for (int tetromino = 0;
+         tetromino < (int)ARRAY_COUNT(TETROMINOS);
+         ++tetromino)
+    {
+        printf("    {\r\n");
+        for (int rotation = 0;
+             rotation < 4;
+             ++rotation)
+        {
+            printf("        {\r\n");
+            for (int col = FINESSE_MIN_COL;
+                 col < WIDTH;
+                 ++col)
+            {
+                Piece_State spawn = {};
+                spawn.tetromino_index = (u8)tetromino;
+                spawn.offset_col = WIDTH / 2;
+                Finesse_Path path = {};
+                if (tetromino == 0 || !finesse_search(board, &spawn, rotation, col, &path))
+                {
+                    path = {};
+                    path.step_count = FINESSE_UNREACHABLE;
+                }
+                else if (path.step_count > longest)
+                {
+                    longest = path.step_count;
+                }
+
+                int step_count = path.step_count == FINESSE_UNREACHABLE ? 0 : path.step_count;
+                printf("            { %d, %d, {", path.step_count, path.press_count);
+                for (int i = 0;
+                     i < step_count;
+                     ++i)
+                {
+                    printf(" %d%s", path.steps[i], i + 1 < step_count ? "," : " ");
+                }
+                printf("} }%s\r\n", col + 1 < WIDTH ? "," : "");
+            }
+            printf("        }%s\r\n", rotation < 3 ? "," : "");
+        }
+        printf("    }%s\r\n", tetromino + 1 < (int)ARRAY_COUNT(TETROMINOS) ? "," : "");
+    }
+    printf("};\r\n\r\n#endif\r\n");
+
+    fprintf(stderr, "longest sequence: %d steps\n", longest);
+    return 0;
+}
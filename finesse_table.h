@@ -0,0 +1,507 @@
+#ifndef FINESSE_TABLE_H
+#define FINESSE_TABLE_H
+
+//Generated by finesse_gen.cpp, do not edit.
+//Indexed by tetromino, rotation and offset_col - FINESSE_MIN_COL;
+//{ step_count, press_count, { steps } }, where steps are Input_Button masks.
+
+const Finesse_Path FINESSE_TABLE[8][4][FINESSE_COL_COUNT] = {
+    {
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        }
+    },
+    {
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 5, 5, { 1, 1, 1, 1, 1 } },
+            { 4, 4, { 1, 1, 1, 1 } },
+            { 3, 3, { 1, 1, 1 } },
+            { 2, 2, { 1, 1 } },
+            { 1, 1, { 1 } },
+            { 0, 0, {} },
+            { 1, 1, { 2 } },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 7, 8, { 1, 1, 1, 1, 1, 5, 1 } },
+            { 6, 7, { 1, 1, 1, 1, 1, 5 } },
+            { 5, 6, { 1, 1, 1, 1, 5 } },
+            { 4, 5, { 1, 1, 1, 5 } },
+            { 3, 4, { 1, 1, 5 } },
+            { 2, 3, { 1, 5 } },
+            { 1, 2, { 5 } },
+            { 1, 1, { 4 } },
+            { 1, 2, { 6 } },
+            { 2, 3, { 2, 6 } },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 5, 5, { 1, 1, 1, 1, 1 } },
+            { 4, 4, { 1, 1, 1, 1 } },
+            { 3, 3, { 1, 1, 1 } },
+            { 2, 2, { 1, 1 } },
+            { 1, 1, { 1 } },
+            { 0, 0, {} },
+            { 1, 1, { 2 } },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 7, 8, { 1, 1, 1, 1, 1, 5, 1 } },
+            { 6, 7, { 1, 1, 1, 1, 1, 5 } },
+            { 5, 6, { 1, 1, 1, 1, 5 } },
+            { 4, 5, { 1, 1, 1, 5 } },
+            { 3, 4, { 1, 1, 5 } },
+            { 2, 3, { 1, 5 } },
+            { 1, 2, { 5 } },
+            { 1, 1, { 4 } },
+            { 1, 2, { 6 } },
+            { 2, 3, { 2, 6 } },
+            { 255, 0, {} }
+        }
+    },
+    {
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 5, 5, { 1, 1, 1, 1, 1 } },
+            { 4, 4, { 1, 1, 1, 1 } },
+            { 3, 3, { 1, 1, 1 } },
+            { 2, 2, { 1, 1 } },
+            { 1, 1, { 1 } },
+            { 0, 0, {} },
+            { 1, 1, { 2 } },
+            { 2, 2, { 2, 2 } },
+            { 3, 3, { 2, 2, 2 } },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 5, 5, { 1, 1, 1, 1, 1 } },
+            { 4, 4, { 1, 1, 1, 1 } },
+            { 3, 3, { 1, 1, 1 } },
+            { 2, 2, { 1, 1 } },
+            { 1, 1, { 1 } },
+            { 0, 0, {} },
+            { 1, 1, { 2 } },
+            { 2, 2, { 2, 2 } },
+            { 3, 3, { 2, 2, 2 } },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 5, 5, { 1, 1, 1, 1, 1 } },
+            { 4, 4, { 1, 1, 1, 1 } },
+            { 3, 3, { 1, 1, 1 } },
+            { 2, 2, { 1, 1 } },
+            { 1, 1, { 1 } },
+            { 0, 0, {} },
+            { 1, 1, { 2 } },
+            { 2, 2, { 2, 2 } },
+            { 3, 3, { 2, 2, 2 } },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 5, 5, { 1, 1, 1, 1, 1 } },
+            { 4, 4, { 1, 1, 1, 1 } },
+            { 3, 3, { 1, 1, 1 } },
+            { 2, 2, { 1, 1 } },
+            { 1, 1, { 1 } },
+            { 0, 0, {} },
+            { 1, 1, { 2 } },
+            { 2, 2, { 2, 2 } },
+            { 3, 3, { 2, 2, 2 } },
+            { 255, 0, {} }
+        }
+    },
+    {
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 5, 5, { 1, 1, 1, 1, 1 } },
+            { 4, 4, { 1, 1, 1, 1 } },
+            { 3, 3, { 1, 1, 1 } },
+            { 2, 2, { 1, 1 } },
+            { 1, 1, { 1 } },
+            { 0, 0, {} },
+            { 1, 1, { 2 } },
+            { 2, 2, { 2, 2 } },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 6, 7, { 1, 1, 1, 1, 1, 5 } },
+            { 5, 6, { 1, 1, 1, 1, 5 } },
+            { 4, 5, { 1, 1, 1, 5 } },
+            { 3, 4, { 1, 1, 5 } },
+            { 2, 3, { 1, 5 } },
+            { 1, 2, { 5 } },
+            { 1, 1, { 4 } },
+            { 1, 2, { 6 } },
+            { 2, 3, { 2, 6 } },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 5, 7, { 1, 1, 1, 5, 5 } },
+            { 4, 6, { 1, 1, 5, 5 } },
+            { 3, 5, { 1, 5, 5 } },
+            { 2, 4, { 5, 5 } },
+            { 2, 3, { 4, 5 } },
+            { 2, 2, { 4, 4 } },
+            { 2, 3, { 4, 6 } },
+            { 2, 4, { 6, 6 } },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 5, 8, { 1, 1, 5, 5, 5 } },
+            { 4, 7, { 1, 5, 5, 5 } },
+            { 3, 6, { 5, 5, 5 } },
+            { 3, 5, { 4, 5, 5 } },
+            { 3, 4, { 4, 4, 5 } },
+            { 3, 3, { 4, 4, 4 } },
+            { 3, 4, { 4, 4, 6 } },
+            { 3, 5, { 4, 6, 6 } },
+            { 3, 6, { 6, 6, 6 } },
+            { 255, 0, {} }
+        }
+    },
+    {
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 5, 5, { 1, 1, 1, 1, 1 } },
+            { 4, 4, { 1, 1, 1, 1 } },
+            { 3, 3, { 1, 1, 1 } },
+            { 2, 2, { 1, 1 } },
+            { 1, 1, { 1 } },
+            { 0, 0, {} },
+            { 1, 1, { 2 } },
+            { 2, 2, { 2, 2 } },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 6, 7, { 1, 1, 1, 1, 1, 5 } },
+            { 5, 6, { 1, 1, 1, 1, 5 } },
+            { 4, 5, { 1, 1, 1, 5 } },
+            { 3, 4, { 1, 1, 5 } },
+            { 2, 3, { 1, 5 } },
+            { 1, 2, { 5 } },
+            { 1, 1, { 4 } },
+            { 1, 2, { 6 } },
+            { 2, 3, { 2, 6 } },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 5, 5, { 1, 1, 1, 1, 1 } },
+            { 4, 4, { 1, 1, 1, 1 } },
+            { 3, 3, { 1, 1, 1 } },
+            { 2, 2, { 1, 1 } },
+            { 1, 1, { 1 } },
+            { 0, 0, {} },
+            { 1, 1, { 2 } },
+            { 2, 2, { 2, 2 } },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 6, 7, { 1, 1, 1, 1, 1, 5 } },
+            { 5, 6, { 1, 1, 1, 1, 5 } },
+            { 4, 5, { 1, 1, 1, 5 } },
+            { 3, 4, { 1, 1, 5 } },
+            { 2, 3, { 1, 5 } },
+            { 1, 2, { 5 } },
+            { 1, 1, { 4 } },
+            { 1, 2, { 6 } },
+            { 2, 3, { 2, 6 } },
+            { 255, 0, {} }
+        }
+    },
+    {
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 5, 5, { 1, 1, 1, 1, 1 } },
+            { 4, 4, { 1, 1, 1, 1 } },
+            { 3, 3, { 1, 1, 1 } },
+            { 2, 2, { 1, 1 } },
+            { 1, 1, { 1 } },
+            { 0, 0, {} },
+            { 1, 1, { 2 } },
+            { 2, 2, { 2, 2 } },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 6, 7, { 1, 1, 1, 1, 1, 5 } },
+            { 5, 6, { 1, 1, 1, 1, 5 } },
+            { 4, 5, { 1, 1, 1, 5 } },
+            { 3, 4, { 1, 1, 5 } },
+            { 2, 3, { 1, 5 } },
+            { 1, 2, { 5 } },
+            { 1, 1, { 4 } },
+            { 1, 2, { 6 } },
+            { 2, 3, { 2, 6 } },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 5, 5, { 1, 1, 1, 1, 1 } },
+            { 4, 4, { 1, 1, 1, 1 } },
+            { 3, 3, { 1, 1, 1 } },
+            { 2, 2, { 1, 1 } },
+            { 1, 1, { 1 } },
+            { 0, 0, {} },
+            { 1, 1, { 2 } },
+            { 2, 2, { 2, 2 } },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 6, 7, { 1, 1, 1, 1, 1, 5 } },
+            { 5, 6, { 1, 1, 1, 1, 5 } },
+            { 4, 5, { 1, 1, 1, 5 } },
+            { 3, 4, { 1, 1, 5 } },
+            { 2, 3, { 1, 5 } },
+            { 1, 2, { 5 } },
+            { 1, 1, { 4 } },
+            { 1, 2, { 6 } },
+            { 2, 3, { 2, 6 } },
+            { 255, 0, {} }
+        }
+    },
+    {
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 5, 5, { 1, 1, 1, 1, 1 } },
+            { 4, 4, { 1, 1, 1, 1 } },
+            { 3, 3, { 1, 1, 1 } },
+            { 2, 2, { 1, 1 } },
+            { 1, 1, { 1 } },
+            { 0, 0, {} },
+            { 1, 1, { 2 } },
+            { 2, 2, { 2, 2 } },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 6, 7, { 1, 1, 1, 1, 1, 5 } },
+            { 5, 6, { 1, 1, 1, 1, 5 } },
+            { 4, 5, { 1, 1, 1, 5 } },
+            { 3, 4, { 1, 1, 5 } },
+            { 2, 3, { 1, 5 } },
+            { 1, 2, { 5 } },
+            { 1, 1, { 4 } },
+            { 1, 2, { 6 } },
+            { 2, 3, { 2, 6 } },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 5, 7, { 1, 1, 1, 5, 5 } },
+            { 4, 6, { 1, 1, 5, 5 } },
+            { 3, 5, { 1, 5, 5 } },
+            { 2, 4, { 5, 5 } },
+            { 2, 3, { 4, 5 } },
+            { 2, 2, { 4, 4 } },
+            { 2, 3, { 4, 6 } },
+            { 2, 4, { 6, 6 } },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 5, 8, { 1, 1, 5, 5, 5 } },
+            { 4, 7, { 1, 5, 5, 5 } },
+            { 3, 6, { 5, 5, 5 } },
+            { 3, 5, { 4, 5, 5 } },
+            { 3, 4, { 4, 4, 5 } },
+            { 3, 3, { 4, 4, 4 } },
+            { 3, 4, { 4, 4, 6 } },
+            { 3, 5, { 4, 6, 6 } },
+            { 3, 6, { 6, 6, 6 } },
+            { 255, 0, {} }
+        }
+    },
+    {
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 5, 5, { 1, 1, 1, 1, 1 } },
+            { 4, 4, { 1, 1, 1, 1 } },
+            { 3, 3, { 1, 1, 1 } },
+            { 2, 2, { 1, 1 } },
+            { 1, 1, { 1 } },
+            { 0, 0, {} },
+            { 1, 1, { 2 } },
+            { 2, 2, { 2, 2 } },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 6, 7, { 1, 1, 1, 1, 1, 5 } },
+            { 5, 6, { 1, 1, 1, 1, 5 } },
+            { 4, 5, { 1, 1, 1, 5 } },
+            { 3, 4, { 1, 1, 5 } },
+            { 2, 3, { 1, 5 } },
+            { 1, 2, { 5 } },
+            { 1, 1, { 4 } },
+            { 1, 2, { 6 } },
+            { 2, 3, { 2, 6 } },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 5, 7, { 1, 1, 1, 5, 5 } },
+            { 4, 6, { 1, 1, 5, 5 } },
+            { 3, 5, { 1, 5, 5 } },
+            { 2, 4, { 5, 5 } },
+            { 2, 3, { 4, 5 } },
+            { 2, 2, { 4, 4 } },
+            { 2, 3, { 4, 6 } },
+            { 2, 4, { 6, 6 } },
+            { 255, 0, {} },
+            { 255, 0, {} }
+        },
+        {
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 255, 0, {} },
+            { 5, 8, { 1, 1, 5, 5, 5 } },
+            { 4, 7, { 1, 5, 5, 5 } },
+            { 3, 6, { 5, 5, 5 } },
+            { 3, 5, { 4, 5, 5 } },
+            { 3, 4, { 4, 4, 5 } },
+            { 3, 3, { 4, 4, 4 } },
+            { 3, 4, { 4, 4, 6 } },
+            { 3, 5, { 4, 6, 6 } },
+            { 3, 6, { 6, 6, 6 } },
+            { 255, 0, {} }
+        }
+    }
+};
+
+#endif
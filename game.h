@@ -0,0 +1,1097 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+//Define board sizes
+#define WIDTH 10
+#define HEIGHT 22
+#define VISIBLE_HEIGHT 20
+
+#define ARRAY_COUNT(x) (sizeof(x) / sizeof((x)[0]))
+
+const u8 FRAMES_PER_DROP[] = {
+    48,
+    43,
+    38,
+    33,
+    28,
+    23,
+    18,
+    13,
+    8,
+    6,
+    5,
+    5,
+    5,
+    4,
+    4,
+    4,
+    3,
+    3,
+    3,
+    2,
+    2,
+    2,
+    2,
+    2,
+    2,
+    2,
+    2,
+    2,
+    2,
+    1
+};
+
+//Convert from frames to seconds
+const float TARGET_SECONDS_PER_FRAME = 1.f / 60.f;
+
+struct Tetromino
+{
+    const u8 *data;
+    const int side;
+};
+
+Tetromino tetromino(const u8 *data, int side)
+{
+    return { data, side };
+}
+
+const u8 TETROMINO_DEFAULT[] = {
+    0, 0, 0, 0,
+    0, 0, 0, 0,
+    0, 0, 0, 0,
+    0, 0, 0, 0
+};
+
+//I-shaped tetromino
+const u8 TETROMINO_1[] = {
+    0, 0, 0, 0,
+    1, 1, 1, 1,
+    0, 0, 0, 0,
+    0, 0, 0, 0
+};
+
+//O-shaped tetromino
+const u8 TETROMINO_2[] = {
+    2, 2,
+    2, 2
+};
+
+//T-shaped tetromino
+const u8 TETROMINO_3[] = {
+    0, 3, 0,
+    3, 3, 3,
+    0, 0, 0
+};
+
+//S-shaped tetromino
+const u8 TETROMINO_4[] = {
+    0, 4, 4,
+    4, 4, 0,
+    0, 0, 0
+};
+
+//Z-shaped tetromino
+const u8 TETROMINO_5[] = {
+    5, 5, 0,
+    0, 5, 5,
+    0, 0, 0
+};
+
+//L-shaped tetromino
+const u8 TETROMINO_6[] = {
+    6, 0, 0,
+    6, 6, 6,
+    0, 0, 0
+};
+ //J-shaped tetromino
+const u8 TETROMINO_7[] = {
+    0, 0, 7,
+    7, 7, 7,
+    0, 0, 0
+};
+
+
+const Tetromino TETROMINOS[] = {
+    tetromino(TETROMINO_DEFAULT, 4),
+    tetromino(TETROMINO_1, 4),
+    tetromino(TETROMINO_2, 2),
+    tetromino(TETROMINO_3, 3),
+    tetromino(TETROMINO_4, 3),
+    tetromino(TETROMINO_5, 3),
+    tetromino(TETROMINO_6, 3),
+    tetromino(TETROMINO_7, 3),
+};
+
+enum Game_Phase
+{
+    GAME_PHASE_START,
+    GAME_PHASE_PLAY,
+    GAME_PHASE_LINE,
+    GAME_PHASE_GAMEOVER
+};
+
+//Rule variants a game can be played under, see Rule_Set
+enum Game_Rules
+{
+    RULES_CLASSIC,
+    RULES_GUIDELINE,
+    RULES_TOURNAMENT,
+    RULES_COUNT
+};
+
+const char *RULES_NAMES[RULES_COUNT] = {
+    "classic",
+    "guideline",
+    "tournament"
+};
+
+//The update only queues sounds, the platform layer plays them after each frame
+enum Sound_Effect
+{
+    SOUND_INCREASE_LEVEL,
+    SOUND_DECREASE_LEVEL,
+    SOUND_START,
+    SOUND_SOFT_DROP,
+    SOUND_MOVE,
+    SOUND_ROTATE,
+    SOUND_LANDING,
+    SOUND_HARD_DROP,
+    SOUND_LEVEL_UP,
+    SOUND_PAUSE,
+    SOUND_GAMEOVER,
+    SOUND_COUNT
+};
+
+struct Piece_State
+{
+    u8 tetromino_index;
+    int offset_row;
+    int offset_col;
+    int rotation;
+};
+
+//Represents the board with zero is an empty cell and the other values represent different colors
+struct Game_State
+{
+    u8 board[WIDTH * HEIGHT];
+    u8 lines[HEIGHT];
+    int pending_line_count;
+
+    bool muted=false;
+    bool holdPlace=false;
+
+    Piece_State piece;
+    Piece_State nextPiece;
+    Piece_State holdPiece;
+
+    Game_Phase phase;
+
+    int start_level;
+    int level;
+    int line_count;
+    int points;
+    u8 pause;
+    //Game_Rules, set before the game starts
+    u8 rules;
+    //Pieces dealt from the current bag by Bag_Randomizer
+    u8 bag;
+    //Frames the piece has been resting under a lock delay
+    u8 lock_frames;
+
+    float next_drop_time;
+    float highlight_end_time;
+    float time;
+
+    u32 rng_state;
+    u32 frame;
+    u32 sounds;
+    u32 piece_count;
+
+    //Per-game bookkeeping for telemetry.h
+    float telemetry_time;
+    u16 piece_inputs;
+    u8 max_stack_height;
+};
+
+struct Input_State
+{
+    u8 left;
+    u8 right;
+    u8 up;
+    u8 down;
+    u8 space;
+    u8 p;
+    u8 m;
+    u8 g;
+    u8 h;
+
+    s8 dleft;
+    s8 dright;
+    s8 dup;
+    s8 ddown;
+    s8 dspace;
+    s8 dp;
+    s8 dm;
+    s8 dg;
+    s8 dh;
+};
+
+//Compact button mask used for replays and netplay
+enum Input_Button
+{
+    INPUT_LEFT = 1 << 0,
+    INPUT_RIGHT = 1 << 1,
+    INPUT_UP = 1 << 2,
+    INPUT_DOWN = 1 << 3,
+    INPUT_SPACE = 1 << 4,
+    INPUT_P = 1 << 5,
+    INPUT_M = 1 << 6,
+    INPUT_G = 1 << 7,
+    INPUT_H = 1 << 8
+};
+
+u16 pack_input(const Input_State *input)
+{
+    u16 buttons = 0;
+    buttons |= input->left ? INPUT_LEFT : 0;
+    buttons |= input->right ? INPUT_RIGHT : 0;
+    buttons |= input->up ? INPUT_UP : 0;
+    buttons |= input->down ? INPUT_DOWN : 0;
+    buttons |= input->space ? INPUT_SPACE : 0;
+    buttons |= input->p ? INPUT_P : 0;
+    buttons |= input->m ? INPUT_M : 0;
+    buttons |= input->g ? INPUT_G : 0;
+    buttons |= input->h ? INPUT_H : 0;
+    return buttons;
+}
+
+//Rebuilds the held keys and their press/release edges from two button masks
+Input_State unpack_input(u16 buttons, u16 prev_buttons)
+{
+    Input_State input = {};
+    input.left = (buttons & INPUT_LEFT) != 0;
+    input.right = (buttons & INPUT_RIGHT) != 0;
+    input.up = (buttons & INPUT_UP) != 0;
+    input.down = (buttons & INPUT_DOWN) != 0;
+    input.space = (buttons & INPUT_SPACE) != 0;
+    input.p = (buttons & INPUT_P) != 0;
+    input.m = (buttons & INPUT_M) != 0;
+    input.g = (buttons & INPUT_G) != 0;
+    input.h = (buttons & INPUT_H) != 0;
+
+    input.dleft = input.left - ((prev_buttons & INPUT_LEFT) != 0);
+    input.dright = input.right - ((prev_buttons & INPUT_RIGHT) != 0);
+    input.dup = input.up - ((prev_buttons & INPUT_UP) != 0);
+    input.ddown = input.down - ((prev_buttons & INPUT_DOWN) != 0);
+    input.dspace = input.space - ((prev_buttons & INPUT_SPACE) != 0);
+    input.dp = input.p - ((prev_buttons & INPUT_P) != 0);
+    input.dm = input.m - ((prev_buttons & INPUT_M) != 0);
+    input.dg = input.g - ((prev_buttons & INPUT_G) != 0);
+    input.dh = input.h - ((prev_buttons & INPUT_H) != 0);
+    return input;
+}
+
+void play_sound(Game_State *game, Sound_Effect sound)
+{
+    game->sounds |= 1u << sound;
+}
+
+//Get the value at a coordinate
+u8 matrix_get(const u8 *values, int width, int row, int col)
+{
+    int index = row * width + col;
+    return values[index];
+}
+
+//Set the value at a coordinate
+void matrix_set(u8 *values, int width, int row, int col, u8 value)
+{
+    int index = row * width + col;
+    values[index] = value;
+}
+
+//Rotates the tetromino
+u8 tetromino_rotate(const Tetromino *tetromino, int row, int col, int rotation)
+{
+    int side = tetromino->side;
+    switch (rotation)
+    {
+    case 0:
+        return tetromino->data[row * side + col];
+    case 1:
+        return tetromino->data[(side - col - 1) * side + row];
+    case 2:
+        return tetromino->data[(side - row - 1) * side + (side - col - 1)];
+    case 3:
+        return tetromino->data[col * side + (side - row - 1)];
+    }
+    return 0;
+}
+
+u8 check_row_filled(const u8 *values, int width, int row)
+{
+    for (int col = 0;
+         col < width;
+         ++col)
+    {
+        if (!matrix_get(values, width, row, col))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+u8 check_row_empty(const u8 *values, int width, int row)
+{
+    for (int col = 0;
+         col < width;
+         ++col)
+    {
+        if (matrix_get(values, width, row, col))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int find_lines(const u8 *values, int width, int height, u8 *lines_out)
+{
+    int count = 0;
+    for (int row = 0;
+         row < height;
+         ++row)
+    {
+        u8 filled = check_row_filled(values, width, row);
+        lines_out[row] = filled;
+        count += filled;
+    }
+    return count;
+}
+
+void clear_lines(u8 *values, int width, int height, const u8 *lines)
+{
+    int src_row = height - 1;
+    for (int dst_row = height - 1;
+         dst_row >= 0;
+         --dst_row)
+    {
+        while (src_row >= 0 && lines[src_row])
+        {
+            --src_row;
+        }
+
+        if (src_row < 0)
+        {
+            memset(values + dst_row * width, 0, width);
+        }
+        else
+        {
+            if (src_row != dst_row)
+            {
+                memcpy(values + dst_row * width,
+                       values + src_row * width,
+                       width);
+            }
+            --src_row;
+        }
+    }
+}
+
+//Checks if the tetromino collides with anything
+bool check_piece_valid(const Piece_State *piece,
+                  const u8 *board, int width, int height)
+{
+    const Tetromino *tetromino = TETROMINOS + piece->tetromino_index;
+    // assert(tetromino);
+
+    for (int row = 0;
+         row < tetromino->side;
+         ++row)
+    {
+        for (int col = 0;
+             col < tetromino->side;
+             ++col)
+        {
+            u8 value = tetromino_rotate(tetromino, row, col, piece->rotation);
+            if (value > 0)
+            {
+                int board_row = piece->offset_row + row;
+                int board_col = piece->offset_col + col;
+                if (board_row < 0)
+                {
+                    return false;
+                }
+                if (board_row >= height)
+                {
+                    return false;
+                }
+                if (board_col < 0)
+                {
+                    return false;
+                }
+                if (board_col >= width)
+                {
+                    return false;
+                }
+                if (matrix_get(board, width, board_row, board_col))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+#ifdef TETRIS_TELEMETRY
+#include "telemetry.h"
+#else
+#define TELEMETRY_SPAWN(game, start)
+#define TELEMETRY_MERGE(game)
+#define TELEMETRY_LINE(game)
+#define TELEMETRY_INPUT(game, input)
+#define TELEMETRY_GAME_OVER(game)
+#define TELEMETRY_MUTE(muted)
+#endif
+
+#ifdef TETRIS_TRACE
+#include "trace.h"
+#else
+#define TRACE_ZONE(name)
+#define TRACE_THREAD_NAME(name)
+#define TRACE_EXPORT(path) false
+#endif
+
+void merge_piece(Game_State *game)
+{
+    const Tetromino *tetromino = TETROMINOS + game->piece.tetromino_index;
+    for (int row = 0;
+         row < tetromino->side;
+         ++row)
+    {
+        for (int col = 0;
+             col < tetromino->side;
+             ++col)
+        {
+            u8 value = tetromino_rotate(tetromino, row, col, game->piece.rotation);
+            if (value)
+            {
+                int board_row = game->piece.offset_row + row;
+                int board_col = game->piece.offset_col + col;
+                matrix_set(game->board, WIDTH, board_row, board_col, value);
+            }
+        }
+    }
+    TELEMETRY_MERGE(game);
+}
+
+//Xorshift generator kept in the game state so a seed replays the same pieces
+u32 random_next(u32 *state)
+{
+    u32 x = *state;
+    if (!x)
+    {
+        x = 0x9E3779B9;
+    }
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+int random_int(Game_State *game, int min, int max)
+{
+    int range = max - min;
+    return min + random_next(&game->rng_state) % range;
+}
+
+void seed_game(Game_State *game, u32 seed)
+{
+    game->rng_state = seed;
+}
+
+float get_time_to_next_drop(int level)
+{
+    if (level > 29)
+    {
+        level = 29;
+    }
+    return FRAMES_PER_DROP[level] * TARGET_SECONDS_PER_FRAME;
+}
+
+
+void pushHold(Game_State* game)
+{
+    if(game->holdPlace)
+    {
+        game->nextPiece.tetromino_index=game->holdPiece.tetromino_index;
+        game->holdPiece = {};
+        game->holdPlace = false;
+    }
+
+}
+
+int compute_points(int level, int line_count)
+{
+    switch (line_count)
+    {
+    case 1:
+        return 40 * (level + 1);
+    case 2:
+        return 100 * (level + 1);
+    case 3:
+        return 300 * (level + 1);
+    case 4:
+        return 1200 * (level + 1);
+    }
+    return 0;
+}
+
+int min(int x, int y)
+{
+    return x < y ? x : y;
+}
+int max(int x, int y)
+{
+    return x > y ? x : y;
+}
+
+int get_lines_for_next_level(int start_level, int level)
+{
+    int first_level_up_limit = min((start_level * 10 + 10),
+        max(100, (start_level * 10 - 50)));
+    if (level == start_level)
+    {
+        return first_level_up_limit;
+    }
+    int diff = level - start_level;
+    return first_level_up_limit + diff * 10;
+}
+
+//Rule variants. Each rule is a policy with static functions, and the update below is
+//templated on a Rule_Set of them, so every variant compiles to an engine of its own with
+//its rules inlined and nothing checked per piece. Game_State::rules picks the engine once
+//per step_game. Classic_Rules are the original rules and replay bit for bit.
+
+struct Classic_Gravity
+{
+    static float seconds_per_drop(int level)
+    {
+        return get_time_to_next_drop(level);
+    }
+};
+
+//Frames per row from the guideline curve (0.8 - (L - 1) * 0.007)^(L - 1) seconds with
+//L = level + 1. From level 13 on it would drop more than a row a frame, one is the most
+//the frame step does.
+const u8 GUIDELINE_FRAMES_PER_DROP[] = {
+    60,
+    48,
+    37,
+    28,
+    21,
+    16,
+    11,
+    8,
+    6,
+    4,
+    3,
+    2,
+    1
+};
+
+struct Guideline_Gravity
+{
+    static float seconds_per_drop(int level)
+    {
+        int last = ARRAY_COUNT(GUIDELINE_FRAMES_PER_DROP) - 1;
+        return GUIDELINE_FRAMES_PER_DROP[min(level, last)] * TARGET_SECONDS_PER_FRAME;
+    }
+};
+
+struct Classic_Scoring
+{
+    static int points(int level, int line_count)
+    {
+        return compute_points(level, line_count);
+    }
+};
+
+struct Guideline_Scoring
+{
+    static int points(int level, int line_count)
+    {
+        const int LINE_POINTS[] = { 0, 100, 300, 500, 800 };
+        return LINE_POINTS[line_count] * (level + 1);
+    }
+};
+
+struct Classic_Leveling
+{
+    static int lines_for_next_level(int start_level, int level)
+    {
+        return get_lines_for_next_level(start_level, level);
+    }
+};
+
+//A level every ten lines whatever the start level
+struct Fixed_Goal_Leveling
+{
+    static int lines_for_next_level(int start_level, int level)
+    {
+        return (level - start_level + 1) * 10;
+    }
+};
+
+struct Uniform_Randomizer
+{
+    static u8 next_piece(Game_State *game)
+    {
+        return (u8)random_int(game, 1, ARRAY_COUNT(TETROMINOS));
+    }
+};
+
+//Deals all seven pieces in a random order before any repeats; Game_State::bag has bit
+//i - 1 set once piece i is dealt from the current bag
+struct Bag_Randomizer
+{
+    static u8 next_piece(Game_State *game)
+    {
+        const int PIECE_COUNT = ARRAY_COUNT(TETROMINOS) - 1;
+        const u8 FULL_BAG = (1 << PIECE_COUNT) - 1;
+        if (game->bag == FULL_BAG)
+        {
+            game->bag = 0;
+        }
+        int left = 0;
+        for (int piece = 0;
+             piece < PIECE_COUNT;
+             ++piece)
+        {
+            left += !(game->bag & (1 << piece));
+        }
+        int pick = random_int(game, 0, left);
+        for (int piece = 0;
+             piece < PIECE_COUNT;
+             ++piece)
+        {
+            if (!(game->bag & (1 << piece)) && pick-- == 0)
+            {
+                game->bag |= (u8)(1 << piece);
+                return (u8)(piece + 1);
+            }
+        }
+        return 1;
+    }
+};
+
+//Rotation systems settle where a moved or rotated piece ends up; false leaves it in place
+struct No_Kicks
+{
+    static bool fit(const Game_State *game, Piece_State *piece, bool rotated)
+    {
+        (void)rotated;
+        return check_piece_valid(piece, game->board, WIDTH, HEIGHT);
+    }
+};
+
+//A rotation that doesn't fit tries one and two columns to either side, then a row up
+struct Wall_Kicks
+{
+    static bool fit(const Game_State *game, Piece_State *piece, bool rotated)
+    {
+        if (check_piece_valid(piece, game->board, WIDTH, HEIGHT))
+        {
+            return true;
+        }
+        if (!rotated)
+        {
+            return false;
+        }
+        const int KICKS[][2] = { { 0, -1 }, { 0, 1 }, { 0, -2 }, { 0, 2 }, { -1, 0 } };
+        for (int i = 0;
+             i < (int)ARRAY_COUNT(KICKS);
+             ++i)
+        {
+            Piece_State kicked = *piece;
+            kicked.offset_row += KICKS[i][0];
+            kicked.offset_col += KICKS[i][1];
+            if (check_piece_valid(&kicked, game->board, WIDTH, HEIGHT))
+            {
+                *piece = kicked;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+//Frames a resting piece waits before it locks, any move resets the wait; zero locks on landing
+template <int frames>
+struct Fixed_Lock_Delay
+{
+    static const int FRAMES = frames;
+};
+
+template <typename Gravity_Rule,
+          typename Scoring_Rule,
+          typename Leveling_Rule,
+          typename Randomizer_Rule,
+          typename Rotation_Rule,
+          typename Lock_Delay_Rule>
+struct Rule_Set
+{
+    typedef Gravity_Rule Gravity;
+    typedef Scoring_Rule Scoring;
+    typedef Leveling_Rule Leveling;
+    typedef Randomizer_Rule Randomizer;
+    typedef Rotation_Rule Rotation;
+    typedef Lock_Delay_Rule Lock_Delay;
+};
+
+typedef Rule_Set<Classic_Gravity, Classic_Scoring, Classic_Leveling,
+                 Uniform_Randomizer, No_Kicks, Fixed_Lock_Delay<0> > Classic_Rules;
+typedef Rule_Set<Guideline_Gravity, Guideline_Scoring, Fixed_Goal_Leveling,
+                 Bag_Randomizer, Wall_Kicks, Fixed_Lock_Delay<30> > Guideline_Rules;
+//Classic speed for comparable games, with a fair randomizer and a short lock delay
+typedef Rule_Set<Classic_Gravity, Guideline_Scoring, Classic_Leveling,
+                 Bag_Randomizer, No_Kicks, Fixed_Lock_Delay<15> > Tournament_Rules;
+
+template <typename Rules>
+void spawn_piece(Game_State *game, bool start=false)
+{
+    ++game->piece_count;
+    game->piece = {};
+    if(start)
+    {
+        game->piece.tetromino_index = Rules::Randomizer::next_piece(game);
+        game->piece.offset_col = WIDTH / 2;
+
+        game->nextPiece = {};
+        game->nextPiece.tetromino_index = Rules::Randomizer::next_piece(game);
+    }
+    else
+    {
+        game->piece=game->nextPiece;
+        game->piece.offset_col = WIDTH / 2;
+        game->nextPiece.tetromino_index = Rules::Randomizer::next_piece(game);
+    }
+    game->lock_frames = 0;
+    game->next_drop_time = game->time + Rules::Gravity::seconds_per_drop(game->level);
+    TELEMETRY_SPAWN(game, start);
+}
+
+template <typename Rules>
+void hold_piece(Game_State *game)
+{
+    if(!game->holdPlace)
+    {
+        game->holdPiece.tetromino_index = game->piece.tetromino_index;
+        spawn_piece<Rules>(game);
+        game->holdPlace = true;
+    }
+    else
+    {
+        Piece_State piece=game->piece;
+        piece.tetromino_index=game->holdPiece.tetromino_index;
+        if (check_piece_valid(&piece, game->board, WIDTH, HEIGHT))
+        {
+            u8 temp = game->piece.tetromino_index;
+            game->piece.tetromino_index = game->holdPiece.tetromino_index;
+            game->holdPiece.tetromino_index = temp;
+        }
+    }
+}
+
+template <typename Rules>
+void lock_piece(Game_State *game)
+{
+    play_sound(game, SOUND_LANDING);
+    merge_piece(game);
+    spawn_piece<Rules>(game);
+}
+
+//False when the piece is resting; without a lock delay it is locked right away
+template <typename Rules>
+bool soft_drop(Game_State *game)
+{
+    TRACE_ZONE("soft_drop");
+    ++game->piece.offset_row;
+    if (!check_piece_valid(&game->piece, game->board, WIDTH, HEIGHT))
+    {
+        --game->piece.offset_row;
+        if (Rules::Lock_Delay::FRAMES)
+        {
+            //Gravity waits for the next drop instead of retrying every frame
+            game->next_drop_time = game->time + Rules::Gravity::seconds_per_drop(game->level);
+            return false;
+        }
+        lock_piece<Rules>(game);
+        return false;
+    }
+
+    game->next_drop_time = game->time + Rules::Gravity::seconds_per_drop(game->level);
+    return true;
+}
+
+template <typename Rules>
+void update_game_start(Game_State *game, const Input_State *input)
+{
+    TRACE_ZONE("update_game_start");
+    if (input->dup > 0)
+    {
+        play_sound(game, SOUND_INCREASE_LEVEL);
+        ++game->start_level;
+    }
+
+    if (input->ddown > 0 && game->start_level > 0)
+    {
+        play_sound(game, SOUND_DECREASE_LEVEL);
+        --game->start_level;
+    }
+
+    if (input->dspace > 0)
+    {
+        play_sound(game, SOUND_START);
+        memset(game->board, 0, WIDTH * HEIGHT);
+        game->level = game->start_level;
+        game->line_count = 0;
+        game->points = 0;
+        game->bag = 0;
+        spawn_piece<Rules>(game, true);
+        game->phase = GAME_PHASE_PLAY;
+    }
+}
+
+void update_game_gameover(Game_State *game, const Input_State *input)
+{
+    TRACE_ZONE("update_game_gameover");
+    if (input->dspace > 0)
+    {
+        game->phase = GAME_PHASE_START;
+    }
+}
+
+template <typename Rules>
+void update_game_line(Game_State *game)
+{
+    TRACE_ZONE("update_game_line");
+    if (game->time >= game->highlight_end_time)
+    {
+        TELEMETRY_LINE(game);
+        clear_lines(game->board, WIDTH, HEIGHT, game->lines);
+        game->line_count += game->pending_line_count;
+        game->points += Rules::Scoring::points(game->level, game->pending_line_count);
+
+        int lines_for_next_level = Rules::Leveling::lines_for_next_level(game->start_level,
+                                                                         game->level);
+        if (game->line_count >= lines_for_next_level)
+        {
+            ++game->level;
+        }
+
+        game->phase = GAME_PHASE_PLAY;
+    }
+}
+
+template <typename Rules>
+void update_game_play(Game_State *game, const Input_State *input)
+{
+    TRACE_ZONE("update_game_play");
+    if (input->dp > 0) {
+        play_sound(game, SOUND_PAUSE);
+        game->pause = (game->pause+1) % 2;
+    }
+    TELEMETRY_INPUT(game, input);
+    Piece_State piece = game->piece;
+    bool moved = false;
+    bool rotated = false;
+
+    if (input->dleft > 0 && game->pause == 0)
+    {
+        play_sound(game, SOUND_MOVE);
+        --piece.offset_col;
+        moved = true;
+    }
+    if (input->dright> 0 && game->pause == 0)
+    {
+        play_sound(game, SOUND_MOVE);
+        ++piece.offset_col;
+        moved = true;
+    }
+    if (input->dup > 0 && game->pause == 0)
+    {
+        play_sound(game, SOUND_ROTATE);
+        piece.rotation = (piece.rotation + 1) % 4;
+        rotated = true;
+    }
+
+    if (Rules::Rotation::fit(game, &piece, rotated))
+    {
+        game->piece = piece;
+        if (Rules::Lock_Delay::FRAMES && (moved || rotated))
+        {
+            game->lock_frames = 0;
+        }
+    }
+
+    if (input->ddown > 0 && game->pause == 0)
+    {
+        play_sound(game, SOUND_MOVE);
+        soft_drop<Rules>(game);
+    }
+
+    if (input->dspace > 0 && game->pause == 0)
+    {
+        play_sound(game, SOUND_HARD_DROP);
+        while(soft_drop<Rules>(game));
+        if (Rules::Lock_Delay::FRAMES)
+        {
+            lock_piece<Rules>(game);
+        }
+    }
+
+    while (game->time >= game->next_drop_time && game->pause == 0)
+    {
+        play_sound(game, SOUND_SOFT_DROP);
+        soft_drop<Rules>(game);
+    }
+
+    if (input->dg > 0 && game->pause == 0)
+    {
+        hold_piece<Rules>(game);
+    }
+
+    if(input->dh > 0 && game->pause == 0)
+    {
+        pushHold(game);
+    }
+
+    if (Rules::Lock_Delay::FRAMES && game->pause == 0)
+    {
+        Piece_State below = game->piece;
+        ++below.offset_row;
+        if (check_piece_valid(&below, game->board, WIDTH, HEIGHT))
+        {
+            game->lock_frames = 0;
+        }
+        else if (++game->lock_frames >= Rules::Lock_Delay::FRAMES)
+        {
+            lock_piece<Rules>(game);
+        }
+    }
+
+    game->pending_line_count = find_lines(game->board, WIDTH, HEIGHT, game->lines);
+    if (game->pending_line_count > 0)
+    {
+        game->phase = GAME_PHASE_LINE;
+        game->highlight_end_time = game->time + 0.5f;
+    }
+
+    int game_over_row = 0;
+    if (!check_row_empty(game->board, WIDTH, game_over_row))
+    {
+        play_sound(game, SOUND_GAMEOVER);
+        TELEMETRY_GAME_OVER(game);
+        game->phase = GAME_PHASE_GAMEOVER;
+    }
+}
+
+//Switches between game phases
+template <typename Rules>
+void update_game(Game_State *game, const Input_State *input)
+{
+    switch(game->phase)
+    {
+    case GAME_PHASE_START:
+        update_game_start<Rules>(game, input);
+        break;
+    case GAME_PHASE_PLAY:
+        update_game_play<Rules>(game, input);
+        break;
+    case GAME_PHASE_LINE:
+        update_game_line<Rules>(game);
+        break;
+    case GAME_PHASE_GAMEOVER:
+        update_game_gameover(game, input);
+        break;
+    }
+}
+
+//Advances one fixed 60 Hz frame without a wall clock, so runs are reproducible
+template <typename Rules>
+void step_game(Game_State *game, const Input_State *input)
+{
+    TRACE_ZONE("step_game");
+    ++game->frame;
+    game->time = game->frame * TARGET_SECONDS_PER_FRAME;
+    update_game<Rules>(game, input);
+}
+
+//The entry points below pick the engine for the game's rules
+
+void update_game(Game_State *game, const Input_State *input)
+{
+    switch(game->rules)
+    {
+    case RULES_GUIDELINE:
+        update_game<Guideline_Rules>(game, input);
+        break;
+    case RULES_TOURNAMENT:
+        update_game<Tournament_Rules>(game, input);
+        break;
+    default:
+        update_game<Classic_Rules>(game, input);
+        break;
+    }
+}
+
+void step_game(Game_State *game, const Input_State *input)
+{
+    switch(game->rules)
+    {
+    case RULES_GUIDELINE:
+        step_game<Guideline_Rules>(game, input);
+        break;
+    case RULES_TOURNAMENT:
+        step_game<Tournament_Rules>(game, input);
+        break;
+    default:
+        step_game<Classic_Rules>(game, input);
+        break;
+    }
+}
+
+void hold_piece(Game_State *game)
+{
+    switch(game->rules)
+    {
+    case RULES_GUIDELINE:
+        hold_piece<Guideline_Rules>(game);
+        break;
+    case RULES_TOURNAMENT:
+        hold_piece<Tournament_Rules>(game);
+        break;
+    default:
+        hold_piece<Classic_Rules>(game);
+        break;
+    }
+}
+
+#endif
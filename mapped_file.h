@@ -0,0 +1,200 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cerrno>
+#include <cstddef>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//A whole file mapped into memory, read-only or writable.
+//Writable maps can be grown; the data pointer changes when they are.
+
+struct Mapped_File
+{
+    u8 *data;
+    size_t size;
+    bool writable;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int file;
+#endif
+};
+
+#ifdef _WIN32
+
+bool mapped_file_map(Mapped_File *mapped)
+{
+    mapped->mapping = 0;
+    mapped->data = 0;
+    if (mapped->size == 0)
+    {
+        return true;
+    }
+    mapped->mapping = CreateFileMappingA(mapped->file, 0,
+                                         mapped->writable ? PAGE_READWRITE : PAGE_READONLY,
+                                         (DWORD)((u64)mapped->size >> 32), (DWORD)mapped->size, 0);
+    if (!mapped->mapping)
+    {
+        return false;
+    }
+    mapped->data = (u8 *)MapViewOfFile(mapped->mapping,
+                                       mapped->writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+                                       0, 0, mapped->size);
+    return mapped->data != 0;
+}
+
+void mapped_file_unmap(Mapped_File *mapped)
+{
+    if (mapped->data)
+    {
+        UnmapViewOfFile(mapped->data);
+    }
+    if (mapped->mapping)
+    {
+        CloseHandle(mapped->mapping);
+    }
+    mapped->data = 0;
+    mapped->mapping = 0;
+}
+
+//Writable files are created when missing; false when the file cannot be opened or mapped
+bool mapped_file_open(Mapped_File *mapped, const char *path, bool writable)
+{
+    *mapped = {};
+    mapped->writable = writable;
+    mapped->file = CreateFileA(path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                               FILE_SHARE_READ | FILE_SHARE_WRITE, 0,
+                               writable ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (mapped->file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(mapped->file, &size);
+    mapped->size = (size_t)size.QuadPart;
+    if (!mapped_file_map(mapped))
+    {
+        CloseHandle(mapped->file);
+        return false;
+    }
+    return true;
+}
+
+bool mapped_file_resize(Mapped_File *mapped, size_t size)
+{
+    mapped_file_unmap(mapped);
+    LARGE_INTEGER distance;
+    distance.QuadPart = (LONGLONG)size;
+    if (!SetFilePointerEx(mapped->file, distance, 0, FILE_BEGIN) || !SetEndOfFile(mapped->file))
+    {
+        mapped_file_map(mapped);
+        return false;
+    }
+    mapped->size = size;
+    return mapped_file_map(mapped);
+}
+
+void mapped_file_close(Mapped_File *mapped)
+{
+    mapped_file_unmap(mapped);
+    CloseHandle(mapped->file);
+    *mapped = {};
+}
+
+bool make_directory(const char *path)
+{
+    return _mkdir(path) == 0 || errno == EEXIST;
+}
+
+#else
+
+bool mapped_file_map(Mapped_File *mapped)
+{
+    mapped->data = 0;
+    if (mapped->size == 0)
+    {
+        return true;
+    }
+    void *data = mmap(0, mapped->size, mapped->writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                      MAP_SHARED, mapped->file, 0);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+    mapped->data = (u8 *)data;
+    return true;
+}
+
+void mapped_file_unmap(Mapped_File *mapped)
+{
+    if (mapped->data)
+    {
+        munmap(mapped->data, mapped->size);
+    }
+    mapped->data = 0;
+}
+
+//Writable files are created when missing; false when the file cannot be opened or mapped
+bool mapped_file_open(Mapped_File *mapped, const char *path, bool writable)
+{
+    *mapped = {};
+    mapped->writable = writable;
+    mapped->file = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (mapped->file < 0)
+    {
+        return false;
+    }
+    struct stat info;
+    if (fstat(mapped->file, &info) != 0)
+    {
+        close(mapped->file);
+        return false;
+    }
+    mapped->size = (size_t)info.st_size;
+    if (!mapped_file_map(mapped))
+    {
+        close(mapped->file);
+        return false;
+    }
+    return true;
+}
+
+bool mapped_file_resize(Mapped_File *mapped, size_t size)
+{
+    mapped_file_unmap(mapped);
+    if (ftruncate(mapped->file, (off_t)size) != 0)
+    {
+        mapped_file_map(mapped);
+        return false;
+    }
+    mapped->size = size;
+    return mapped_file_map(mapped);
+}
+
+void mapped_file_close(Mapped_File *mapped)
+{
+    mapped_file_unmap(mapped);
+    close(mapped->file);
+    *mapped = {};
+}
+
+bool make_directory(const char *path)
+{
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+#endif
+
+#endif
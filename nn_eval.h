@@ -0,0 +1,277 @@
+#ifndef NN_EVAL_H
+#define NN_EVAL_H
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "mapped_file.h"
+
+//Learned position evaluation for the bot: a small quantized network over the board after a
+//placement, the piece in hand and the held one, written by nn_train.cpp.
+//
+//The inputs are one bit per cell plus a one-hot hand and hold, so the first layer is a sum of
+//the int16 weight columns of the set inputs, with no multiplies. Activations are clipped to
+//0..127 and the second layer is int8 weights against those bytes, 32 products per instruction
+//on AVX2; the output layer is a short int32 dot product. Without AVX2 the same integer math
+//runs scalar and gives exactly the same scores.
+//
+//File layout: Nn_Model_Header, then w1 s16[NN_INPUTS][NN_HIDDEN1], b1 s16[NN_HIDDEN1],
+//w2 s8[NN_HIDDEN2][NN_HIDDEN1], b2 s32[NN_HIDDEN2], w3 s16[NN_HIDDEN2], b3 s32.
+//Scales: an activation of 1.0 is 127, a second layer weight of 1.0 is 1 << NN_W2_SHIFT, and
+//the header's output_scale turns the final sum into evaluation units.
+
+#define NN_MODEL_MAGIC 0x4C45564E
+#define NN_MODEL_VERSION 1
+
+#define NN_CELL_INPUTS (WIDTH * HEIGHT)
+//Hand and hold one-hot, index 0 for none
+#define NN_PIECE_INPUTS 8
+#define NN_INPUTS (NN_CELL_INPUTS + 2 * NN_PIECE_INPUTS)
+#define NN_MAX_ACTIVE (NN_CELL_INPUTS + 2)
+#define NN_HIDDEN1 64
+#define NN_HIDDEN2 32
+#define NN_ACTIVATION_MAX 127
+#define NN_W2_SHIFT 6
+
+struct Nn_Model_Header
+{
+    u32 magic;
+    u32 version;
+    u32 inputs;
+    u32 hidden1;
+    u32 hidden2;
+    float output_scale;
+    u32 reserved[10];
+};
+
+struct Nn_Model
+{
+    Mapped_File file;
+    const Nn_Model_Header *header;
+    const s16 *w1;
+    const s16 *b1;
+    const s8 *w2;
+    const s32 *b2;
+    const s16 *w3;
+    const s32 *b3;
+};
+
+//One position to score; rows are in the bitboard layout of batch_engine.h
+struct Nn_Position
+{
+    const u16 *rows;
+    u8 hand;
+    u8 hold;
+};
+
+size_t nn_model_size()
+{
+    return sizeof(Nn_Model_Header) +
+           NN_INPUTS * NN_HIDDEN1 * sizeof(s16) + NN_HIDDEN1 * sizeof(s16) +
+           NN_HIDDEN2 * NN_HIDDEN1 * sizeof(s8) + NN_HIDDEN2 * sizeof(s32) +
+           NN_HIDDEN2 * sizeof(s16) + sizeof(s32);
+}
+
+//Null when the file is missing or not a model of this version and shape
+Nn_Model *nn_model_open(const char *path)
+{
+    Nn_Model *model = new Nn_Model();
+    if (!mapped_file_open(&model->file, path, false))
+    {
+        delete model;
+        return 0;
+    }
+    const u8 *data = model->file.data;
+    model->header = (const Nn_Model_Header *)data;
+    const Nn_Model_Header *header = model->header;
+    bool valid = model->file.size >= nn_model_size() &&
+                 header->magic == NN_MODEL_MAGIC &&
+                 header->version == NN_MODEL_VERSION &&
+                 header->inputs == NN_INPUTS &&
+                 header->hidden1 == NN_HIDDEN1 &&
+                 header->hidden2 == NN_HIDDEN2;
+    if (!valid)
+    {
+        mapped_file_close(&model->file);
+        delete model;
+        return 0;
+    }
+    data += sizeof(Nn_Model_Header);
+    model->w1 = (const s16 *)data;
+    data += NN_INPUTS * NN_HIDDEN1 * sizeof(s16);
+    model->b1 = (const s16 *)data;
+    data += NN_HIDDEN1 * sizeof(s16);
+    model->w2 = (const s8 *)data;
+    data += NN_HIDDEN2 * NN_HIDDEN1 * sizeof(s8);
+    model->b2 = (const s32 *)data;
+    data += NN_HIDDEN2 * sizeof(s32);
+    model->w3 = (const s16 *)data;
+    data += NN_HIDDEN2 * sizeof(s16);
+    model->b3 = (const s32 *)data;
+    return model;
+}
+
+void nn_model_close(Nn_Model *model)
+{
+    if (model)
+    {
+        mapped_file_close(&model->file);
+        delete model;
+    }
+}
+
+//Indices of the set inputs: filled cells row by row, then hand and hold
+int nn_features(const u16 *rows, u8 hand, u8 hold, u16 *features)
+{
+    int count = 0;
+    for (int row = 0;
+         row < HEIGHT;
+         ++row)
+    {
+        u32 cells = (rows[row] & BATCH_CELL_BITS) >> BATCH_COL_SHIFT;
+        while (cells)
+        {
+            features[count++] = (u16)(row * WIDTH + __builtin_ctz(cells));
+            cells &= cells - 1;
+        }
+    }
+    features[count++] = (u16)(NN_CELL_INPUTS + (hand < NN_PIECE_INPUTS ? hand : 0));
+    features[count++] = (u16)(NN_CELL_INPUTS + NN_PIECE_INPUTS + (hold < NN_PIECE_INPUTS ? hold : 0));
+    return count;
+}
+
+#ifdef __AVX2__
+
+float nn_evaluate(const Nn_Model *model, const u16 *rows, u8 hand, u8 hold)
+{
+    u16 features[NN_MAX_ACTIVE];
+    int count = nn_features(rows, hand, hold, features);
+
+    __m256i acc0 = _mm256_loadu_si256((const __m256i *)model->b1);
+    __m256i acc1 = _mm256_loadu_si256((const __m256i *)(model->b1 + 16));
+    __m256i acc2 = _mm256_loadu_si256((const __m256i *)(model->b1 + 32));
+    __m256i acc3 = _mm256_loadu_si256((const __m256i *)(model->b1 + 48));
+    for (int i = 0;
+         i < count;
+         ++i)
+    {
+        const s16 *column = model->w1 + features[i] * NN_HIDDEN1;
+        acc0 = _mm256_add_epi16(acc0, _mm256_loadu_si256((const __m256i *)column));
+        acc1 = _mm256_add_epi16(acc1, _mm256_loadu_si256((const __m256i *)(column + 16)));
+        acc2 = _mm256_add_epi16(acc2, _mm256_loadu_si256((const __m256i *)(column + 32)));
+        acc3 = _mm256_add_epi16(acc3, _mm256_loadu_si256((const __m256i *)(column + 48)));
+    }
+
+    //Clip to 0..127 and narrow to bytes; the pack interleaves lanes, the permute undoes it
+    __m256i top = _mm256_set1_epi16(NN_ACTIVATION_MAX);
+    __m256i h1_lo = _mm256_permute4x64_epi64(
+        _mm256_packus_epi16(_mm256_min_epi16(acc0, top), _mm256_min_epi16(acc1, top)), 0xD8);
+    __m256i h1_hi = _mm256_permute4x64_epi64(
+        _mm256_packus_epi16(_mm256_min_epi16(acc2, top), _mm256_min_epi16(acc3, top)), 0xD8);
+
+    //Each maddubs pair sum is at most 2 * 127 * 128, so nothing saturates
+    __m256i ones = _mm256_set1_epi16(1);
+    __m256i zero = _mm256_setzero_si256();
+    __m256i top32 = _mm256_set1_epi32(NN_ACTIVATION_MAX);
+    __m256i total = _mm256_setzero_si256();
+    for (int group = 0;
+         group < NN_HIDDEN2;
+         group += 8)
+    {
+        __m256i sums[8];
+        for (int j = 0;
+             j < 8;
+             ++j)
+        {
+            const s8 *weights = model->w2 + (group + j) * NN_HIDDEN1;
+            __m256i lo = _mm256_maddubs_epi16(h1_lo, _mm256_loadu_si256((const __m256i *)weights));
+            __m256i hi = _mm256_maddubs_epi16(h1_hi, _mm256_loadu_si256((const __m256i *)(weights + 32)));
+            sums[j] = _mm256_add_epi32(_mm256_madd_epi16(lo, ones), _mm256_madd_epi16(hi, ones));
+        }
+        __m256i s01 = _mm256_hadd_epi32(sums[0], sums[1]);
+        __m256i s23 = _mm256_hadd_epi32(sums[2], sums[3]);
+        __m256i s45 = _mm256_hadd_epi32(sums[4], sums[5]);
+        __m256i s67 = _mm256_hadd_epi32(sums[6], sums[7]);
+        __m256i s0123 = _mm256_hadd_epi32(s01, s23);
+        __m256i s4567 = _mm256_hadd_epi32(s45, s67);
+        __m256i dots = _mm256_add_epi32(_mm256_permute2x128_si256(s0123, s4567, 0x20),
+                                        _mm256_permute2x128_si256(s0123, s4567, 0x31));
+
+        dots = _mm256_add_epi32(dots, _mm256_loadu_si256((const __m256i *)(model->b2 + group)));
+        __m256i h2 = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(dots, NN_W2_SHIFT), zero), top32);
+        __m256i w3 = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(model->w3 + group)));
+        total = _mm256_add_epi32(total, _mm256_mullo_epi32(h2, w3));
+    }
+
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    s32 output = _mm_cvtsi128_si32(sum) + *model->b3;
+    return output * model->header->output_scale;
+}
+
+#else
+
+float nn_evaluate(const Nn_Model *model, const u16 *rows, u8 hand, u8 hold)
+{
+    u16 features[NN_MAX_ACTIVE];
+    int count = nn_features(rows, hand, hold, features);
+
+    s16 acc[NN_HIDDEN1];
+    memcpy(acc, model->b1, sizeof(acc));
+    for (int i = 0;
+         i < count;
+         ++i)
+    {
+        const s16 *column = model->w1 + features[i] * NN_HIDDEN1;
+        for (int j = 0;
+             j < NN_HIDDEN1;
+             ++j)
+        {
+            acc[j] = (s16)(acc[j] + column[j]);
+        }
+    }
+
+    u8 h1[NN_HIDDEN1];
+    for (int j = 0;
+         j < NN_HIDDEN1;
+         ++j)
+    {
+        h1[j] = (u8)(acc[j] < 0 ? 0 : acc[j] > NN_ACTIVATION_MAX ? NN_ACTIVATION_MAX : acc[j]);
+    }
+
+    s32 output = *model->b3;
+    for (int j = 0;
+         j < NN_HIDDEN2;
+         ++j)
+    {
+        const s8 *weights = model->w2 + j * NN_HIDDEN1;
+        s32 dot = 0;
+        for (int i = 0;
+             i < NN_HIDDEN1;
+             ++i)
+        {
+            dot += h1[i] * weights[i];
+        }
+        s32 h2 = (dot + model->b2[j]) >> NN_W2_SHIFT;
+        h2 = h2 < 0 ? 0 : h2 > NN_ACTIVATION_MAX ? NN_ACTIVATION_MAX : h2;
+        output += h2 * model->w3[j];
+    }
+    return output * model->header->output_scale;
+}
+
+#endif
+
+//Scores a batch, such as every placement of one piece; the weights stay in cache across it
+void nn_evaluate_batch(const Nn_Model *model, const Nn_Position *positions, int count, float *scores)
+{
+    for (int i = 0;
+         i < count;
+         ++i)
+    {
+        scores[i] = nn_evaluate(model, positions[i].rows, positions[i].hand, positions[i].hold);
+    }
+}
+
+#endif
@@ -0,0 +1,531 @@
+//Trains the evaluation network read by nn_eval.h and writes it quantized.
+//Build: g++ -O2 -mavx2 nn_train.cpp -o nn_train -pthread  (drop -mavx2 for the scalar path)
+//Usage: nn_train [--games n] [--pieces n] [--epochs n] [--seed n] [--out file]
+//
+//Positions come from bot self-play: every placement of the piece in hand, from every
+//position the bot was in. Each is labelled with the hand-tuned evaluation, so the network
+//distils it.
+//Training runs in float with the activations clipped to the range the quantized layers
+//can hold, then the model is quantized, written, reloaded through nn_eval.h and timed.
+//The default output is not the eval.nn the game loads; copy a model there once it plays
+//better than the hand-tuned evaluation.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <vector>
+
+#include "game.h"
+#include "bot.h"
+
+//Labels are divided by this so the network's outputs stay near one
+#define NN_TRAIN_TARGET_SCALE 64.0f
+#define NN_TRAIN_BATCH 256
+#define NN_TRAIN_W3_SCALE 256.0f
+
+struct Sample
+{
+    u16 rows[BATCH_ROWS];
+    u8 hand;
+    u8 hold;
+    float label;
+};
+
+struct Float_Network
+{
+    float w1[NN_INPUTS][NN_HIDDEN1];
+    float b1[NN_HIDDEN1];
+    float w2[NN_HIDDEN2][NN_HIDDEN1];
+    float b2[NN_HIDDEN2];
+    float w3[NN_HIDDEN2];
+    float b3;
+};
+
+//Parameters as one flat array, for the optimizer
+const int NN_PARAMETER_COUNT = sizeof(Float_Network) / sizeof(float);
+
+struct Trainer
+{
+    Float_Network net;
+    Float_Network gradient;
+    Float_Network moment;
+    Float_Network velocity;
+    int step;
+    u32 rng_state;
+};
+
+float train_random_float(u32 *state)
+{
+    return (random_next(state) >> 8) * (1.0f / 16777216.0f);
+}
+
+float clip01(float x)
+{
+    return x < 0 ? 0 : x > 1 ? 1 : x;
+}
+
+void collect_position(std::vector<Sample> *samples, const Game_State *game)
+{
+    u16 rows[BATCH_ROWS];
+    bot_rows_from_board(rows, game->board);
+    u8 tetromino = game->piece.tetromino_index;
+    u8 hold = game->holdPlace ? game->holdPiece.tetromino_index : 0;
+    Bot_Placement placements[BOT_MAX_PLACEMENTS];
+    int count = bot_generate_placements(rows, tetromino, placements);
+    for (int i = 0;
+         i < count;
+         ++i)
+    {
+        Sample sample;
+        memcpy(sample.rows, rows, sizeof(rows));
+        if (bot_place(sample.rows, tetromino, placements + i) < 0)
+        {
+            continue;
+        }
+        //What bot_expand_piece passes for the child of this placement
+        sample.hand = game->nextPiece.tetromino_index;
+        sample.hold = hold;
+        sample.label = bot_evaluate(sample.rows, BOT_DEFAULT_WEIGHTS);
+        samples->push_back(sample);
+    }
+}
+
+void play_game(Bot *bot, u32 seed, int max_pieces, std::vector<Sample> *samples)
+{
+    Game_State game = {};
+    seed_game(&game, seed);
+    Input_State start = unpack_input(INPUT_SPACE, 0);
+    step_game(&game, &start);
+
+    while (game.phase == GAME_PHASE_PLAY && (int)game.piece_count <= max_pieces)
+    {
+        collect_position(samples, &game);
+        u32 piece_count = game.piece_count;
+        bool allow_hold = true;
+        Bot_Move move;
+        for (;;)
+        {
+            if (!bot_decide(bot, &game, allow_hold, &move) || bot_apply_move(&game, &move))
+            {
+                break;
+            }
+            allow_hold = false;
+        }
+        if (game.piece_count == piece_count)
+        {
+            break;
+        }
+    }
+}
+
+void init_network(Trainer *trainer, float mean_label)
+{
+    Float_Network *net = &trainer->net;
+    for (int i = 0;
+         i < NN_INPUTS;
+         ++i)
+    {
+        for (int j = 0;
+             j < NN_HIDDEN1;
+             ++j)
+        {
+            net->w1[i][j] = (train_random_float(&trainer->rng_state) * 2 - 1) * 0.05f;
+        }
+    }
+    float w2_range = 1.0f / sqrtf((float)NN_HIDDEN1);
+    float w3_range = 1.0f / sqrtf((float)NN_HIDDEN2);
+    //Biases start the clipped units in their linear range
+    for (int j = 0;
+         j < NN_HIDDEN1;
+         ++j)
+    {
+        net->b1[j] = 0.5f;
+    }
+    for (int j = 0;
+         j < NN_HIDDEN2;
+         ++j)
+    {
+        for (int i = 0;
+             i < NN_HIDDEN1;
+             ++i)
+        {
+            net->w2[j][i] = (train_random_float(&trainer->rng_state) * 2 - 1) * w2_range;
+        }
+        net->b2[j] = 0.5f;
+        net->w3[j] = (train_random_float(&trainer->rng_state) * 2 - 1) * w3_range;
+    }
+    net->b3 = mean_label / NN_TRAIN_TARGET_SCALE;
+}
+
+//Forward and backward pass for one sample, accumulating into the gradient; returns the squared error
+float train_sample(Trainer *trainer, const Sample *sample)
+{
+    const Float_Network *net = &trainer->net;
+    Float_Network *gradient = &trainer->gradient;
+    u16 features[NN_MAX_ACTIVE];
+    int count = nn_features(sample->rows, sample->hand, sample->hold, features);
+
+    float h1[NN_HIDDEN1];
+    float a1[NN_HIDDEN1];
+    memcpy(h1, net->b1, sizeof(h1));
+    for (int f = 0;
+         f < count;
+         ++f)
+    {
+        for (int j = 0;
+             j < NN_HIDDEN1;
+             ++j)
+        {
+            h1[j] += net->w1[features[f]][j];
+        }
+    }
+    for (int j = 0;
+         j < NN_HIDDEN1;
+         ++j)
+    {
+        a1[j] = clip01(h1[j]);
+    }
+
+    float h2[NN_HIDDEN2];
+    float a2[NN_HIDDEN2];
+    float output = net->b3;
+    for (int j = 0;
+         j < NN_HIDDEN2;
+         ++j)
+    {
+        float sum = net->b2[j];
+        for (int i = 0;
+             i < NN_HIDDEN1;
+             ++i)
+        {
+            sum += net->w2[j][i] * a1[i];
+        }
+        h2[j] = sum;
+        a2[j] = clip01(sum);
+        output += net->w3[j] * a2[j];
+    }
+
+    float error = output - sample->label / NN_TRAIN_TARGET_SCALE;
+    gradient->b3 += error;
+    float d1[NN_HIDDEN1] = {};
+    for (int j = 0;
+         j < NN_HIDDEN2;
+         ++j)
+    {
+        gradient->w3[j] += error * a2[j];
+        if (h2[j] <= 0 || h2[j] >= 1)
+        {
+            continue;
+        }
+        float d2 = error * net->w3[j];
+        gradient->b2[j] += d2;
+        for (int i = 0;
+             i < NN_HIDDEN1;
+             ++i)
+        {
+            gradient->w2[j][i] += d2 * a1[i];
+            d1[i] += d2 * net->w2[j][i];
+        }
+    }
+    for (int j = 0;
+         j < NN_HIDDEN1;
+         ++j)
+    {
+        if (h1[j] <= 0 || h1[j] >= 1)
+        {
+            d1[j] = 0;
+        }
+        gradient->b1[j] += d1[j];
+    }
+    for (int f = 0;
+         f < count;
+         ++f)
+    {
+        for (int j = 0;
+             j < NN_HIDDEN1;
+             ++j)
+        {
+            gradient->w1[features[f]][j] += d1[j];
+        }
+    }
+    return error * error;
+}
+
+//Adam over the averaged batch gradient, then clamps the weights to what quantizes losslessly
+void apply_gradient(Trainer *trainer, int batch_size, float learning_rate)
+{
+    const float beta1 = 0.9f;
+    const float beta2 = 0.999f;
+    ++trainer->step;
+    float correction1 = 1 - powf(beta1, (float)trainer->step);
+    float correction2 = 1 - powf(beta2, (float)trainer->step);
+    float *params = (float *)&trainer->net;
+    float *gradient = (float *)&trainer->gradient;
+    float *moment = (float *)&trainer->moment;
+    float *velocity = (float *)&trainer->velocity;
+    for (int i = 0;
+         i < NN_PARAMETER_COUNT;
+         ++i)
+    {
+        float g = gradient[i] / batch_size;
+        moment[i] = beta1 * moment[i] + (1 - beta1) * g;
+        velocity[i] = beta2 * velocity[i] + (1 - beta2) * g * g;
+        params[i] -= learning_rate * (moment[i] / correction1) / (sqrtf(velocity[i] / correction2) + 1e-8f);
+    }
+    memset(&trainer->gradient, 0, sizeof(trainer->gradient));
+
+    //int8 second layer, and first layer columns small enough that no sum overflows int16
+    float w2_limit = 127.0f / (1 << NN_W2_SHIFT);
+    float w1_limit = 32000.0f / NN_ACTIVATION_MAX / NN_MAX_ACTIVE;
+    for (int j = 0;
+         j < NN_HIDDEN2;
+         ++j)
+    {
+        for (int i = 0;
+             i < NN_HIDDEN1;
+             ++i)
+        {
+            trainer->net.w2[j][i] = fmaxf(-w2_limit, fminf(w2_limit, trainer->net.w2[j][i]));
+        }
+    }
+    for (int i = 0;
+         i < NN_INPUTS;
+         ++i)
+    {
+        for (int j = 0;
+             j < NN_HIDDEN1;
+             ++j)
+        {
+            trainer->net.w1[i][j] = fmaxf(-w1_limit, fminf(w1_limit, trainer->net.w1[i][j]));
+        }
+    }
+}
+
+template <typename T>
+T quantize(float value, float scale, float low, float high)
+{
+    float scaled = roundf(value * scale);
+    return (T)fmaxf(low, fminf(high, scaled));
+}
+
+bool write_model(const char *path, const Float_Network *net)
+{
+    Nn_Model_Header header = {};
+    header.magic = NN_MODEL_MAGIC;
+    header.version = NN_MODEL_VERSION;
+    header.inputs = NN_INPUTS;
+    header.hidden1 = NN_HIDDEN1;
+    header.hidden2 = NN_HIDDEN2;
+    header.output_scale = NN_TRAIN_TARGET_SCALE / (NN_ACTIVATION_MAX * NN_TRAIN_W3_SCALE);
+
+    std::vector<s16> w1(NN_INPUTS * NN_HIDDEN1);
+    s16 b1[NN_HIDDEN1];
+    s8 w2[NN_HIDDEN2 * NN_HIDDEN1];
+    s32 b2[NN_HIDDEN2];
+    s16 w3[NN_HIDDEN2];
+    float activation = (float)NN_ACTIVATION_MAX;
+    float w2_scale = (float)(1 << NN_W2_SHIFT);
+    for (int i = 0;
+         i < NN_INPUTS;
+         ++i)
+    {
+        for (int j = 0;
+             j < NN_HIDDEN1;
+             ++j)
+        {
+            w1[i * NN_HIDDEN1 + j] = quantize<s16>(net->w1[i][j], activation, -32767, 32767);
+        }
+    }
+    for (int j = 0;
+         j < NN_HIDDEN1;
+         ++j)
+    {
+        b1[j] = quantize<s16>(net->b1[j], activation, -32767, 32767);
+    }
+    for (int j = 0;
+         j < NN_HIDDEN2;
+         ++j)
+    {
+        for (int i = 0;
+             i < NN_HIDDEN1;
+             ++i)
+        {
+            w2[j * NN_HIDDEN1 + i] = quantize<s8>(net->w2[j][i], w2_scale, -128, 127);
+        }
+        b2[j] = quantize<s32>(net->b2[j], activation * w2_scale, -1e9f, 1e9f);
+        w3[j] = quantize<s16>(net->w3[j], NN_TRAIN_W3_SCALE, -32767, 32767);
+    }
+    s32 b3 = quantize<s32>(net->b3, activation * NN_TRAIN_W3_SCALE, -1e9f, 1e9f);
+
+    FILE *file = fopen(path, "wb");
+    bool written = file &&
+                   fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(w1.data(), sizeof(s16), w1.size(), file) == w1.size() &&
+                   fwrite(b1, sizeof(b1), 1, file) == 1 &&
+                   fwrite(w2, sizeof(w2), 1, file) == 1 &&
+                   fwrite(b2, sizeof(b2), 1, file) == 1 &&
+                   fwrite(w3, sizeof(w3), 1, file) == 1 &&
+                   fwrite(&b3, sizeof(b3), 1, file) == 1;
+    if (file && fclose(file) != 0)
+    {
+        written = false;
+    }
+    return written;
+}
+
+int main(int argc, char **argv)
+{
+    int games = 40;
+    int pieces = 300;
+    int epochs = 10;
+    u32 seed = 1;
+    const char *out = "eval_trained.nn";
+    for (int i = 1;
+         i + 1 < argc;
+         i += 2)
+    {
+        if (strcmp(argv[i], "--games") == 0)
+        {
+            games = max(1, atoi(argv[i + 1]));
+        }
+        else if (strcmp(argv[i], "--pieces") == 0)
+        {
+            pieces = max(1, atoi(argv[i + 1]));
+        }
+        else if (strcmp(argv[i], "--epochs") == 0)
+        {
+            epochs = max(1, atoi(argv[i + 1]));
+        }
+        else if (strcmp(argv[i], "--seed") == 0)
+        {
+            seed = (u32)strtoul(argv[i + 1], 0, 10);
+        }
+        else if (strcmp(argv[i], "--out") == 0)
+        {
+            out = argv[i + 1];
+        }
+        else
+        {
+            fprintf(stderr, "usage: nn_train [--games n] [--pieces n] [--epochs n] [--seed n] [--out file]\n");
+            return 1;
+        }
+    }
+    if (argc % 2 == 0)
+    {
+        fprintf(stderr, "usage: nn_train [--games n] [--pieces n] [--epochs n] [--seed n] [--out file]\n");
+        return 1;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    Bot_Config config = bot_default_config();
+    config.beam_width = 8;
+    config.time_budget_ms = 2.0f;
+    Bot *bot = bot_create(&config);
+    std::vector<Sample> samples;
+    for (int game = 0;
+         game < games;
+         ++game)
+    {
+        play_game(bot, seed + game, pieces, &samples);
+    }
+    bot_destroy(bot);
+    if (samples.empty())
+    {
+        fprintf(stderr, "no positions collected\n");
+        return 1;
+    }
+    double mean_label = 0;
+    for (const Sample &sample : samples)
+    {
+        mean_label += sample.label;
+    }
+    mean_label /= samples.size();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    printf("%zu positions from %d games, %.1f s\n", samples.size(), games, seconds);
+
+    Trainer *trainer = new Trainer();
+    trainer->rng_state = seed * 0x9E3779B9u + 1;
+    init_network(trainer, (float)mean_label);
+    for (int epoch = 0;
+         epoch < epochs;
+         ++epoch)
+    {
+        for (size_t i = samples.size() - 1;
+             i > 0;
+             --i)
+        {
+            size_t j = random_next(&trainer->rng_state) % (i + 1);
+            std::swap(samples[i], samples[j]);
+        }
+        float learning_rate = 0.002f * powf(0.7f, (float)epoch);
+        double loss = 0;
+        for (size_t start = 0;
+             start < samples.size();
+             start += NN_TRAIN_BATCH)
+        {
+            size_t end = std::min(samples.size(), start + NN_TRAIN_BATCH);
+            for (size_t i = start;
+                 i < end;
+                 ++i)
+            {
+                loss += train_sample(trainer, &samples[i]);
+            }
+            apply_gradient(trainer, (int)(end - start), learning_rate);
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        printf("epoch %d: rms error %.3f, %.1f s\n", epoch + 1,
+               sqrt(loss / samples.size()) * NN_TRAIN_TARGET_SCALE, seconds);
+    }
+
+    if (!write_model(out, &trainer->net))
+    {
+        fprintf(stderr, "could not write %s\n", out);
+        return 1;
+    }
+    delete trainer;
+
+    //Check the file as the bot will use it: quantized error and batched throughput
+    Nn_Model *model = nn_model_open(out);
+    if (!model)
+    {
+        fprintf(stderr, "could not read back %s\n", out);
+        return 1;
+    }
+    std::vector<Nn_Position> positions(samples.size());
+    std::vector<float> scores(samples.size());
+    for (size_t i = 0;
+         i < samples.size();
+         ++i)
+    {
+        positions[i].rows = samples[i].rows;
+        positions[i].hand = samples[i].hand;
+        positions[i].hold = samples[i].hold;
+    }
+    auto timed = std::chrono::steady_clock::now();
+    for (size_t start = 0;
+         start < samples.size();
+         start += BOT_MAX_PLACEMENTS)
+    {
+        int count = (int)std::min((size_t)BOT_MAX_PLACEMENTS, samples.size() - start);
+        nn_evaluate_batch(model, positions.data() + start, count, scores.data() + start);
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - timed).count();
+    double error = 0;
+    for (size_t i = 0;
+         i < samples.size();
+         ++i)
+    {
+        double diff = scores[i] - samples[i].label;
+        error += diff * diff;
+    }
+#ifdef __AVX2__
+    const char *path = "avx2";
+#else
+    const char *path = "scalar";
+#endif
+    printf("%s written, quantized rms error %.3f, %s: %.0f positions/s on one core\n", out,
+           sqrt(error / samples.size()), path, samples.size() / seconds);
+    nn_model_close(model);
+    return 0;
+}
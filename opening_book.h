@@ -0,0 +1,134 @@
+#ifndef OPENING_BOOK_H
+#define OPENING_BOOK_H
+
+#include "mapped_file.h"
+
+//Precomputed placements for the first pieces of a game, written by book_gen.cpp.
+//A position is the board with the piece in hand, the next piece and the held one;
+//its key is a hash of those. The file is an open-addressed table of keys and moves,
+//mapped read-only and probed in place, so opening a book reads nothing up front.
+//
+//File layout: Opening_Book_Header, then slot_count Opening_Book_Entry slots; slot_count
+//is a power of two and a zero key marks an empty slot.
+
+#define OPENING_BOOK_MAGIC 0x4B4F4F42
+#define OPENING_BOOK_VERSION 1
+
+struct Opening_Book_Header
+{
+    u32 magic;
+    u32 version;
+    u32 slot_count;
+    u32 entry_count;
+    u32 max_depth;
+    u32 reserved[3];
+};
+
+//The move in Bot_Move terms: the piece placed, through hold or not, and where it rests
+struct Opening_Book_Entry
+{
+    u64 key;
+    u8 use_hold;
+    u8 tetromino;
+    u8 rotation;
+    s8 offset_row;
+    s8 offset_col;
+    //Pieces placed before this position
+    u8 depth;
+    u16 reserved;
+};
+
+struct Opening_Book
+{
+    Mapped_File file;
+    const Opening_Book_Header *header;
+    const Opening_Book_Entry *entries;
+};
+
+u64 opening_book_mix(u64 x)
+{
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDull;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+//Rows in the bitboard layout of batch_engine.h; never zero
+u64 opening_book_key(const u16 *rows, u8 hand, u8 next, u8 hold)
+{
+    u64 key = opening_book_mix((u64)hand | (u64)next << 8 | (u64)hold << 16);
+    for (int row = 0;
+         row < HEIGHT;
+         row += 4)
+    {
+        u64 word = 0;
+        for (int i = 0;
+             i < 4 && row + i < HEIGHT;
+             ++i)
+        {
+            word |= (u64)rows[row + i] << (i * 16);
+        }
+        key = opening_book_mix(key ^ word);
+    }
+    return key ? key : 1;
+}
+
+//Null when the file is missing or not a book of this version
+Opening_Book *opening_book_open(const char *path)
+{
+    Opening_Book *book = new Opening_Book();
+    if (!mapped_file_open(&book->file, path, false))
+    {
+        delete book;
+        return 0;
+    }
+    book->header = (const Opening_Book_Header *)book->file.data;
+    book->entries = (const Opening_Book_Entry *)(book->header + 1);
+    const Opening_Book_Header *header = book->header;
+    bool valid = book->file.size >= sizeof(Opening_Book_Header) &&
+                 header->magic == OPENING_BOOK_MAGIC &&
+                 header->version == OPENING_BOOK_VERSION &&
+                 header->slot_count && (header->slot_count & (header->slot_count - 1)) == 0 &&
+                 book->file.size >= sizeof(Opening_Book_Header) +
+                                    (size_t)header->slot_count * sizeof(Opening_Book_Entry);
+    if (!valid)
+    {
+        mapped_file_close(&book->file);
+        delete book;
+        return 0;
+    }
+    return book;
+}
+
+void opening_book_close(Opening_Book *book)
+{
+    if (book)
+    {
+        mapped_file_close(&book->file);
+        delete book;
+    }
+}
+
+const Opening_Book_Entry *opening_book_find(const Opening_Book *book, u64 key)
+{
+    u32 mask = book->header->slot_count - 1;
+    for (u32 probe = 0;
+         probe <= mask;
+         ++probe)
+    {
+        const Opening_Book_Entry *entry = book->entries + ((key + probe) & mask);
+        if (entry->key == key)
+        {
+            return entry;
+        }
+        if (entry->key == 0)
+        {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef RENDER_SNAPSHOT_H
+#define RENDER_SNAPSHOT_H
+
+//The part of a Game_State that drawing needs, copied out once per tick so the
+//renderer never reads state the simulation is still changing.
+
+struct Render_Snapshot
+{
+    u8 board[WIDTH * HEIGHT];
+    u8 lines[HEIGHT];
+
+    Piece_State piece;
+    Piece_State nextPiece;
+    Piece_State holdPiece;
+
+    Game_Phase phase;
+    int start_level;
+    int level;
+    int line_count;
+    int points;
+    bool muted;
+    u32 frame;
+};
+
+void make_render_snapshot(const Game_State *game, Render_Snapshot *snapshot)
+{
+    memcpy(snapshot->board, game->board, sizeof(snapshot->board));
+    memcpy(snapshot->lines, game->lines, sizeof(snapshot->lines));
+    snapshot->piece = game->piece;
+    snapshot->nextPiece = game->nextPiece;
+    snapshot->holdPiece = game->holdPiece;
+    snapshot->phase = game->phase;
+    snapshot->start_level = game->start_level;
+    snapshot->level = game->level;
+    snapshot->line_count = game->line_count;
+    snapshot->points = game->points;
+    snapshot->muted = game->muted;
+    snapshot->frame = game->frame;
+}
+
+#endif
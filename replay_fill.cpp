@@ -0,0 +1,265 @@
+//Fills a replay store (replay_store.h) with transitions from bot self-play, then times
+//uniform and prioritized sampling from several reader threads.
+//Build: g++ -O2 -mavx2 replay_fill.cpp -o replay_fill -pthread
+//Usage: replay_fill [--games n] [--pieces n] [--readers n] [--seed n] [--dir path]
+//
+//Each placement the bot makes is one transition: the board and pieces it saw, its move,
+//the points the move scored and the board it left. Games append to whatever the
+//directory already holds, so repeated runs grow one dataset.
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "game.h"
+#include "bot.h"
+#include "replay_store.h"
+
+#define FILL_SAMPLE_BATCH 256
+
+struct Reader_Result
+{
+    u64 samples;
+    u64 checksum;
+};
+
+//Plays one game, appending a transition per placement; false when the store is full
+bool fill_game(Replay_Store *store, Bot *bot, u32 seed, int max_pieces)
+{
+    Game_State game = {};
+    seed_game(&game, seed);
+    Input_State start = unpack_input(INPUT_SPACE, 0);
+    step_game(&game, &start);
+
+    while (game.phase == GAME_PHASE_PLAY && (int)game.piece_count <= max_pieces)
+    {
+        Replay_Step step = {};
+        bot_rows_from_board(step.rows, game.board);
+        step.hand = game.piece.tetromino_index;
+        step.next = game.nextPiece.tetromino_index;
+        step.hold = game.holdPlace ? game.holdPiece.tetromino_index : 0;
+        s32 points = game.points;
+
+        u32 piece_count = game.piece_count;
+        bool allow_hold = true;
+        bool placed = false;
+        Bot_Move move;
+        for (;;)
+        {
+            if (!bot_decide(bot, &game, allow_hold, &move))
+            {
+                break;
+            }
+            if (bot_apply_move(&game, &move))
+            {
+                placed = true;
+                break;
+            }
+            allow_hold = false;
+        }
+        if (!placed || game.piece_count == piece_count)
+        {
+            break;
+        }
+
+        step.use_hold = move.use_hold;
+        step.rotation = move.rotation;
+        step.offset_row = move.offset_row;
+        step.offset_col = move.offset_col;
+        step.reward = (float)(game.points - points);
+        step.terminal = game.phase == GAME_PHASE_GAMEOVER;
+        bot_rows_from_board(step.next_rows, game.board);
+        if (!replay_store_append(store, &step))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Samples in batches and reads every pick back, like a training input pipeline would
+void read_uniform(Replay_Store *store, u32 seed, std::atomic<bool> *stop, Reader_Result *result)
+{
+    u32 rng_state = seed;
+    u32 indices[FILL_SAMPLE_BATCH];
+    Replay_Step step;
+    while (!stop->load(std::memory_order_relaxed))
+    {
+        int count = replay_sample_uniform(store, &rng_state, indices, FILL_SAMPLE_BATCH);
+        for (int i = 0;
+             i < count;
+             ++i)
+        {
+            replay_store_get(store, indices[i], &step);
+            result->checksum += step.rows[HEIGHT - 1] + step.offset_col;
+        }
+        result->samples += count;
+    }
+}
+
+void read_prioritized(Replay_Store *store, u32 seed, std::atomic<bool> *stop, Reader_Result *result)
+{
+    u32 rng_state = seed;
+    u32 indices[FILL_SAMPLE_BATCH];
+    float probabilities[FILL_SAMPLE_BATCH];
+    Replay_Step step;
+    while (!stop->load(std::memory_order_relaxed))
+    {
+        int count = replay_sample_prioritized(store, &rng_state, indices, probabilities, FILL_SAMPLE_BATCH);
+        for (int i = 0;
+             i < count;
+             ++i)
+        {
+            replay_store_get(store, indices[i], &step);
+            result->checksum += step.rows[HEIGHT - 1] + step.offset_col;
+        }
+        result->samples += count;
+    }
+}
+
+//Runs the readers for a second; when prioritized the main thread rewrites a batch of
+//priorities every millisecond meanwhile, about the pace of a training loop
+double time_readers(Replay_Store *store, int readers, bool prioritized)
+{
+    std::atomic<bool> stop(false);
+    std::vector<Reader_Result> results(readers);
+    std::vector<std::thread> threads;
+    for (int i = 0;
+         i < readers;
+         ++i)
+    {
+        results[i] = {};
+        threads.emplace_back(prioritized ? read_prioritized : read_uniform, store, (u32)(i + 1) * 2654435761u,
+                             &stop, &results[i]);
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    u32 rng_state = 12345;
+    u64 updates = 0;
+    while (std::chrono::steady_clock::now() - begin < std::chrono::seconds(1))
+    {
+        if (prioritized)
+        {
+            //Stand-in for the new errors a training step would report
+            u32 indices[FILL_SAMPLE_BATCH];
+            float priorities[FILL_SAMPLE_BATCH];
+            replay_sample_uniform(store, &rng_state, indices, FILL_SAMPLE_BATCH);
+            for (int i = 0;
+                 i < FILL_SAMPLE_BATCH;
+                 ++i)
+            {
+                priorities[i] = 0.05f + (random_next(&rng_state) >> 8) * (1.0f / 16777216.0f);
+            }
+            replay_update_priorities(store, indices, priorities, FILL_SAMPLE_BATCH);
+            updates += FILL_SAMPLE_BATCH;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    stop.store(true, std::memory_order_relaxed);
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    u64 samples = 0;
+    u64 checksum = 0;
+    for (const Reader_Result &result : results)
+    {
+        samples += result.samples;
+        checksum += result.checksum;
+    }
+    printf("%s: %.1fM samples/s over %d readers", prioritized ? "prioritized" : "uniform",
+           samples / seconds / 1e6, readers);
+    if (prioritized)
+    {
+        printf(", %.1fM priority updates/s", updates / seconds / 1e6);
+    }
+    printf(" (checksum %llx)\n", (unsigned long long)checksum);
+    return samples / seconds;
+}
+
+int main(int argc, char **argv)
+{
+    int games = 20;
+    int pieces = 500;
+    int readers = (int)std::thread::hardware_concurrency();
+    u32 seed = 1;
+    const char *directory = "transitions";
+    for (int i = 1;
+         i + 1 < argc;
+         i += 2)
+    {
+        if (strcmp(argv[i], "--games") == 0)
+        {
+            games = max(0, atoi(argv[i + 1]));
+        }
+        else if (strcmp(argv[i], "--pieces") == 0)
+        {
+            pieces = max(1, atoi(argv[i + 1]));
+        }
+        else if (strcmp(argv[i], "--readers") == 0)
+        {
+            readers = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0)
+        {
+            seed = (u32)strtoul(argv[i + 1], 0, 10);
+        }
+        else if (strcmp(argv[i], "--dir") == 0)
+        {
+            directory = argv[i + 1];
+        }
+        else
+        {
+            fprintf(stderr, "usage: replay_fill [--games n] [--pieces n] [--readers n] [--seed n] [--dir path]\n");
+            return 1;
+        }
+    }
+    if (argc % 2 == 0)
+    {
+        fprintf(stderr, "usage: replay_fill [--games n] [--pieces n] [--readers n] [--seed n] [--dir path]\n");
+        return 1;
+    }
+    readers = max(1, readers);
+
+    Replay_Store *store = replay_store_open(directory, true);
+    if (!store)
+    {
+        fprintf(stderr, "could not open a replay store in %s\n", directory);
+        return 1;
+    }
+    u32 existing = replay_store_count(store);
+
+    auto begin = std::chrono::steady_clock::now();
+    Bot_Config config = bot_default_config();
+    Bot *bot = bot_create(&config);
+    bool full = false;
+    for (int game = 0;
+         game < games && !full;
+         ++game)
+    {
+        full = !fill_game(store, bot, seed + game, pieces);
+    }
+    bot_destroy(bot);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    u32 count = replay_store_count(store);
+    printf("%u transitions added in %.1f s, %u in the store%s\n", count - existing, seconds, count,
+           full ? ", which is full" : "");
+    if (!count)
+    {
+        replay_store_close(store);
+        return 0;
+    }
+    double bytes = (double)count * sizeof(Replay_Transition) + (double)store->board_count * sizeof(Replay_Board);
+    printf("%u distinct boards for %u board references, %.1f bytes a transition (Game_State pairs: %zu)\n",
+           store->board_count, count * 2, bytes / count, 2 * sizeof(Game_State));
+
+    time_readers(store, readers, false);
+    time_readers(store, readers, true);
+    replay_store_close(store);
+    return 0;
+}
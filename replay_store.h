@@ -0,0 +1,681 @@
+#ifndef REPLAY_STORE_H
+#define REPLAY_STORE_H
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <shared_mutex>
+#include <thread>
+
+#include "mapped_file.h"
+
+//Append-only store of placement transitions for training: the board before a move, the
+//pieces, the move, its reward and the board after. Boards are packed to a bit per cell and
+//kept once however many transitions share them, found again through a hash of their
+//contents, so a transition costs 16 bytes plus its share of 32-byte boards where two
+//Game_States would take 720.
+//
+//Transitions and boards live in fixed-size segment files in a directory, each mapped whole
+//when it is created, so nothing moves while readers use it. One thread appends, any number
+//sample. Uniform sampling takes no lock: it only reads below the published count, and
+//everything below it was written first. Prioritized sampling keeps a priority per
+//transition in memory, summed per block of REPLAY_PRIORITY_BLOCK into a sum tree per
+//segment, under a lock that samplers share and appends and priority updates take alone.
+//Priorities are not saved; transitions start at the highest priority seen, reopened ones too.
+//Segments are sparse files on most systems, so the unused tail of the last one costs no disk.
+
+#define REPLAY_STORE_MAGIC 0x59504C52
+#define REPLAY_STORE_VERSION 1
+//64 MB segments either way
+#define REPLAY_SEGMENT_TRANSITIONS (1u << 22)
+#define REPLAY_SEGMENT_BOARDS (1u << 21)
+#define REPLAY_MAX_SEGMENTS 512
+#define REPLAY_PRIORITY_BLOCK 256
+#define REPLAY_SEGMENT_BLOCKS (REPLAY_SEGMENT_TRANSITIONS / REPLAY_PRIORITY_BLOCK)
+#define REPLAY_INITIAL_BOARD_SLOTS (1u << 16)
+#define REPLAY_ROWS_PER_WORD 6
+//Piece offsets are stored biased so they fit unsigned fields
+#define REPLAY_OFFSET_BIAS 4
+
+enum Replay_Flag
+{
+    //The move topped out, the board after it is the one it left
+    REPLAY_FLAG_TERMINAL = 1 << 0
+};
+
+struct Replay_Store_Header
+{
+    u32 magic;
+    u32 version;
+    //Written after the data they count
+    u32 transition_count;
+    u32 board_count;
+    u32 reserved[4];
+};
+
+//Six ten-column rows a word
+struct Replay_Board
+{
+    u64 words[4];
+};
+
+struct Replay_Transition
+{
+    u32 board;
+    u32 next_board;
+    float reward;
+    //Hand, next and hold in three bits each, then the Replay_Flag bits
+    u16 pieces;
+    //Rotation in two bits, hold in one, then the biased row and column in six and five
+    u16 action;
+};
+
+//One transition unpacked; rows are in the bitboard layout of batch_engine.h and the move
+//is in Bot_Move terms
+struct Replay_Step
+{
+    u16 rows[BATCH_ROWS];
+    u16 next_rows[BATCH_ROWS];
+    u8 hand;
+    u8 next;
+    u8 hold;
+    u8 use_hold;
+    u8 rotation;
+    s8 offset_row;
+    s8 offset_col;
+    bool terminal;
+    float reward;
+};
+
+struct Replay_Priorities
+{
+    float *leaves;
+    //Block sums as a binary tree: node 1 is the segment's total, block b is node
+    //REPLAY_SEGMENT_BLOCKS + b
+    double *tree;
+};
+
+struct Replay_Store
+{
+    char directory[512];
+    Mapped_File header_file;
+    Mapped_File transitions[REPLAY_MAX_SEGMENTS];
+    Mapped_File boards[REPLAY_MAX_SEGMENTS];
+    std::atomic<u32> transition_count;
+    u32 board_count;
+
+    //Open-addressed board ids by content hash: the high half of a slot is a tag from the
+    //hash, the low half the board id plus one, zero is empty. Only the appender uses it.
+    u64 *board_slots;
+    u32 board_slot_count;
+
+    bool prioritized;
+    Replay_Priorities priorities[REPLAY_MAX_SEGMENTS];
+    float max_priority;
+    std::shared_mutex priority_lock;
+    //Samplers hold off while a writer waits, or a steady stream of them would starve it
+    std::atomic<int> priority_writers;
+};
+
+Replay_Store_Header *replay_header(Replay_Store *store)
+{
+    return (Replay_Store_Header *)store->header_file.data;
+}
+
+u32 replay_store_count(const Replay_Store *store)
+{
+    return store->transition_count.load(std::memory_order_acquire);
+}
+
+void replay_pack_board(const u16 *rows, Replay_Board *board)
+{
+    *board = {};
+    for (int row = 0;
+         row < HEIGHT;
+         ++row)
+    {
+        u64 cells = (rows[row] & BATCH_CELL_BITS) >> BATCH_COL_SHIFT;
+        board->words[row / REPLAY_ROWS_PER_WORD] |= cells << (row % REPLAY_ROWS_PER_WORD * WIDTH);
+    }
+}
+
+void replay_unpack_board(const Replay_Board *board, u16 *rows)
+{
+    for (int row = 0;
+         row < BATCH_ROWS;
+         ++row)
+    {
+        if (row >= HEIGHT)
+        {
+            rows[row] = BATCH_FULL_ROW;
+            continue;
+        }
+        u64 cells = (board->words[row / REPLAY_ROWS_PER_WORD] >> (row % REPLAY_ROWS_PER_WORD * WIDTH)) &
+                    ((1u << WIDTH) - 1);
+        rows[row] = (u16)(BATCH_WALL_ROW | cells << BATCH_COL_SHIFT);
+    }
+}
+
+u64 replay_hash_board(const Replay_Board *board)
+{
+    u64 hash = 0x9E3779B97F4A7C15ull;
+    for (int i = 0;
+         i < 4;
+         ++i)
+    {
+        hash ^= board->words[i];
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 33;
+        hash *= 0xC4CEB9FE1A85EC53ull;
+        hash ^= hash >> 33;
+    }
+    return hash;
+}
+
+const Replay_Board *replay_board(const Replay_Store *store, u32 id)
+{
+    return (const Replay_Board *)store->boards[id / REPLAY_SEGMENT_BOARDS].data + id % REPLAY_SEGMENT_BOARDS;
+}
+
+const Replay_Transition *replay_transition(const Replay_Store *store, u32 index)
+{
+    return (const Replay_Transition *)store->transitions[index / REPLAY_SEGMENT_TRANSITIONS].data +
+           index % REPLAY_SEGMENT_TRANSITIONS;
+}
+
+//Maps a whole segment, creating it at full size when it is new
+bool replay_map_segment(Replay_Store *store, Mapped_File *mapped, const char *kind, u32 segment, size_t size)
+{
+    char path[600];
+    snprintf(path, sizeof(path), "%s/%s_%04u.dat", store->directory, kind, segment);
+    if (!mapped_file_open(mapped, path, true))
+    {
+        return false;
+    }
+    if (mapped->size < size && !mapped_file_resize(mapped, size))
+    {
+        mapped_file_close(mapped);
+        return false;
+    }
+    return true;
+}
+
+//Finds the board's slot: the one holding it, or the empty one it would go in
+u64 *replay_find_board_slot(Replay_Store *store, const Replay_Board *board, u64 hash)
+{
+    u32 mask = store->board_slot_count - 1;
+    u64 tag = hash & 0xFFFFFFFF00000000ull;
+    for (u32 slot = (u32)hash & mask;
+         ;
+         slot = (slot + 1) & mask)
+    {
+        u64 *entry = store->board_slots + slot;
+        if (!*entry)
+        {
+            return entry;
+        }
+        if ((*entry & 0xFFFFFFFF00000000ull) == tag &&
+            memcmp(replay_board(store, (u32)*entry - 1), board, sizeof(Replay_Board)) == 0)
+        {
+            return entry;
+        }
+    }
+}
+
+//Keeps the table at most half full; only ever called with boards already stored
+void replay_insert_board_slot(Replay_Store *store, u32 id)
+{
+    if ((u64)(store->board_count + 1) * 2 > store->board_slot_count)
+    {
+        u64 *old_slots = store->board_slots;
+        u32 old_count = store->board_slot_count;
+        store->board_slot_count = old_count * 2;
+        store->board_slots = (u64 *)calloc(store->board_slot_count, sizeof(u64));
+        for (u32 slot = 0;
+             slot < old_count;
+             ++slot)
+        {
+            if (old_slots[slot])
+            {
+                const Replay_Board *board = replay_board(store, (u32)old_slots[slot] - 1);
+                *replay_find_board_slot(store, board, replay_hash_board(board)) = old_slots[slot];
+            }
+        }
+        free(old_slots);
+    }
+    const Replay_Board *board = replay_board(store, id);
+    u64 hash = replay_hash_board(board);
+    *replay_find_board_slot(store, board, hash) = (hash & 0xFFFFFFFF00000000ull) | (id + 1);
+}
+
+//The id of the board, stored now if it is new; false when the store is full
+bool replay_intern_board(Replay_Store *store, const u16 *rows, u32 *id)
+{
+    Replay_Board board;
+    replay_pack_board(rows, &board);
+    u64 *slot = replay_find_board_slot(store, &board, replay_hash_board(&board));
+    if (*slot)
+    {
+        *id = (u32)*slot - 1;
+        return true;
+    }
+
+    u32 new_id = store->board_count;
+    u32 segment = new_id / REPLAY_SEGMENT_BOARDS;
+    if (segment >= REPLAY_MAX_SEGMENTS)
+    {
+        return false;
+    }
+    if (!store->boards[segment].data &&
+        !replay_map_segment(store, store->boards + segment, "boards", segment,
+                            (size_t)REPLAY_SEGMENT_BOARDS * sizeof(Replay_Board)))
+    {
+        return false;
+    }
+    ((Replay_Board *)store->boards[segment].data)[new_id % REPLAY_SEGMENT_BOARDS] = board;
+    replay_insert_board_slot(store, new_id);
+    store->board_count = new_id + 1;
+    replay_header(store)->board_count = store->board_count;
+    *id = new_id;
+    return true;
+}
+
+//The exclusive side of priority_lock
+struct Replay_Priority_Write
+{
+    Replay_Store *store;
+
+    Replay_Priority_Write(Replay_Store *write_store)
+    {
+        store = write_store;
+        store->priority_writers.fetch_add(1, std::memory_order_acquire);
+        store->priority_lock.lock();
+    }
+
+    ~Replay_Priority_Write()
+    {
+        store->priority_lock.unlock();
+        store->priority_writers.fetch_sub(1, std::memory_order_release);
+    }
+};
+
+//Call with the priority lock held exclusively
+void replay_set_priority(Replay_Store *store, u32 index, float priority)
+{
+    Replay_Priorities *priorities = store->priorities + index / REPLAY_SEGMENT_TRANSITIONS;
+    if (!priorities->leaves)
+    {
+        priorities->leaves = (float *)calloc(REPLAY_SEGMENT_TRANSITIONS, sizeof(float));
+        priorities->tree = (double *)calloc(2 * REPLAY_SEGMENT_BLOCKS, sizeof(double));
+    }
+    u32 leaf = index % REPLAY_SEGMENT_TRANSITIONS;
+    priorities->leaves[leaf] = priority;
+    if (priority > store->max_priority)
+    {
+        store->max_priority = priority;
+    }
+
+    //Summed afresh rather than by difference, so rounding never builds up
+    u32 block = leaf / REPLAY_PRIORITY_BLOCK;
+    const float *leaves = priorities->leaves + block * REPLAY_PRIORITY_BLOCK;
+    double sum = 0;
+    for (int i = 0;
+         i < REPLAY_PRIORITY_BLOCK;
+         ++i)
+    {
+        sum += leaves[i];
+    }
+    u32 node = REPLAY_SEGMENT_BLOCKS + block;
+    priorities->tree[node] = sum;
+    for (node >>= 1;
+         node;
+         node >>= 1)
+    {
+        priorities->tree[node] = priorities->tree[node * 2] + priorities->tree[node * 2 + 1];
+    }
+}
+
+//Gives the first count transitions max_priority and builds each segment's tree once,
+//bottom up, for reopening a store without a per-transition tree walk
+void replay_fill_priorities(Replay_Store *store, u32 count)
+{
+    for (u32 first = 0;
+         first < count;
+         first += REPLAY_SEGMENT_TRANSITIONS)
+    {
+        Replay_Priorities *priorities = store->priorities + first / REPLAY_SEGMENT_TRANSITIONS;
+        if (!priorities->leaves)
+        {
+            priorities->leaves = (float *)calloc(REPLAY_SEGMENT_TRANSITIONS, sizeof(float));
+            priorities->tree = (double *)calloc(2 * REPLAY_SEGMENT_BLOCKS, sizeof(double));
+        }
+        u32 filled = count - first < REPLAY_SEGMENT_TRANSITIONS ? count - first : REPLAY_SEGMENT_TRANSITIONS;
+        for (u32 leaf = 0;
+             leaf < filled;
+             ++leaf)
+        {
+            priorities->leaves[leaf] = store->max_priority;
+        }
+        for (u32 block = 0;
+             block < REPLAY_SEGMENT_BLOCKS;
+             ++block)
+        {
+            const float *leaves = priorities->leaves + block * REPLAY_PRIORITY_BLOCK;
+            double sum = 0;
+            for (int i = 0;
+                 i < REPLAY_PRIORITY_BLOCK;
+                 ++i)
+            {
+                sum += leaves[i];
+            }
+            priorities->tree[REPLAY_SEGMENT_BLOCKS + block] = sum;
+        }
+        for (u32 node = REPLAY_SEGMENT_BLOCKS - 1;
+             node;
+             --node)
+        {
+            priorities->tree[node] = priorities->tree[node * 2] + priorities->tree[node * 2 + 1];
+        }
+    }
+}
+
+void replay_store_close(Replay_Store *store)
+{
+    if (!store)
+    {
+        return;
+    }
+    for (int segment = 0;
+         segment < REPLAY_MAX_SEGMENTS;
+         ++segment)
+    {
+        if (store->transitions[segment].data)
+        {
+            mapped_file_close(store->transitions + segment);
+        }
+        if (store->boards[segment].data)
+        {
+            mapped_file_close(store->boards + segment);
+        }
+        free(store->priorities[segment].leaves);
+        free(store->priorities[segment].tree);
+    }
+    if (store->header_file.data)
+    {
+        mapped_file_close(&store->header_file);
+    }
+    free(store->board_slots);
+    delete store;
+}
+
+//Creates the directory and an empty store when needed; null when it cannot be opened.
+//Without prioritized the priorities are never kept and only uniform sampling works.
+Replay_Store *replay_store_open(const char *directory, bool prioritized)
+{
+    Replay_Store *store = new Replay_Store();
+    snprintf(store->directory, sizeof(store->directory), "%s", directory);
+    store->prioritized = prioritized;
+    store->max_priority = 1.0f;
+    char path[600];
+    snprintf(path, sizeof(path), "%s/store.dat", directory);
+    if (!make_directory(directory) || !mapped_file_open(&store->header_file, path, true))
+    {
+        delete store;
+        return 0;
+    }
+    if (store->header_file.size == 0)
+    {
+        if (!mapped_file_resize(&store->header_file, sizeof(Replay_Store_Header)))
+        {
+            replay_store_close(store);
+            return 0;
+        }
+        Replay_Store_Header *header = replay_header(store);
+        header->magic = REPLAY_STORE_MAGIC;
+        header->version = REPLAY_STORE_VERSION;
+    }
+
+    Replay_Store_Header *header = replay_header(store);
+    if (store->header_file.size < sizeof(Replay_Store_Header) ||
+        header->magic != REPLAY_STORE_MAGIC || header->version != REPLAY_STORE_VERSION ||
+        header->board_count > (u64)REPLAY_MAX_SEGMENTS * REPLAY_SEGMENT_BOARDS ||
+        header->transition_count > (u64)REPLAY_MAX_SEGMENTS * REPLAY_SEGMENT_TRANSITIONS)
+    {
+        replay_store_close(store);
+        return 0;
+    }
+
+    u32 board_count = header->board_count;
+    u32 transition_count = header->transition_count;
+    for (u32 segment = 0;
+         segment * REPLAY_SEGMENT_BOARDS < board_count;
+         ++segment)
+    {
+        if (!replay_map_segment(store, store->boards + segment, "boards", segment,
+                                (size_t)REPLAY_SEGMENT_BOARDS * sizeof(Replay_Board)))
+        {
+            replay_store_close(store);
+            return 0;
+        }
+    }
+    for (u32 segment = 0;
+         segment * REPLAY_SEGMENT_TRANSITIONS < transition_count;
+         ++segment)
+    {
+        if (!replay_map_segment(store, store->transitions + segment, "transitions", segment,
+                                (size_t)REPLAY_SEGMENT_TRANSITIONS * sizeof(Replay_Transition)))
+        {
+            replay_store_close(store);
+            return 0;
+        }
+    }
+
+    //The hash is not saved, it is rebuilt from the boards
+    store->board_slot_count = REPLAY_INITIAL_BOARD_SLOTS;
+    store->board_slots = (u64 *)calloc(store->board_slot_count, sizeof(u64));
+    for (u32 id = 0;
+         id < board_count;
+         ++id)
+    {
+        replay_insert_board_slot(store, id);
+        store->board_count = id + 1;
+    }
+    if (prioritized)
+    {
+        replay_fill_priorities(store, transition_count);
+    }
+    store->transition_count.store(transition_count, std::memory_order_release);
+    return store;
+}
+
+//Boards go in before the transition and the count is published last; false when full
+bool replay_store_append(Replay_Store *store, const Replay_Step *step)
+{
+    u32 index = store->transition_count.load(std::memory_order_relaxed);
+    u32 segment = index / REPLAY_SEGMENT_TRANSITIONS;
+    if (segment >= REPLAY_MAX_SEGMENTS)
+    {
+        return false;
+    }
+    if (!store->transitions[segment].data &&
+        !replay_map_segment(store, store->transitions + segment, "transitions", segment,
+                            (size_t)REPLAY_SEGMENT_TRANSITIONS * sizeof(Replay_Transition)))
+    {
+        return false;
+    }
+
+    Replay_Transition transition;
+    if (!replay_intern_board(store, step->rows, &transition.board) ||
+        !replay_intern_board(store, step->next_rows, &transition.next_board))
+    {
+        return false;
+    }
+    transition.reward = step->reward;
+    transition.pieces = (u16)((step->hand & 7) |
+                              (step->next & 7) << 3 |
+                              (step->hold & 7) << 6 |
+                              (step->terminal ? REPLAY_FLAG_TERMINAL : 0) << 9);
+    transition.action = (u16)((step->rotation & 3) |
+                              (step->use_hold ? 1 : 0) << 2 |
+                              ((step->offset_row + REPLAY_OFFSET_BIAS) & 0x3F) << 3 |
+                              ((step->offset_col + REPLAY_OFFSET_BIAS) & 0x1F) << 9);
+    ((Replay_Transition *)store->transitions[segment].data)[index % REPLAY_SEGMENT_TRANSITIONS] = transition;
+
+    //A prioritized sampler must never see the leaf in the tree before the count covers it
+    if (store->prioritized)
+    {
+        Replay_Priority_Write write(store);
+        replay_set_priority(store, index, store->max_priority);
+        replay_header(store)->transition_count = index + 1;
+        store->transition_count.store(index + 1, std::memory_order_release);
+    }
+    else
+    {
+        replay_header(store)->transition_count = index + 1;
+        store->transition_count.store(index + 1, std::memory_order_release);
+    }
+    return true;
+}
+
+//False when the index is past the published count
+bool replay_store_get(const Replay_Store *store, u32 index, Replay_Step *step)
+{
+    if (index >= replay_store_count(store))
+    {
+        return false;
+    }
+    const Replay_Transition *transition = replay_transition(store, index);
+    replay_unpack_board(replay_board(store, transition->board), step->rows);
+    replay_unpack_board(replay_board(store, transition->next_board), step->next_rows);
+    step->hand = transition->pieces & 7;
+    step->next = (transition->pieces >> 3) & 7;
+    step->hold = (transition->pieces >> 6) & 7;
+    step->terminal = ((transition->pieces >> 9) & REPLAY_FLAG_TERMINAL) != 0;
+    step->rotation = transition->action & 3;
+    step->use_hold = (transition->action >> 2) & 1;
+    step->offset_row = (s8)(((transition->action >> 3) & 0x3F) - REPLAY_OFFSET_BIAS);
+    step->offset_col = (s8)(((transition->action >> 9) & 0x1F) - REPLAY_OFFSET_BIAS);
+    step->reward = transition->reward;
+    return true;
+}
+
+//Fills indices with count uniform picks and returns count, or 0 when the store is empty.
+//rng_state is the caller's, one per thread.
+int replay_sample_uniform(const Replay_Store *store, u32 *rng_state, u32 *indices, int count)
+{
+    u32 total = replay_store_count(store);
+    if (!total)
+    {
+        return 0;
+    }
+    for (int i = 0;
+         i < count;
+         ++i)
+    {
+        indices[i] = (u32)(((u64)random_next(rng_state) * total) >> 32);
+    }
+    return count;
+}
+
+//Picks count transitions in proportion to their priorities, one from each of count equal
+//slices of the total, and gives each pick's probability for importance weights.
+//Returns count, or 0 when the store is empty or not prioritized.
+int replay_sample_prioritized(Replay_Store *store, u32 *rng_state, u32 *indices, float *probabilities,
+                              int count)
+{
+    if (!store->prioritized)
+    {
+        return 0;
+    }
+    while (store->priority_writers.load(std::memory_order_relaxed))
+    {
+        std::this_thread::yield();
+    }
+    std::shared_lock<std::shared_mutex> lock(store->priority_lock);
+    u32 segment_count = (store->transition_count.load(std::memory_order_relaxed) +
+                         REPLAY_SEGMENT_TRANSITIONS - 1) / REPLAY_SEGMENT_TRANSITIONS;
+    double total = 0;
+    for (u32 segment = 0;
+         segment < segment_count;
+         ++segment)
+    {
+        total += store->priorities[segment].tree[1];
+    }
+    if (total <= 0)
+    {
+        return 0;
+    }
+
+    for (int i = 0;
+         i < count;
+         ++i)
+    {
+        double target = (i + (random_next(rng_state) >> 8) * (1.0 / 16777216.0)) * total / count;
+        u32 segment = 0;
+        while (segment + 1 < segment_count && target >= store->priorities[segment].tree[1])
+        {
+            target -= store->priorities[segment].tree[1];
+            ++segment;
+        }
+        const Replay_Priorities *priorities = store->priorities + segment;
+        u32 node = 1;
+        while (node < REPLAY_SEGMENT_BLOCKS)
+        {
+            double left = priorities->tree[node * 2];
+            if (target < left || priorities->tree[node * 2 + 1] <= 0)
+            {
+                node = node * 2;
+            }
+            else
+            {
+                target -= left;
+                node = node * 2 + 1;
+            }
+        }
+
+        //Rounding can leave the target just past the block, then its last live leaf is taken
+        u32 first = (node - REPLAY_SEGMENT_BLOCKS) * REPLAY_PRIORITY_BLOCK;
+        u32 picked = first;
+        for (u32 leaf = first;
+             leaf < first + REPLAY_PRIORITY_BLOCK;
+             ++leaf)
+        {
+            float priority = priorities->leaves[leaf];
+            if (priority > 0)
+            {
+                picked = leaf;
+                target -= priority;
+                if (target < 0)
+                {
+                    break;
+                }
+            }
+        }
+        indices[i] = segment * REPLAY_SEGMENT_TRANSITIONS + picked;
+        probabilities[i] = (float)(priorities->leaves[picked] / total);
+    }
+    return count;
+}
+
+//Priorities must be positive; indices past the count are skipped
+void replay_update_priorities(Replay_Store *store, const u32 *indices, const float *priorities, int count)
+{
+    if (!store->prioritized)
+    {
+        return;
+    }
+    Replay_Priority_Write write(store);
+    u32 total = store->transition_count.load(std::memory_order_relaxed);
+    for (int i = 0;
+         i < count;
+         ++i)
+    {
+        if (indices[i] < total && priorities[i] > 0)
+        {
+            replay_set_priority(store, indices[i], priorities[i]);
+        }
+    }
+}
+
+#endif
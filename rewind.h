@@ -0,0 +1,263 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+//Practice rewind: a packed snapshot at the start of every piece plus the buttons of every
+//tick, both in fixed rings, so a session of any length costs the same memory.
+//Scrubbing moves between snapshots and unpacks one, so it takes the same time however far
+//back it goes; only returning to the live tick replays the inputs since the last snapshot.
+//The game is frozen while scrubbing and the first press plays on from the shown piece,
+//dropping the snapshots after it.
+
+#define REWIND_SNAPSHOT_COUNT 2048
+//About 18 minutes at 60 Hz, only the stretch since the newest snapshot has to survive
+#define REWIND_INPUT_COUNT (1 << 16)
+
+//Everything a piece start needs: line clears are over by then, the piece has just
+//spawned, and next and hold only ever carry a tetromino
+struct Rewind_Snapshot
+{
+    //Two cells a byte
+    u8 cells[WIDTH * HEIGHT / 2];
+    u8 piece;
+    u8 piece_rotation;
+    s8 piece_row;
+    s8 piece_col;
+    u8 next;
+    u8 hold;
+    u8 hold_place;
+    u8 pause;
+    u8 bag;
+    u8 lock_frames;
+    s32 start_level;
+    s32 level;
+    s32 line_count;
+    s32 points;
+    float next_drop_time;
+    u32 rng_state;
+    u32 frame;
+    u32 piece_count;
+    u16 prev_buttons;
+    //Inputs recorded before this snapshot
+    u64 input_index;
+};
+
+struct Rewind_Buffer
+{
+    Rewind_Snapshot snapshots[REWIND_SNAPSHOT_COUNT];
+    u16 inputs[REWIND_INPUT_COUNT];
+
+    //Snapshots first to count - 1 are kept, snapshot n lives in slot n % REWIND_SNAPSHOT_COUNT
+    u32 first;
+    u32 count;
+    u64 input_count;
+    u32 last_piece_count;
+
+    bool scrubbing;
+    //Snapshot shown while scrubbing, count when it is the live tick
+    u32 cursor;
+};
+
+void rewind_reset(Rewind_Buffer *rewind)
+{
+    rewind->first = 0;
+    rewind->count = 0;
+    rewind->input_count = 0;
+    rewind->last_piece_count = 0;
+    rewind->scrubbing = false;
+    rewind->cursor = 0;
+}
+
+Rewind_Snapshot *rewind_snapshot(Rewind_Buffer *rewind, u32 index)
+{
+    return rewind->snapshots + index % REWIND_SNAPSHOT_COUNT;
+}
+
+void rewind_pack(const Game_State *game, Rewind_Snapshot *snapshot)
+{
+    for (int i = 0;
+         i < WIDTH * HEIGHT / 2;
+         ++i)
+    {
+        snapshot->cells[i] = (u8)(game->board[i * 2] | game->board[i * 2 + 1] << 4);
+    }
+    snapshot->piece = game->piece.tetromino_index;
+    snapshot->piece_rotation = (u8)game->piece.rotation;
+    snapshot->piece_row = (s8)game->piece.offset_row;
+    snapshot->piece_col = (s8)game->piece.offset_col;
+    snapshot->next = game->nextPiece.tetromino_index;
+    snapshot->hold = game->holdPiece.tetromino_index;
+    snapshot->hold_place = (u8)game->holdPlace;
+    snapshot->pause = game->pause;
+    snapshot->bag = game->bag;
+    snapshot->lock_frames = game->lock_frames;
+    snapshot->start_level = game->start_level;
+    snapshot->level = game->level;
+    snapshot->line_count = game->line_count;
+    snapshot->points = game->points;
+    snapshot->next_drop_time = game->next_drop_time;
+    snapshot->rng_state = game->rng_state;
+    snapshot->frame = game->frame;
+    snapshot->piece_count = game->piece_count;
+}
+
+//Leaves muted and rules alone, they are settings rather than part of the game
+void rewind_unpack(const Rewind_Snapshot *snapshot, Game_State *game)
+{
+    for (int i = 0;
+         i < WIDTH * HEIGHT / 2;
+         ++i)
+    {
+        game->board[i * 2] = snapshot->cells[i] & 0xF;
+        game->board[i * 2 + 1] = snapshot->cells[i] >> 4;
+    }
+    memset(game->lines, 0, sizeof(game->lines));
+    game->pending_line_count = 0;
+    game->holdPlace = snapshot->hold_place != 0;
+    game->piece = {};
+    game->piece.tetromino_index = snapshot->piece;
+    game->piece.rotation = snapshot->piece_rotation;
+    game->piece.offset_row = snapshot->piece_row;
+    game->piece.offset_col = snapshot->piece_col;
+    game->nextPiece = {};
+    game->nextPiece.tetromino_index = snapshot->next;
+    game->holdPiece = {};
+    game->holdPiece.tetromino_index = snapshot->hold;
+    game->phase = GAME_PHASE_PLAY;
+    game->start_level = snapshot->start_level;
+    game->level = snapshot->level;
+    game->line_count = snapshot->line_count;
+    game->points = snapshot->points;
+    game->pause = snapshot->pause;
+    game->bag = snapshot->bag;
+    game->lock_frames = snapshot->lock_frames;
+    game->next_drop_time = snapshot->next_drop_time;
+    game->highlight_end_time = 0;
+    game->rng_state = snapshot->rng_state;
+    game->frame = snapshot->frame;
+    game->time = game->frame * TARGET_SECONDS_PER_FRAME;
+    game->sounds = 0;
+    game->piece_count = snapshot->piece_count;
+}
+
+//Call after every step_game with the buttons it was given; a new game starts a new history
+void rewind_record(Rewind_Buffer *rewind, const Game_State *game, u16 buttons)
+{
+    if (game->phase == GAME_PHASE_START)
+    {
+        if (rewind->count || rewind->input_count)
+        {
+            rewind_reset(rewind);
+        }
+        return;
+    }
+
+    rewind->inputs[rewind->input_count++ % REWIND_INPUT_COUNT] = buttons;
+    //A piece that cleared lines spawns before the clear ends, take it once play resumes
+    if (game->phase != GAME_PHASE_PLAY || game->piece_count == rewind->last_piece_count)
+    {
+        return;
+    }
+    rewind->last_piece_count = game->piece_count;
+    if (rewind->count - rewind->first == REWIND_SNAPSHOT_COUNT)
+    {
+        ++rewind->first;
+    }
+    Rewind_Snapshot *snapshot = rewind_snapshot(rewind, rewind->count++);
+    rewind_pack(game, snapshot);
+    snapshot->prev_buttons = buttons;
+    snapshot->input_index = rewind->input_count;
+}
+
+//Goes back to the start of the piece in play, or of the one before when it has just spawned
+bool rewind_back(Rewind_Buffer *rewind, Game_State *game)
+{
+    if (rewind->count == rewind->first)
+    {
+        return false;
+    }
+    u32 target;
+    if (!rewind->scrubbing)
+    {
+        target = rewind->count - 1;
+        if (rewind_snapshot(rewind, target)->input_index == rewind->input_count)
+        {
+            if (target == rewind->first)
+            {
+                return false;
+            }
+            --target;
+        }
+    }
+    else
+    {
+        if (rewind->cursor == rewind->first)
+        {
+            return false;
+        }
+        target = rewind->cursor - 1;
+    }
+    rewind->scrubbing = true;
+    rewind->cursor = target;
+    rewind_unpack(rewind_snapshot(rewind, target), game);
+    return true;
+}
+
+//Steps toward the live tick again; false when already there or when its inputs are gone
+bool rewind_forward(Rewind_Buffer *rewind, Game_State *game)
+{
+    if (!rewind->scrubbing || rewind->cursor == rewind->count)
+    {
+        return false;
+    }
+    if (rewind->cursor + 1 < rewind->count)
+    {
+        rewind_unpack(rewind_snapshot(rewind, ++rewind->cursor), game);
+        return true;
+    }
+
+    //Nothing is recorded while scrubbing, so the inputs after the newest snapshot lead to the live tick
+    const Rewind_Snapshot *snapshot = rewind_snapshot(rewind, rewind->cursor);
+    if (rewind->input_count - snapshot->input_index > REWIND_INPUT_COUNT)
+    {
+        return false;
+    }
+    rewind_unpack(snapshot, game);
+    TELEMETRY_MUTE(true);
+    u16 prev_buttons = snapshot->prev_buttons;
+    for (u64 index = snapshot->input_index;
+         index < rewind->input_count;
+         ++index)
+    {
+        u16 buttons = rewind->inputs[index % REWIND_INPUT_COUNT];
+        Input_State input = unpack_input(buttons, prev_buttons);
+        step_game(game, &input);
+        prev_buttons = buttons;
+    }
+    TELEMETRY_MUTE(false);
+    game->sounds = 0;
+    rewind->cursor = rewind->count;
+    return true;
+}
+
+//Plays on from the shown tick. prev_buttons are what is held now; returns the buttons the
+//next step has to take as the previous ones, so the recorded inputs replay exactly.
+u16 rewind_resume(Rewind_Buffer *rewind, u16 prev_buttons)
+{
+    if (!rewind->scrubbing)
+    {
+        return prev_buttons;
+    }
+    rewind->scrubbing = false;
+    if (rewind->cursor == rewind->count)
+    {
+        return rewind->input_count ? rewind->inputs[(rewind->input_count - 1) % REWIND_INPUT_COUNT] : prev_buttons;
+    }
+    Rewind_Snapshot *snapshot = rewind_snapshot(rewind, rewind->cursor);
+    snapshot->prev_buttons = prev_buttons;
+    rewind->count = rewind->cursor + 1;
+    rewind->input_count = snapshot->input_index;
+    rewind->last_piece_count = snapshot->piece_count;
+    return prev_buttons;
+}
+
+#endif
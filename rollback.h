@@ -0,0 +1,152 @@
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+//Rollback netplay for two boards: the remote input is predicted as a repeat
+//of its last confirmed input, and a late mismatch restores the snapshot taken
+//before that frame and re-simulates up to the present with sounds suppressed.
+
+#define ROLLBACK_RING_SIZE 32
+#define ROLLBACK_MAX_PREDICTION 8
+#define ROLLBACK_NONE 0xFFFFFFFF
+
+struct Rollback_Session
+{
+    Game_State games[2];
+
+    //State of both boards before simulating frame n lives in slot n % ROLLBACK_RING_SIZE
+    Game_State snapshots[ROLLBACK_RING_SIZE][2];
+    u16 inputs[ROLLBACK_RING_SIZE][2];
+
+    int local_player;
+    u32 frame;
+    u32 confirmed_frame;
+    u32 rollback_frame;
+    u16 last_remote_buttons;
+
+    u32 rollback_count;
+    u32 resimulated_frames;
+};
+
+void rollback_start(Rollback_Session *session, int local_player, u32 seed)
+{
+    *session = {};
+    session->local_player = local_player;
+    session->rollback_frame = ROLLBACK_NONE;
+    seed_game(&session->games[0], seed);
+    seed_game(&session->games[1], seed);
+}
+
+int rollback_remote_player(const Rollback_Session *session)
+{
+    return 1 - session->local_player;
+}
+
+u16 rollback_get_input(const Rollback_Session *session, u32 frame, int player)
+{
+    return session->inputs[frame % ROLLBACK_RING_SIZE][player];
+}
+
+void rollback_simulate_frame(Rollback_Session *session, u32 frame)
+{
+    Game_State *snapshot = session->snapshots[frame % ROLLBACK_RING_SIZE];
+    snapshot[0] = session->games[0];
+    snapshot[1] = session->games[1];
+
+    for (int player = 0;
+         player < 2;
+         ++player)
+    {
+        u16 buttons = rollback_get_input(session, frame, player);
+        u16 prev_buttons = frame ? rollback_get_input(session, frame - 1, player) : 0;
+        Input_State input = unpack_input(buttons, prev_buttons);
+        step_game(&session->games[player], &input);
+    }
+}
+
+//Restores the first mispredicted frame and replays to the present silently
+void rollback_resimulate(Rollback_Session *session)
+{
+    if (session->rollback_frame == ROLLBACK_NONE)
+    {
+        return;
+    }
+
+    u32 from = session->rollback_frame;
+    assert(session->frame - from <= ROLLBACK_MAX_PREDICTION);
+    const Game_State *snapshot = session->snapshots[from % ROLLBACK_RING_SIZE];
+    session->games[0] = snapshot[0];
+    session->games[1] = snapshot[1];
+
+    //These frames were counted when they were first predicted
+    TELEMETRY_MUTE(true);
+    for (u32 frame = from;
+         frame < session->frame;
+         ++frame)
+    {
+        rollback_simulate_frame(session, frame);
+    }
+    TELEMETRY_MUTE(false);
+    session->games[0].sounds = 0;
+    session->games[1].sounds = 0;
+
+    ++session->rollback_count;
+    session->resimulated_frames += session->frame - from;
+    session->rollback_frame = ROLLBACK_NONE;
+}
+
+//False while the remote player lags too far behind to keep predicting
+bool rollback_can_advance(const Rollback_Session *session)
+{
+    return session->frame - session->confirmed_frame < ROLLBACK_MAX_PREDICTION;
+}
+
+//Simulates the next frame with the local input and a predicted remote input
+void rollback_advance(Rollback_Session *session, u16 local_buttons)
+{
+    assert(rollback_can_advance(session));
+    rollback_resimulate(session);
+
+    u16 *inputs = session->inputs[session->frame % ROLLBACK_RING_SIZE];
+    inputs[session->local_player] = local_buttons;
+    if (session->frame >= session->confirmed_frame)
+    {
+        inputs[rollback_remote_player(session)] = session->last_remote_buttons;
+    }
+
+    rollback_simulate_frame(session, session->frame);
+    ++session->frame;
+}
+
+//Remote inputs must arrive in frame order; returns false for one that has to be resent
+bool rollback_add_remote_input(Rollback_Session *session, u32 frame, u16 buttons)
+{
+    if (frame != session->confirmed_frame ||
+        frame >= session->frame + ROLLBACK_RING_SIZE - ROLLBACK_MAX_PREDICTION - 1)
+    {
+        return false;
+    }
+
+    int remote = rollback_remote_player(session);
+    u16 *inputs = session->inputs[frame % ROLLBACK_RING_SIZE];
+    if (frame < session->frame &&
+        inputs[remote] != buttons &&
+        session->rollback_frame == ROLLBACK_NONE)
+    {
+        session->rollback_frame = frame;
+    }
+    inputs[remote] = buttons;
+
+    //Later frames were predicted from an older input, repredict them from this one
+    for (u32 later = frame + 1;
+         later < session->frame;
+         ++later)
+    {
+        session->inputs[later % ROLLBACK_RING_SIZE][remote] = buttons;
+    }
+
+    session->confirmed_frame = frame + 1;
+    session->last_remote_buttons = buttons;
+    return true;
+}
+
+#endif
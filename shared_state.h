@@ -0,0 +1,275 @@
+#ifndef SHARED_STATE_H
+#define SHARED_STATE_H
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+//Live game state published to other processes through a named shared memory segment.
+//The game writes a snapshot every tick under a sequence lock: the sequence is odd while
+//a write is under way, and a reader retries whenever it was odd or changed during its copy.
+//The writer never waits for readers and readers never block it, so any number of
+//overlays can poll at no cost to the game.
+//
+//Only fixed-width fields, so readers built with other compilers agree on the layout.
+//Fields are only ever appended; version goes up when they are.
+
+#define SHARED_STATE_MAGIC 0x54535453
+#define SHARED_STATE_VERSION 1
+#ifdef _WIN32
+#define SHARED_STATE_NAME "Local\\tetris_state"
+#else
+#define SHARED_STATE_NAME "/tetris_state"
+#endif
+
+struct Shared_Piece
+{
+    u8 tetromino;
+    u8 rotation;
+    s8 offset_row;
+    s8 offset_col;
+};
+
+struct Shared_State_Data
+{
+    u8 board[WIDTH * HEIGHT];
+    Shared_Piece piece;
+    Shared_Piece next;
+    Shared_Piece hold;
+    u8 phase;
+    u8 paused;
+    u8 muted;
+    u8 reserved;
+    s32 start_level;
+    s32 level;
+    s32 line_count;
+    s32 points;
+    u32 frame;
+    u32 piece_count;
+};
+
+struct Shared_State_Segment
+{
+    u32 magic;
+    u32 version;
+    u32 data_size;
+    u32 width;
+    u32 height;
+    alignas(64) std::atomic<u32> sequence;
+    alignas(64) Shared_State_Data data;
+};
+
+struct Shared_State
+{
+    Shared_State_Segment *segment;
+    const char *name;
+    bool writer;
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+};
+
+Shared_Piece shared_piece(const Piece_State *piece)
+{
+    Shared_Piece result;
+    result.tetromino = piece->tetromino_index;
+    result.rotation = (u8)piece->rotation;
+    result.offset_row = (s8)piece->offset_row;
+    result.offset_col = (s8)piece->offset_col;
+    return result;
+}
+
+//Null when the segment cannot be created; the game then just doesn't publish
+Shared_State *shared_state_create(const char *name)
+{
+    Shared_State_Segment *segment;
+#ifdef _WIN32
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, 0, PAGE_READWRITE, 0,
+                                        sizeof(Shared_State_Segment), name);
+    if (!mapping)
+    {
+        return 0;
+    }
+    segment = (Shared_State_Segment *)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0,
+                                                    sizeof(Shared_State_Segment));
+    if (!segment)
+    {
+        CloseHandle(mapping);
+        return 0;
+    }
+#else
+    int file = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (file < 0)
+    {
+        return 0;
+    }
+    if (ftruncate(file, sizeof(Shared_State_Segment)) != 0)
+    {
+        close(file);
+        return 0;
+    }
+    void *data = mmap(0, sizeof(Shared_State_Segment), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    close(file);
+    if (data == MAP_FAILED)
+    {
+        return 0;
+    }
+    segment = (Shared_State_Segment *)data;
+#endif
+
+    //The magic goes in last, so readers never take a half-initialized segment for a valid one
+    segment->magic = 0;
+    segment->version = SHARED_STATE_VERSION;
+    segment->data_size = sizeof(Shared_State_Data);
+    segment->width = WIDTH;
+    segment->height = HEIGHT;
+    segment->sequence.store(0, std::memory_order_relaxed);
+    memset(&segment->data, 0, sizeof(segment->data));
+    std::atomic_thread_fence(std::memory_order_release);
+    segment->magic = SHARED_STATE_MAGIC;
+
+    Shared_State *shared = new Shared_State();
+    shared->segment = segment;
+    shared->name = name;
+    shared->writer = true;
+#ifdef _WIN32
+    shared->mapping = mapping;
+#endif
+    return shared;
+}
+
+//The writer also removes the name, so readers can tell the game is gone
+void shared_state_close(Shared_State *shared)
+{
+    if (!shared)
+    {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(shared->segment);
+    CloseHandle(shared->mapping);
+#else
+    munmap(shared->segment, sizeof(Shared_State_Segment));
+    if (shared->writer)
+    {
+        shm_unlink(shared->name);
+    }
+#endif
+    delete shared;
+}
+
+//Null when no game is publishing under that name, or it publishes another version
+Shared_State *shared_state_open(const char *name)
+{
+    Shared_State_Segment *segment;
+#ifdef _WIN32
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    if (!mapping)
+    {
+        return 0;
+    }
+    segment = (Shared_State_Segment *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0,
+                                                    sizeof(Shared_State_Segment));
+    if (!segment)
+    {
+        CloseHandle(mapping);
+        return 0;
+    }
+#else
+    int file = shm_open(name, O_RDONLY, 0);
+    if (file < 0)
+    {
+        return 0;
+    }
+    void *data = mmap(0, sizeof(Shared_State_Segment), PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if (data == MAP_FAILED)
+    {
+        return 0;
+    }
+    segment = (Shared_State_Segment *)data;
+#endif
+
+    Shared_State *shared = new Shared_State();
+    shared->segment = segment;
+    shared->name = name;
+    shared->writer = false;
+#ifdef _WIN32
+    shared->mapping = mapping;
+#endif
+    if (segment->magic != SHARED_STATE_MAGIC || segment->version != SHARED_STATE_VERSION ||
+        segment->data_size != sizeof(Shared_State_Data))
+    {
+        shared_state_close(shared);
+        return 0;
+    }
+    return shared;
+}
+
+void shared_state_publish(Shared_State *shared, const Game_State *game)
+{
+    Shared_State_Segment *segment = shared->segment;
+    u32 sequence = segment->sequence.load(std::memory_order_relaxed);
+    segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Shared_State_Data *data = &segment->data;
+    memcpy(data->board, game->board, sizeof(data->board));
+    data->piece = shared_piece(&game->piece);
+    data->next = shared_piece(&game->nextPiece);
+    data->hold = shared_piece(&game->holdPiece);
+    data->phase = (u8)game->phase;
+    data->paused = (u8)(game->pause != 0);
+    data->muted = (u8)game->muted;
+    data->start_level = game->start_level;
+    data->level = game->level;
+    data->line_count = game->line_count;
+    data->points = game->points;
+    data->frame = game->frame;
+    data->piece_count = game->piece_count;
+
+    segment->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+//Copies a consistent snapshot; false only if the writer kept it busy for every attempt.
+//The sequence number tells a poller whether anything changed since its last read.
+bool shared_state_read(const Shared_State *shared, Shared_State_Data *data, u32 *sequence_out = 0)
+{
+    const Shared_State_Segment *segment = shared->segment;
+    for (int attempt = 0;
+         attempt < 1000;
+         ++attempt)
+    {
+        u32 before = segment->sequence.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            //The writer may have been switched out mid-write, let it finish
+            std::this_thread::yield();
+            continue;
+        }
+        memcpy(data, (const void *)&segment->data, sizeof(*data));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        u32 after = segment->sequence.load(std::memory_order_relaxed);
+        if (before == after)
+        {
+            if (sequence_out)
+            {
+                *sequence_out = before;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
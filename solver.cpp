@@ -0,0 +1,237 @@
+//Solves a set of perfect clear or pattern puzzles and prints the placements for each.
+//Build: g++ -O2 solver.cpp -o solver -pthread
+//Usage: solver puzzles.txt [--budget ms] [--height n] [--threads n] [--table bits]
+//One puzzle per line: board queue [hold [pattern]]
+//  board    rows from the top down, separated by '/', '.' empty and anything else filled,
+//           or '-' for an empty board; the last row given is the bottom of the well
+//  queue    piece letters IOTSZJL, the first one is the piece in hand
+//  hold     the held piece, or '-'
+//  pattern  rows like the board, '?' for cells that don't matter; without one the
+//           goal is a perfect clear
+//e.g. XXXXXX..../XXXXXX.... OOI -
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+
+#include "game.h"
+#include "solver.h"
+
+u8 parse_piece(char letter)
+{
+    const char *found = strchr(SOLVER_PIECE_LETTERS + 1, letter);
+    return found && letter ? (u8)(found - SOLVER_PIECE_LETTERS) : 0;
+}
+
+//Fills rows bottom-aligned; care is only written for patterns
+bool parse_rows(const char *text, u16 *rows, u16 *care)
+{
+    if (strcmp(text, "-") == 0)
+    {
+        return true;
+    }
+    int row_count = 1;
+    for (const char *c = text;
+         *c;
+         ++c)
+    {
+        row_count += *c == '/';
+    }
+    if (row_count > HEIGHT)
+    {
+        return false;
+    }
+
+    int row = HEIGHT - row_count;
+    int col = 0;
+    for (const char *c = text;
+         ;
+         ++c)
+    {
+        if (*c == '/' || *c == 0)
+        {
+            if (col != WIDTH)
+            {
+                return false;
+            }
+            if (*c == 0)
+            {
+                return true;
+            }
+            ++row;
+            col = 0;
+            continue;
+        }
+        if (col == WIDTH)
+        {
+            return false;
+        }
+        u16 bit = (u16)(1 << (col + BATCH_COL_SHIFT));
+        if (*c != '.' && *c != '?')
+        {
+            rows[row] |= bit;
+        }
+        if (care && *c != '?')
+        {
+            care[row] |= bit;
+        }
+        ++col;
+    }
+}
+
+bool parse_puzzle(char *line, Solver_Problem *problem)
+{
+    *problem = {};
+    for (int row = 0;
+         row < BATCH_ROWS;
+         ++row)
+    {
+        problem->rows[row] = row < HEIGHT ? BATCH_WALL_ROW : BATCH_FULL_ROW;
+    }
+
+    char *fields[4] = {};
+    int field_count = 0;
+    for (char *token = strtok(line, " \t\r\n");
+         token && field_count < 4;
+         token = strtok(0, " \t\r\n"))
+    {
+        fields[field_count++] = token;
+    }
+    if (field_count < 2 || !parse_rows(fields[0], problem->rows, 0))
+    {
+        return false;
+    }
+
+    const char *queue = fields[1];
+    int length = (int)strlen(queue);
+    if (length < 1 || length > SOLVER_MAX_QUEUE + 1)
+    {
+        return false;
+    }
+    for (int i = 0;
+         i < length;
+         ++i)
+    {
+        u8 piece = parse_piece(queue[i]);
+        if (!piece)
+        {
+            return false;
+        }
+        if (i == 0)
+        {
+            problem->hand = piece;
+        }
+        else
+        {
+            problem->queue[problem->queue_count++] = piece;
+        }
+    }
+
+    if (field_count > 2 && strcmp(fields[2], "-") != 0)
+    {
+        problem->hold = parse_piece(fields[2][0]);
+        if (!problem->hold || fields[2][1])
+        {
+            return false;
+        }
+    }
+
+    problem->perfect_clear = field_count < 4;
+    if (!problem->perfect_clear)
+    {
+        return parse_rows(fields[3], problem->pattern_filled, problem->pattern_care);
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: solver puzzles.txt [--budget ms] [--height n] [--threads n] [--table bits]\n");
+        return 1;
+    }
+
+    Solver_Config config = solver_default_config();
+    for (int i = 2;
+         i + 1 < argc;
+         i += 2)
+    {
+        if (strcmp(argv[i], "--budget") == 0)
+        {
+            config.time_budget_ms = (float)atof(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "--height") == 0)
+        {
+            config.max_height = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0)
+        {
+            config.threads = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "--table") == 0)
+        {
+            config.table_bits = max(10, min(atoi(argv[i + 1]), 32));
+        }
+        else
+        {
+            fprintf(stderr, "bad option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    FILE *file = fopen(argv[1], "r");
+    if (!file)
+    {
+        fprintf(stderr, "could not open %s\n", argv[1]);
+        return 1;
+    }
+
+    Solver *solver = solver_create(&config);
+    const char *RESULT_NAMES[] = { "found", "none", "timeout" };
+    int counts[3] = {};
+    auto begin = std::chrono::steady_clock::now();
+    char line[1024];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        ++line_number;
+        if (line[0] == '#' || line[strspn(line, " \t\r\n")] == 0)
+        {
+            continue;
+        }
+        Solver_Problem problem;
+        if (!parse_puzzle(line, &problem))
+        {
+            printf("%d: bad puzzle\n", line_number);
+            continue;
+        }
+
+        Solver_Solution solution;
+        auto start = std::chrono::steady_clock::now();
+        Solver_Result result = solver_solve(solver, &problem, &solution);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        ++counts[result];
+
+        //Each move: piece, H when it came through hold, rotation and where it rests
+        printf("%d: %s in %.2f ms, %llu nodes", line_number, RESULT_NAMES[result], ms,
+               (unsigned long long)solution.nodes);
+        for (int i = 0;
+             i < solution.move_count;
+             ++i)
+        {
+            const Bot_Move *move = solution.moves + i;
+            printf("%s %c%s r%d %d,%d", i ? "," : ":", SOLVER_PIECE_LETTERS[move->tetromino],
+                   move->use_hold ? "H" : "", move->rotation, move->offset_row, move->offset_col);
+        }
+        printf("\n");
+    }
+    fclose(file);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    printf("%d found, %d none, %d timed out in %.2f s\n", counts[SOLVER_FOUND], counts[SOLVER_NONE],
+           counts[SOLVER_TIMEOUT], seconds);
+    solver_destroy(solver);
+    return 0;
+}
@@ -0,0 +1,633 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#include "bot.h"
+
+//Decides whether a perfect clear, or a board matching a target pattern, can be built
+//from a known queue, and returns the placements that do it.
+//Placements are the bot's hard drops, so every solution can be played with bot_apply_move.
+//
+//The search is a depth-first one, split into subtrees that the thread pool works on
+//at once. States already visited by any worker are skipped through a lock-free table
+//of board fingerprints; different orders that build the same board are only searched once.
+//Perfect clears are searched one target height at a time, lowest first, and a state is
+//dropped as soon as a piece sticks out above the target or an empty region of the
+//target rows stops being a multiple of four cells.
+
+#define SOLVER_MAX_QUEUE 16
+#define SOLVER_MAX_MOVES (SOLVER_MAX_QUEUE + 2)
+#define SOLVER_MAX_PC_HEIGHT 6
+#define SOLVER_MAX_FRONTIER (1 << 15)
+#define SOLVER_PROBE_LIMIT 16
+
+//Pieces by shape, in TETROMINOS order
+const char SOLVER_PIECE_LETTERS[] = " IOTSZJL";
+
+enum Solver_Result
+{
+    SOLVER_FOUND,
+    SOLVER_NONE,
+    SOLVER_TIMEOUT
+};
+
+struct Solver_Config
+{
+    //Tallest perfect clear tried, or the tallest stack allowed while building a pattern
+    int max_height;
+    float time_budget_ms;
+    int threads;
+    //The visited table has 1 << table_bits slots of eight bytes
+    int table_bits;
+};
+
+Solver_Config solver_default_config()
+{
+    Solver_Config config = {};
+    config.max_height = 4;
+    config.time_budget_ms = 1000.0f;
+    config.threads = 0;
+    config.table_bits = 22;
+    return config;
+}
+
+//Rows use the bitboard layout of batch_engine.h. The first piece is the one in hand;
+//a pattern is reached when every cell in pattern_care matches pattern_filled.
+struct Solver_Problem
+{
+    u16 rows[BATCH_ROWS];
+    u8 hand;
+    u8 hold;
+    u8 queue[SOLVER_MAX_QUEUE];
+    int queue_count;
+
+    bool perfect_clear;
+    u16 pattern_filled[BATCH_ROWS];
+    u16 pattern_care[BATCH_ROWS];
+};
+
+struct Solver_Solution
+{
+    Solver_Result result;
+    int move_count;
+    Bot_Move moves[SOLVER_MAX_MOVES];
+    u64 nodes;
+};
+
+struct Solver_State
+{
+    u16 rows[BATCH_ROWS];
+    u8 hand;
+    u8 hold;
+    u8 queue_used;
+    //Rows still to clear for a perfect clear
+    u8 height;
+    u8 move_count;
+    Bot_Move moves[SOLVER_MAX_MOVES];
+};
+
+//One way to take the next piece: from hand, from hold, or from the queue into an empty hold
+struct Solver_Option
+{
+    u8 tetromino;
+    u8 hand;
+    u8 hold;
+    u8 queue_used;
+    bool use_hold;
+};
+
+struct Solver
+{
+    Solver_Config config;
+    Thread_Pool *pool;
+
+    //Fingerprints with the search epoch in the low byte; slots of older epochs count as empty
+    std::atomic<u64> *table;
+    u64 table_mask;
+    u8 epoch;
+
+    const Solver_Problem *problem;
+    int pattern_top;
+    std::chrono::steady_clock::time_point deadline;
+    std::atomic<bool> done;
+    std::atomic<bool> out_of_time;
+    std::atomic<u64> nodes;
+
+    std::mutex solution_mutex;
+    Solver_Solution *solution;
+
+    Solver_State *frontier;
+    int frontier_count;
+    Solver_State *next_frontier;
+};
+
+u64 solver_mix(u64 x)
+{
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDull;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+//A false match would only hide one branch, at odds of about one in 2^56 per pair of states
+u64 solver_fingerprint(const Solver_State *state)
+{
+    u64 hash = solver_mix((u64)state->hand | (u64)state->hold << 8 |
+                          (u64)state->queue_used << 16 | (u64)state->height << 24);
+    for (int row = 0;
+         row < HEIGHT;
+         row += 4)
+    {
+        u64 word = 0;
+        for (int i = 0;
+             i < 4 && row + i < HEIGHT;
+             ++i)
+        {
+            word |= (u64)state->rows[row + i] << (i * 16);
+        }
+        hash = solver_mix(hash ^ word);
+    }
+    return hash;
+}
+
+//True when the state was not seen before in this search, and marks it seen
+bool solver_visit(Solver *solver, const Solver_State *state)
+{
+    u64 fingerprint = solver_fingerprint(state);
+    u64 entry = (fingerprint & ~0xFFull) | solver->epoch;
+    u64 slot = fingerprint >> 8;
+    for (int probe = 0;
+         probe < SOLVER_PROBE_LIMIT;
+         ++probe)
+    {
+        std::atomic<u64> *cell = solver->table + ((slot + probe) & solver->table_mask);
+        u64 seen = cell->load(std::memory_order_relaxed);
+        for (;;)
+        {
+            if (seen == entry)
+            {
+                return false;
+            }
+            if ((u8)seen == solver->epoch)
+            {
+                break;
+            }
+            if (cell->compare_exchange_weak(seen, entry, std::memory_order_relaxed))
+            {
+                return true;
+            }
+        }
+    }
+    //A full neighbourhood only costs repeated work, never a wrong answer
+    return true;
+}
+
+int solver_pieces_left(const Solver *solver, const Solver_State *state)
+{
+    return (state->hand ? 1 : 0) + (state->hold ? 1 : 0) +
+           solver->problem->queue_count - min((int)state->queue_used, solver->problem->queue_count);
+}
+
+int solver_options(const Solver *solver, const Solver_State *state, Solver_Option *options)
+{
+    const Solver_Problem *problem = solver->problem;
+    int q = state->queue_used;
+    u8 upcoming = q < problem->queue_count ? problem->queue[q] : 0;
+    u8 after = q + 1 < problem->queue_count ? problem->queue[q + 1] : 0;
+    int count = 0;
+    if (!state->hand)
+    {
+        return 0;
+    }
+    options[count++] = { state->hand, upcoming, state->hold, (u8)min(q + 1, problem->queue_count), false };
+    if (state->hold && state->hold != state->hand)
+    {
+        options[count++] = { state->hold, upcoming, state->hand, (u8)min(q + 1, problem->queue_count), true };
+    }
+    if (!state->hold && upcoming)
+    {
+        options[count++] = { upcoming, after, state->hand, (u8)min(q + 2, problem->queue_count), true };
+    }
+    return count;
+}
+
+//Cells of the lowest height rows, ten bits per row
+u64 solver_pack_rows(const u16 *rows, int height)
+{
+    u64 packed = 0;
+    for (int i = 0;
+         i < height;
+         ++i)
+    {
+        u64 cells = (rows[HEIGHT - height + i] & BATCH_CELL_BITS) >> BATCH_COL_SHIFT;
+        packed |= cells << (i * WIDTH);
+    }
+    return packed;
+}
+
+//Every separate empty region has to be filled by whole pieces
+bool solver_regions_fillable(u64 packed, int height)
+{
+    const u64 region = (1ull << (height * WIDTH)) - 1;
+    u64 first_col = 0;
+    for (int i = 0;
+         i < height;
+         ++i)
+    {
+        first_col |= 1ull << (i * WIDTH);
+    }
+    const u64 last_col = first_col << (WIDTH - 1);
+
+    u64 empty = ~packed & region;
+    while (empty)
+    {
+        u64 fill = empty & (0 - empty);
+        u64 prev;
+        do
+        {
+            prev = fill;
+            fill |= ((fill << 1) & ~first_col) | ((fill >> 1) & ~last_col) |
+                    (fill << WIDTH) | (fill >> WIDTH);
+            fill &= empty;
+        } while (fill != prev);
+
+        if (__builtin_popcountll(fill) % 4)
+        {
+            return false;
+        }
+        empty &= ~fill;
+    }
+    return true;
+}
+
+bool solver_reached(const Solver *solver, const Solver_State *state)
+{
+    const Solver_Problem *problem = solver->problem;
+    if (problem->perfect_clear)
+    {
+        return state->rows[HEIGHT - 1] == BATCH_WALL_ROW;
+    }
+    for (int row = 0;
+         row < HEIGHT;
+         ++row)
+    {
+        if ((state->rows[row] & problem->pattern_care[row]) != problem->pattern_filled[row])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//False when the state cannot reach the goal any more
+bool solver_viable(const Solver *solver, const Solver_State *state)
+{
+    const Solver_Problem *problem = solver->problem;
+    int pieces = solver_pieces_left(solver, state);
+    if (problem->perfect_clear)
+    {
+        for (int row = 0;
+             row < HEIGHT - state->height;
+             ++row)
+        {
+            if (state->rows[row] & BATCH_CELL_BITS)
+            {
+                return false;
+            }
+        }
+        u64 packed = solver_pack_rows(state->rows, state->height);
+        int missing = state->height * WIDTH - __builtin_popcountll(packed);
+        return missing <= pieces * 4 && solver_regions_fillable(packed, state->height);
+    }
+
+    int missing = 0;
+    for (int row = 0;
+         row < HEIGHT;
+         ++row)
+    {
+        if (row < HEIGHT - solver->pattern_top && (state->rows[row] & BATCH_CELL_BITS))
+        {
+            return false;
+        }
+        missing += __builtin_popcount(problem->pattern_filled[row] & ~state->rows[row]);
+    }
+    return missing <= pieces * 4;
+}
+
+//Places a piece; false when the child is pruned. Sets reached when it is a solution.
+bool solver_child(Solver *solver, const Solver_State *state, const Solver_Option *option,
+                  const Bot_Placement *placement, Solver_State *child, bool *reached)
+{
+    memcpy(child->rows, state->rows, sizeof(child->rows));
+    int lines = bot_place(child->rows, option->tetromino, placement);
+    if (lines < 0)
+    {
+        return false;
+    }
+    child->hand = option->hand;
+    child->hold = option->hold;
+    child->queue_used = option->queue_used;
+    child->height = (u8)(state->height - (solver->problem->perfect_clear ? lines : 0));
+    child->move_count = (u8)(state->move_count + 1);
+    memcpy(child->moves, state->moves, state->move_count * sizeof(Bot_Move));
+    Bot_Move *move = child->moves + state->move_count;
+    move->use_hold = option->use_hold;
+    move->tetromino = option->tetromino;
+    move->rotation = placement->rotation;
+    move->offset_row = placement->offset_row;
+    move->offset_col = placement->offset_col;
+
+    *reached = solver_reached(solver, child);
+    if (*reached)
+    {
+        return true;
+    }
+    return solver_viable(solver, child) && solver_visit(solver, child);
+}
+
+//The first solution found wins; the others stop at their next node
+void solver_publish(Solver *solver, const Solver_State *state)
+{
+    std::lock_guard<std::mutex> lock(solver->solution_mutex);
+    if (solver->done.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    solver->solution->result = SOLVER_FOUND;
+    solver->solution->move_count = state->move_count;
+    memcpy(solver->solution->moves, state->moves, state->move_count * sizeof(Bot_Move));
+    solver->done.store(true, std::memory_order_relaxed);
+}
+
+bool solver_should_stop(Solver *solver, u64 *nodes)
+{
+    if (solver->done.load(std::memory_order_relaxed))
+    {
+        return true;
+    }
+    if ((++*nodes & 255) == 0 && std::chrono::steady_clock::now() > solver->deadline)
+    {
+        solver->out_of_time.store(true, std::memory_order_relaxed);
+        solver->done.store(true, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+//Lower placements first; they close rows sooner and leave fewer overhangs
+void solver_sort_placements(Bot_Placement *placements, int count)
+{
+    std::sort(placements, placements + count, [](const Bot_Placement &a, const Bot_Placement &b)
+    {
+        return a.offset_row > b.offset_row;
+    });
+}
+
+void solver_search(Solver *solver, const Solver_State *state, u64 *nodes)
+{
+    if (solver_should_stop(solver, nodes))
+    {
+        return;
+    }
+
+    Solver_Option options[3];
+    int option_count = solver_options(solver, state, options);
+    for (int o = 0;
+         o < option_count;
+         ++o)
+    {
+        Bot_Placement placements[BOT_MAX_PLACEMENTS];
+        int count = bot_generate_placements(state->rows, options[o].tetromino, placements);
+        solver_sort_placements(placements, count);
+        for (int i = 0;
+             i < count;
+             ++i)
+        {
+            Solver_State child;
+            bool reached;
+            if (!solver_child(solver, state, options + o, placements + i, &child, &reached))
+            {
+                continue;
+            }
+            if (reached)
+            {
+                solver_publish(solver, &child);
+                return;
+            }
+            solver_search(solver, &child, nodes);
+            if (solver->done.load(std::memory_order_relaxed))
+            {
+                return;
+            }
+        }
+    }
+}
+
+void solver_search_task(void *data, int task, int worker)
+{
+    Solver *solver = (Solver *)data;
+    u64 nodes = 0;
+    solver_search(solver, solver->frontier + task, &nodes);
+    solver->nodes.fetch_add(nodes, std::memory_order_relaxed);
+}
+
+//Breadth-first until there are enough subtrees to keep every worker busy.
+//A level is only expanded when all of it is sure to fit, since its children are
+//marked visited as they are made. False when a solution turned up on the way or
+//nothing is left to search.
+bool solver_expand_frontier(Solver *solver)
+{
+    int wanted = solver->pool->worker_count * 8;
+    while (solver->frontier_count > 0 && solver->frontier_count < wanted &&
+           solver->frontier_count * 3 * BOT_MAX_PLACEMENTS <= SOLVER_MAX_FRONTIER)
+    {
+        int next_count = 0;
+        for (int s = 0;
+             s < solver->frontier_count;
+             ++s)
+        {
+            const Solver_State *state = solver->frontier + s;
+            Solver_Option options[3];
+            int option_count = solver_options(solver, state, options);
+            for (int o = 0;
+                 o < option_count;
+                 ++o)
+            {
+                Bot_Placement placements[BOT_MAX_PLACEMENTS];
+                int count = bot_generate_placements(state->rows, options[o].tetromino, placements);
+                solver_sort_placements(placements, count);
+                for (int i = 0;
+                     i < count;
+                     ++i)
+                {
+                    Solver_State *child = solver->next_frontier + next_count;
+                    bool reached;
+                    if (!solver_child(solver, state, options + o, placements + i, child, &reached))
+                    {
+                        continue;
+                    }
+                    if (reached)
+                    {
+                        solver_publish(solver, child);
+                        return false;
+                    }
+                    ++next_count;
+                }
+            }
+        }
+        std::swap(solver->frontier, solver->next_frontier);
+        solver->frontier_count = next_count;
+        solver->nodes.fetch_add(next_count, std::memory_order_relaxed);
+    }
+    return solver->frontier_count > 0;
+}
+
+Solver *solver_create(const Solver_Config *config)
+{
+    batch_init_piece_masks();
+
+    Solver *solver = new Solver();
+    solver->config = *config;
+    solver->pool = thread_pool_create(config->threads);
+    u64 table_size = 1ull << config->table_bits;
+    solver->table = new std::atomic<u64>[table_size];
+    for (u64 i = 0;
+         i < table_size;
+         ++i)
+    {
+        solver->table[i].store(0, std::memory_order_relaxed);
+    }
+    solver->table_mask = table_size - 1;
+    solver->epoch = 0;
+    solver->frontier = new Solver_State[SOLVER_MAX_FRONTIER];
+    solver->next_frontier = new Solver_State[SOLVER_MAX_FRONTIER];
+    return solver;
+}
+
+void solver_destroy(Solver *solver)
+{
+    thread_pool_destroy(solver->pool);
+    delete[] solver->table;
+    delete[] solver->frontier;
+    delete[] solver->next_frontier;
+    delete solver;
+}
+
+//Starts a fresh epoch so the table needs no clearing between searches
+void solver_next_epoch(Solver *solver)
+{
+    if (++solver->epoch == 0)
+    {
+        for (u64 i = 0;
+             i <= solver->table_mask;
+             ++i)
+        {
+            solver->table[i].store(0, std::memory_order_relaxed);
+        }
+        solver->epoch = 1;
+    }
+}
+
+//One complete search for a given perfect clear height, or for the pattern
+void solver_run(Solver *solver, int height)
+{
+    const Solver_Problem *problem = solver->problem;
+    solver_next_epoch(solver);
+
+    Solver_State *root = solver->frontier;
+    memcpy(root->rows, problem->rows, sizeof(root->rows));
+    root->hand = problem->hand;
+    root->hold = problem->hold;
+    root->queue_used = 0;
+    root->height = (u8)height;
+    root->move_count = 0;
+    solver->frontier_count = solver_viable(solver, root) ? 1 : 0;
+
+    if (solver_expand_frontier(solver))
+    {
+        thread_pool_run(solver->pool, solver->frontier_count, solver_search_task, solver);
+    }
+}
+
+Solver_Result solver_solve(Solver *solver, const Solver_Problem *problem, Solver_Solution *solution)
+{
+    auto start = std::chrono::steady_clock::now();
+    solver->deadline = start + std::chrono::microseconds((s64)(solver->config.time_budget_ms * 1000));
+    solver->problem = problem;
+    solver->solution = solution;
+    solver->done.store(false, std::memory_order_relaxed);
+    solver->out_of_time.store(false, std::memory_order_relaxed);
+    solver->nodes.store(0, std::memory_order_relaxed);
+    *solution = {};
+    solution->result = SOLVER_NONE;
+
+    if (problem->perfect_clear)
+    {
+        //Only heights whose empty cells come to whole pieces can be cleared
+        int filled = 0;
+        int stack = 0;
+        for (int row = 0;
+             row < HEIGHT;
+             ++row)
+        {
+            int cells = __builtin_popcount(problem->rows[row] & BATCH_CELL_BITS);
+            filled += cells;
+            if (cells && !stack)
+            {
+                stack = HEIGHT - row;
+            }
+        }
+        int max_height = min(solver->config.max_height, SOLVER_MAX_PC_HEIGHT);
+        for (int height = max(stack, 1);
+             height <= max_height && !solver->done.load(std::memory_order_relaxed);
+             ++height)
+        {
+            int missing = height * WIDTH - filled;
+            if (missing > 0 && missing % 4 == 0)
+            {
+                solver_run(solver, height);
+            }
+        }
+    }
+    else
+    {
+        int top = 0;
+        for (int row = 0;
+             row < HEIGHT;
+             ++row)
+        {
+            if (problem->pattern_care[row] && !top)
+            {
+                top = HEIGHT - row;
+            }
+        }
+        solver->pattern_top = max(top, solver->config.max_height);
+        solver_run(solver, HEIGHT);
+    }
+
+    if (solution->result != SOLVER_FOUND && solver->out_of_time.load(std::memory_order_relaxed))
+    {
+        solution->result = SOLVER_TIMEOUT;
+    }
+    solution->nodes = solver->nodes.load(std::memory_order_relaxed);
+    return solution->result;
+}
+
+//The live game only knows the piece in play, the next one and the held one
+void solver_problem_from_game(const Game_State *game, Solver_Problem *problem)
+{
+    *problem = {};
+    bot_rows_from_board(problem->rows, game->board);
+    problem->hand = game->piece.tetromino_index;
+    problem->hold = game->holdPlace ? game->holdPiece.tetromino_index : 0;
+    problem->queue[0] = game->nextPiece.tetromino_index;
+    problem->queue_count = problem->queue[0] ? 1 : 0;
+    problem->perfect_clear = true;
+}
+
+#endif
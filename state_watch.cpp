@@ -0,0 +1,83 @@
+//Follows the live state a running game publishes through shared_state.h, as an example reader.
+//Build: g++ -O2 state_watch.cpp -o state_watch   (add -lrt on older glibc)
+//Usage: state_watch [--board] [--interval ms]
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+
+#include "game.h"
+#include "shared_state.h"
+
+void print_board(const Shared_State_Data *data)
+{
+    for (int row = HEIGHT - VISIBLE_HEIGHT;
+         row < HEIGHT;
+         ++row)
+    {
+        char line[WIDTH + 1];
+        for (int col = 0;
+             col < WIDTH;
+             ++col)
+        {
+            u8 value = data->board[row * WIDTH + col];
+            line[col] = value ? (char)('0' + value) : '.';
+        }
+        line[WIDTH] = 0;
+        printf("%s\n", line);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool board = false;
+    int interval_ms = 100;
+    for (int i = 1;
+         i < argc;
+         ++i)
+    {
+        if (strcmp(argv[i], "--board") == 0)
+        {
+            board = true;
+        }
+        else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc)
+        {
+            interval_ms = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: state_watch [--board] [--interval ms]\n");
+            return 1;
+        }
+    }
+
+    Shared_State *shared = shared_state_open(SHARED_STATE_NAME);
+    if (!shared)
+    {
+        fprintf(stderr, "no game is running\n");
+        return 1;
+    }
+
+    const char *PHASE_NAMES[] = { "start", "play", "line", "game over" };
+    u32 last_sequence = 1;
+    for (;;)
+    {
+        Shared_State_Data data;
+        u32 sequence;
+        if (shared_state_read(shared, &data, &sequence) && sequence != last_sequence)
+        {
+            last_sequence = sequence;
+            printf("frame %u %s level %d lines %d points %d piece %d next %d hold %d%s\n",
+                   data.frame, PHASE_NAMES[data.phase & 3], data.level, data.line_count,
+                   data.points, data.piece.tetromino, data.next.tetromino, data.hold.tetromino,
+                   data.paused ? " paused" : "");
+            if (board)
+            {
+                print_board(&data);
+            }
+            fflush(stdout);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+    }
+}
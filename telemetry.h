@@ -0,0 +1,352 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+//Gameplay statistics fed by hooks in the engine, compiled in with TETRIS_TELEMETRY.
+//Every thread counts into its own cache-line aligned block; only that thread writes it,
+//so updates are plain relaxed stores with no locked instructions. A writer thread sums
+//all blocks now and then and appends the totals to a columnar file.
+//
+//File layout: "TTEL", u32 version, u32 column count, then the zero-terminated column
+//names. After that come blocks of u32 row count followed by each column's u64 values
+//for those rows in turn. Values are running totals, so any two rows give a rate.
+
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_LEVELS 30
+#define TELEMETRY_MAX_PIECE_INPUTS 16
+#define TELEMETRY_BLOCK_ROWS 64
+
+enum Telemetry_Counter
+{
+    TELEMETRY_GAMES,
+    TELEMETRY_PIECES,
+    TELEMETRY_INPUTS,
+    TELEMETRY_LINES,
+    TELEMETRY_PLAY_US,
+    //Spawns of each tetromino
+    TELEMETRY_PIECE_TYPE,
+    //Clears of one to four lines at once
+    TELEMETRY_CLEAR = TELEMETRY_PIECE_TYPE + 7,
+    //Play time spent on each level, the last one counts everything above
+    TELEMETRY_LEVEL_US = TELEMETRY_CLEAR + 4,
+    //Presses made for each piece, the last one counts everything above
+    TELEMETRY_PIECE_INPUTS = TELEMETRY_LEVEL_US + TELEMETRY_LEVELS,
+    //Highest stack of each finished game
+    TELEMETRY_MAX_STACK = TELEMETRY_PIECE_INPUTS + TELEMETRY_MAX_PIECE_INPUTS,
+    TELEMETRY_COUNTER_COUNT = TELEMETRY_MAX_STACK + HEIGHT + 1
+};
+
+struct alignas(64) Telemetry_Block
+{
+    std::atomic<u64> counters[TELEMETRY_COUNTER_COUNT];
+    Telemetry_Block *next;
+};
+
+//Blocks are pushed once per thread and never freed, so counts of finished threads remain
+std::atomic<Telemetry_Block *> telemetry_blocks;
+thread_local Telemetry_Block *telemetry_thread_block;
+thread_local bool telemetry_muted;
+
+Telemetry_Block *telemetry_block()
+{
+    Telemetry_Block *block = telemetry_thread_block;
+    if (!block)
+    {
+        block = new Telemetry_Block();
+        for (int i = 0;
+             i < TELEMETRY_COUNTER_COUNT;
+             ++i)
+        {
+            block->counters[i].store(0, std::memory_order_relaxed);
+        }
+        block->next = telemetry_blocks.load(std::memory_order_relaxed);
+        while (!telemetry_blocks.compare_exchange_weak(block->next, block,
+                                                       std::memory_order_release,
+                                                       std::memory_order_relaxed));
+        telemetry_thread_block = block;
+    }
+    return block;
+}
+
+void telemetry_add(Telemetry_Block *block, int counter, u64 value)
+{
+    std::atomic<u64> *slot = block->counters + counter;
+    slot->store(slot->load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+u64 telemetry_microseconds(float seconds)
+{
+    return seconds > 0 ? (u64)(seconds * 1000000.0f) : 0;
+}
+
+//Charges the time since the last spawn to the level being played
+void telemetry_account_time(Telemetry_Block *block, Game_State *game)
+{
+    u64 elapsed = telemetry_microseconds(game->time - game->telemetry_time);
+    game->telemetry_time = game->time;
+    telemetry_add(block, TELEMETRY_PLAY_US, elapsed);
+    int level = game->level < TELEMETRY_LEVELS ? game->level : TELEMETRY_LEVELS - 1;
+    telemetry_add(block, TELEMETRY_LEVEL_US + level, elapsed);
+}
+
+void telemetry_spawn(Game_State *game, bool start)
+{
+    if (telemetry_muted)
+    {
+        return;
+    }
+    Telemetry_Block *block = telemetry_block();
+    if (start)
+    {
+        game->telemetry_time = game->time;
+        game->max_stack_height = 0;
+    }
+    else
+    {
+        telemetry_account_time(block, game);
+        int inputs = game->piece_inputs < TELEMETRY_MAX_PIECE_INPUTS ?
+                     game->piece_inputs : TELEMETRY_MAX_PIECE_INPUTS - 1;
+        telemetry_add(block, TELEMETRY_PIECE_INPUTS + inputs, 1);
+    }
+    game->piece_inputs = 0;
+    telemetry_add(block, TELEMETRY_PIECES, 1);
+    telemetry_add(block, TELEMETRY_PIECE_TYPE + game->piece.tetromino_index - 1, 1);
+}
+
+//The stack only grows when a piece locks, so its top cell gives the new height
+void telemetry_merge(Game_State *game)
+{
+    const Tetromino *tetromino = TETROMINOS + game->piece.tetromino_index;
+    for (int row = 0;
+         row < tetromino->side;
+         ++row)
+    {
+        for (int col = 0;
+             col < tetromino->side;
+             ++col)
+        {
+            if (tetromino_rotate(tetromino, row, col, game->piece.rotation))
+            {
+                int height = HEIGHT - (game->piece.offset_row + row);
+                if (height > game->max_stack_height)
+                {
+                    game->max_stack_height = (u8)height;
+                }
+                return;
+            }
+        }
+    }
+}
+
+void telemetry_line(const Game_State *game)
+{
+    if (telemetry_muted || game->pending_line_count <= 0)
+    {
+        return;
+    }
+    Telemetry_Block *block = telemetry_block();
+    telemetry_add(block, TELEMETRY_LINES, game->pending_line_count);
+    int lines = game->pending_line_count < 4 ? game->pending_line_count : 4;
+    telemetry_add(block, TELEMETRY_CLEAR + lines - 1, 1);
+}
+
+void telemetry_input(Game_State *game, const Input_State *input)
+{
+    if (game->pause)
+    {
+        return;
+    }
+    int presses = (input->dleft > 0) + (input->dright > 0) + (input->dup > 0) +
+                  (input->ddown > 0) + (input->dspace > 0) + (input->dg > 0) + (input->dh > 0);
+    if (presses && !telemetry_muted)
+    {
+        game->piece_inputs += (u16)presses;
+        telemetry_add(telemetry_block(), TELEMETRY_INPUTS, presses);
+    }
+}
+
+void telemetry_game_over(Game_State *game)
+{
+    if (telemetry_muted)
+    {
+        return;
+    }
+    Telemetry_Block *block = telemetry_block();
+    telemetry_account_time(block, game);
+    telemetry_add(block, TELEMETRY_GAMES, 1);
+    telemetry_add(block, TELEMETRY_MAX_STACK + game->max_stack_height, 1);
+}
+
+//Sums every thread's block; counts still being written may be a moment behind
+void telemetry_snapshot(u64 *totals)
+{
+    memset(totals, 0, TELEMETRY_COUNTER_COUNT * sizeof(u64));
+    for (Telemetry_Block *block = telemetry_blocks.load(std::memory_order_acquire);
+         block;
+         block = block->next)
+    {
+        for (int i = 0;
+             i < TELEMETRY_COUNTER_COUNT;
+             ++i)
+        {
+            totals[i] += block->counters[i].load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void telemetry_column_name(int counter, char *name, int size)
+{
+    if (counter >= TELEMETRY_MAX_STACK)
+    {
+        snprintf(name, size, "max_stack_%d", counter - TELEMETRY_MAX_STACK);
+    }
+    else if (counter >= TELEMETRY_PIECE_INPUTS)
+    {
+        snprintf(name, size, "piece_inputs_%d", counter - TELEMETRY_PIECE_INPUTS);
+    }
+    else if (counter >= TELEMETRY_LEVEL_US)
+    {
+        snprintf(name, size, "level_us_%d", counter - TELEMETRY_LEVEL_US);
+    }
+    else if (counter >= TELEMETRY_CLEAR)
+    {
+        snprintf(name, size, "clear_%d", counter - TELEMETRY_CLEAR + 1);
+    }
+    else if (counter >= TELEMETRY_PIECE_TYPE)
+    {
+        snprintf(name, size, "piece_%d", counter - TELEMETRY_PIECE_TYPE + 1);
+    }
+    else
+    {
+        const char *names[] = { "games", "pieces", "inputs", "lines", "play_us" };
+        snprintf(name, size, "%s", names[counter]);
+    }
+}
+
+//Column 0 is the time of the snapshot, the counters follow in enum order
+#define TELEMETRY_COLUMN_COUNT (TELEMETRY_COUNTER_COUNT + 1)
+
+struct Telemetry_Writer
+{
+    FILE *file;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool quit;
+    int interval_ms;
+    std::chrono::steady_clock::time_point start;
+
+    int row_count;
+    u64 rows[TELEMETRY_COLUMN_COUNT][TELEMETRY_BLOCK_ROWS];
+};
+
+void telemetry_write_block(Telemetry_Writer *writer)
+{
+    if (writer->row_count == 0)
+    {
+        return;
+    }
+    u32 row_count = (u32)writer->row_count;
+    fwrite(&row_count, sizeof(row_count), 1, writer->file);
+    for (int column = 0;
+         column < TELEMETRY_COLUMN_COUNT;
+         ++column)
+    {
+        fwrite(writer->rows[column], sizeof(u64), row_count, writer->file);
+    }
+    fflush(writer->file);
+    writer->row_count = 0;
+}
+
+void telemetry_sample(Telemetry_Writer *writer)
+{
+    u64 totals[TELEMETRY_COUNTER_COUNT];
+    telemetry_snapshot(totals);
+    int row = writer->row_count++;
+    writer->rows[0][row] = (u64)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - writer->start).count();
+    for (int i = 0;
+         i < TELEMETRY_COUNTER_COUNT;
+         ++i)
+    {
+        writer->rows[i + 1][row] = totals[i];
+    }
+    if (writer->row_count == TELEMETRY_BLOCK_ROWS)
+    {
+        telemetry_write_block(writer);
+    }
+}
+
+void telemetry_writer_thread(Telemetry_Writer *writer)
+{
+    std::unique_lock<std::mutex> lock(writer->mutex);
+    while (!writer->quit)
+    {
+        writer->wake.wait_for(lock, std::chrono::milliseconds(writer->interval_ms));
+        telemetry_sample(writer);
+    }
+    telemetry_write_block(writer);
+}
+
+//Null when the file cannot be created
+Telemetry_Writer *telemetry_start(const char *path, int interval_ms)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        return 0;
+    }
+
+    u32 header[3] = { 0x4C455454, TELEMETRY_VERSION, TELEMETRY_COLUMN_COUNT };
+    fwrite(header, sizeof(header), 1, file);
+    fwrite("time_ms", 8, 1, file);
+    for (int i = 0;
+         i < TELEMETRY_COUNTER_COUNT;
+         ++i)
+    {
+        char name[32];
+        telemetry_column_name(i, name, sizeof(name));
+        fwrite(name, strlen(name) + 1, 1, file);
+    }
+
+    Telemetry_Writer *writer = new Telemetry_Writer();
+    writer->file = file;
+    writer->quit = false;
+    writer->interval_ms = interval_ms;
+    writer->start = std::chrono::steady_clock::now();
+    writer->row_count = 0;
+    writer->thread = std::thread(telemetry_writer_thread, writer);
+    return writer;
+}
+
+//Takes a last sample so the file ends with the final totals
+void telemetry_stop(Telemetry_Writer *writer)
+{
+    if (!writer)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(writer->mutex);
+        writer->quit = true;
+    }
+    writer->wake.notify_one();
+    writer->thread.join();
+    fclose(writer->file);
+    delete writer;
+}
+
+#define TELEMETRY_SPAWN(game, start) telemetry_spawn(game, start)
+#define TELEMETRY_MERGE(game) telemetry_merge(game)
+#define TELEMETRY_LINE(game) telemetry_line(game)
+#define TELEMETRY_INPUT(game, input) telemetry_input(game, input)
+#define TELEMETRY_GAME_OVER(game) telemetry_game_over(game)
+#define TELEMETRY_MUTE(muted) (telemetry_muted = (muted))
+
+#endif
@@ -0,0 +1,140 @@
+//Prints the latest totals of a telemetry file written by telemetry.h, plus the rates they give.
+//Build: g++ -O2 telemetry_dump.cpp -o telemetry_dump
+//Usage: telemetry_dump telemetry.bin [--csv]  (--csv prints every row of every column)
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <string>
+
+#include "game.h"
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: telemetry_dump file [--csv]\n");
+        return 1;
+    }
+    bool csv = argc > 2 && strcmp(argv[2], "--csv") == 0;
+
+    FILE *file = fopen(argv[1], "rb");
+    if (!file)
+    {
+        fprintf(stderr, "could not open %s\n", argv[1]);
+        return 1;
+    }
+
+    u32 header[3];
+    if (fread(header, sizeof(header), 1, file) != 1 || header[0] != 0x4C455454)
+    {
+        fprintf(stderr, "%s is not a telemetry file\n", argv[1]);
+        return 1;
+    }
+    int column_count = (int)header[2];
+    std::vector<std::string> names(column_count);
+    for (int column = 0;
+         column < column_count;
+         ++column)
+    {
+        int c;
+        while ((c = fgetc(file)) > 0)
+        {
+            names[column] += (char)c;
+        }
+    }
+
+    //Blocks are column-major, rows are put back together here
+    std::vector<std::vector<u64>> rows;
+    u32 row_count;
+    while (fread(&row_count, sizeof(row_count), 1, file) == 1)
+    {
+        size_t first = rows.size();
+        rows.resize(first + row_count, std::vector<u64>(column_count));
+        for (int column = 0;
+             column < column_count;
+             ++column)
+        {
+            for (u32 row = 0;
+                 row < row_count;
+                 ++row)
+            {
+                if (fread(&rows[first + row][column], sizeof(u64), 1, file) != 1)
+                {
+                    rows.resize(first + row);
+                    break;
+                }
+            }
+        }
+    }
+    fclose(file);
+    if (rows.empty())
+    {
+        fprintf(stderr, "no samples yet\n");
+        return 1;
+    }
+
+    if (csv)
+    {
+        for (int column = 0;
+             column < column_count;
+             ++column)
+        {
+            printf("%s%s", names[column].c_str(), column + 1 < column_count ? "," : "\n");
+        }
+        for (const std::vector<u64> &row : rows)
+        {
+            for (int column = 0;
+                 column < column_count;
+                 ++column)
+            {
+                printf("%llu%s", (unsigned long long)row[column], column + 1 < column_count ? "," : "\n");
+            }
+        }
+        return 0;
+    }
+
+    const std::vector<u64> &last = rows.back();
+    auto value = [&](const char *name) -> u64
+    {
+        for (int column = 0;
+             column < column_count;
+             ++column)
+        {
+            if (names[column] == name)
+            {
+                return last[column];
+            }
+        }
+        return 0;
+    };
+
+    u64 pieces = value("pieces");
+    double play_seconds = value("play_us") / 1e6;
+    printf("%llu games, %llu pieces, %llu lines over %.1f s of play\n",
+           (unsigned long long)value("games"), (unsigned long long)pieces,
+           (unsigned long long)value("lines"), play_seconds);
+    printf("pieces per second: %.2f\n", play_seconds > 0 ? pieces / play_seconds : 0);
+    printf("inputs per piece: %.2f\n", pieces ? (double)value("inputs") / pieces : 0);
+
+    //Histogram columns share a prefix, print the non-empty buckets of each
+    const char *groups[] = { "piece_", "clear_", "level_us_", "piece_inputs_", "max_stack_" };
+    for (const char *group : groups)
+    {
+        printf("%s:", group);
+        size_t length = strlen(group);
+        for (int column = 0;
+             column < column_count;
+             ++column)
+        {
+            const std::string &name = names[column];
+            bool digit = name.size() > length && name[length] >= '0' && name[length] <= '9';
+            if (name.compare(0, length, group) == 0 && digit && last[column])
+            {
+                printf(" %s=%llu", name.c_str() + length, (unsigned long long)last[column]);
+            }
+        }
+        printf("\n");
+    }
+    return 0;
+}
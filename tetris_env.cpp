@@ -0,0 +1,146 @@
+//Shared library exposing the batch engine through the C interface in tetris_env.h.
+//Build: g++ -O2 -mavx2 -shared -fPIC tetris_env.cpp -o libtetris_env.so
+
+#include <cstdlib>
+
+#include "game.h"
+#include "batch_engine.h"
+#include "tetris_env.h"
+
+struct Tetris_Env
+{
+    Batch_Engine *batch;
+    int start_level;
+    s32 *last_points;
+    Tetris_Env_Buffers buffers;
+};
+
+//Cells of every possible 10-bit row, so a board row expands with one copy
+u8 ENV_ROW_CELLS[1 << WIDTH][WIDTH];
+
+void env_init_row_cells()
+{
+    for (int bits = 0;
+         bits < (1 << WIDTH);
+         ++bits)
+    {
+        for (int col = 0;
+             col < WIDTH;
+             ++col)
+        {
+            ENV_ROW_CELLS[bits][col] = (bits >> col) & 1;
+        }
+    }
+}
+
+void env_write_observation(Tetris_Env *env, int index, float reward)
+{
+    Batch_Engine *batch = env->batch;
+    const Tetris_Env_Buffers *buffers = &env->buffers;
+    const u16 *rows = batch_lane_rows(batch, index);
+
+    if (buffers->board)
+    {
+        u8 *board = buffers->board + index * WIDTH * HEIGHT;
+        for (int row = 0;
+             row < HEIGHT;
+             ++row)
+        {
+            u16 bits = (rows[row] & BATCH_CELL_BITS) >> BATCH_COL_SHIFT;
+            memcpy(board + row * WIDTH, ENV_ROW_CELLS[bits], WIDTH);
+        }
+    }
+    if (buffers->board_rows)
+    {
+        u16 *board_rows = buffers->board_rows + index * HEIGHT;
+        for (int row = 0;
+             row < HEIGHT;
+             ++row)
+        {
+            board_rows[row] = (rows[row] & BATCH_CELL_BITS) >> BATCH_COL_SHIFT;
+        }
+    }
+    if (buffers->pieces)
+    {
+        u8 *pieces = buffers->pieces + index * 3;
+        pieces[0] = batch->tetromino[index];
+        pieces[1] = batch->next_tetromino[index];
+        pieces[2] = batch->hold_tetromino[index];
+    }
+    if (buffers->counters)
+    {
+        s32 *counters = buffers->counters + index * TETRIS_ENV_COUNTER_COUNT;
+        counters[TETRIS_ENV_LEVEL] = batch->level[index];
+        counters[TETRIS_ENV_LINES] = batch->line_count[index];
+        counters[TETRIS_ENV_POINTS] = batch->points[index];
+        counters[TETRIS_ENV_FRAME] = (s32)batch->frame[index];
+        counters[TETRIS_ENV_PIECE_ROW] = batch->offset_row[index];
+        counters[TETRIS_ENV_PIECE_COL] = batch->offset_col[index];
+        counters[TETRIS_ENV_PIECE_ROTATION] = batch->rotation[index];
+        counters[TETRIS_ENV_PHASE] = batch->phase[index];
+    }
+    if (buffers->reward)
+    {
+        buffers->reward[index] = reward;
+    }
+    if (buffers->done)
+    {
+        buffers->done[index] = batch->phase[index] == GAME_PHASE_GAMEOVER;
+    }
+}
+
+extern "C" Tetris_Env *tetris_env_create(int env_count, int start_level)
+{
+    env_init_row_cells();
+
+    Tetris_Env *env = (Tetris_Env *)calloc(1, sizeof(Tetris_Env));
+    env->batch = batch_create(env_count);
+    env->start_level = start_level;
+    env->last_points = (s32 *)calloc(env_count, sizeof(s32));
+    return env;
+}
+
+extern "C" void tetris_env_destroy(Tetris_Env *env)
+{
+    batch_destroy(env->batch);
+    free(env->last_points);
+    free(env);
+}
+
+extern "C" void tetris_env_bind(Tetris_Env *env, const Tetris_Env_Buffers *buffers)
+{
+    env->buffers = *buffers;
+}
+
+extern "C" void tetris_env_reset_one(Tetris_Env *env, int index, u32 seed)
+{
+    batch_reset(env->batch, index, seed, env->start_level);
+    env->last_points[index] = 0;
+    env_write_observation(env, index, 0);
+}
+
+extern "C" void tetris_env_reset(Tetris_Env *env, u32 seed)
+{
+    for (int index = 0;
+         index < env->batch->count;
+         ++index)
+    {
+        tetris_env_reset_one(env, index, seed + index);
+    }
+}
+
+extern "C" void tetris_env_step(Tetris_Env *env, const u16 *actions)
+{
+    Batch_Engine *batch = env->batch;
+    batch_step(batch, actions);
+
+    for (int index = 0;
+         index < batch->count;
+         ++index)
+    {
+        s32 points = batch->points[index];
+        float reward = (float)(points - env->last_points[index]);
+        env->last_points[index] = points;
+        env_write_observation(env, index, reward);
+    }
+}
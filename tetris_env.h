@@ -0,0 +1,74 @@
+#ifndef TETRIS_ENV_H
+#define TETRIS_ENV_H
+
+/* C interface for driving many headless games from training code.
+   Observations are written straight into caller-owned arrays bound once with
+   tetris_env_bind; stepping never allocates. Every array is indexed by env
+   first and may be null to skip that observation. */
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#define TETRIS_ENV_API __declspec(dllexport)
+#else
+#define TETRIS_ENV_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TETRIS_ENV_WIDTH 10
+#define TETRIS_ENV_HEIGHT 22
+
+/* Action bits, the same held-button mask the game reads from the keyboard.
+   Moves, rotation, drops and hold trigger on the step a button goes down. */
+#define TETRIS_ENV_LEFT (1 << 0)
+#define TETRIS_ENV_RIGHT (1 << 1)
+#define TETRIS_ENV_ROTATE (1 << 2)
+#define TETRIS_ENV_SOFT_DROP (1 << 3)
+#define TETRIS_ENV_HARD_DROP (1 << 4)
+#define TETRIS_ENV_HOLD (1 << 7)
+#define TETRIS_ENV_PUSH_HOLD (1 << 8)
+
+enum Tetris_Env_Counter
+{
+    TETRIS_ENV_LEVEL,
+    TETRIS_ENV_LINES,
+    TETRIS_ENV_POINTS,
+    TETRIS_ENV_FRAME,
+    TETRIS_ENV_PIECE_ROW,
+    TETRIS_ENV_PIECE_COL,
+    TETRIS_ENV_PIECE_ROTATION,
+    TETRIS_ENV_PHASE,
+    TETRIS_ENV_COUNTER_COUNT
+};
+
+typedef struct Tetris_Env Tetris_Env;
+
+typedef struct Tetris_Env_Buffers
+{
+    uint8_t *board;       /* [envs][TETRIS_ENV_HEIGHT][TETRIS_ENV_WIDTH], 1 where occupied */
+    uint16_t *board_rows; /* [envs][TETRIS_ENV_HEIGHT], bit n set when column n is occupied */
+    uint8_t *pieces;      /* [envs][3]: current, next and hold piece, 0 for none */
+    int32_t *counters;    /* [envs][TETRIS_ENV_COUNTER_COUNT] */
+    float *reward;        /* [envs], points scored by the step */
+    uint8_t *done;        /* [envs], 1 once the game is over */
+} Tetris_Env_Buffers;
+
+TETRIS_ENV_API Tetris_Env *tetris_env_create(int env_count, int start_level);
+TETRIS_ENV_API void tetris_env_destroy(Tetris_Env *env);
+TETRIS_ENV_API void tetris_env_bind(Tetris_Env *env, const Tetris_Env_Buffers *buffers);
+
+/* Env i starts from seed + i; writes fresh observations */
+TETRIS_ENV_API void tetris_env_reset(Tetris_Env *env, uint32_t seed);
+TETRIS_ENV_API void tetris_env_reset_one(Tetris_Env *env, int index, uint32_t seed);
+
+/* One frame for every env; finished envs stay done until reset */
+TETRIS_ENV_API void tetris_env_step(Tetris_Env *env, const uint16_t *actions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+//Fixed set of worker threads that run one batch of indexed tasks at a time.
+//The calling thread works too, as worker 0.
+
+typedef void Thread_Pool_Task(void *data, int task, int worker);
+
+struct Thread_Pool
+{
+    std::thread *threads;
+    int worker_count;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    u32 generation;
+    int busy;
+    bool quit;
+
+    Thread_Pool_Task *task;
+    void *data;
+    int task_count;
+    std::atomic<int> next_task;
+};
+
+void thread_pool_work(Thread_Pool *pool, int worker)
+{
+    for (;;)
+    {
+        int task = pool->next_task.fetch_add(1, std::memory_order_relaxed);
+        if (task >= pool->task_count)
+        {
+            return;
+        }
+        pool->task(pool->data, task, worker);
+    }
+}
+
+void thread_pool_worker(Thread_Pool *pool, int worker)
+{
+    u32 seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(pool->mutex);
+            pool->wake.wait(lock, [&] { return pool->quit || pool->generation != seen; });
+            if (pool->quit)
+            {
+                return;
+            }
+            seen = pool->generation;
+        }
+
+        thread_pool_work(pool, worker);
+
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        if (--pool->busy == 0)
+        {
+            pool->done.notify_one();
+        }
+    }
+}
+
+//Zero workers means one per hardware thread
+Thread_Pool *thread_pool_create(int worker_count)
+{
+    if (worker_count <= 0)
+    {
+        worker_count = (int)std::thread::hardware_concurrency();
+    }
+    if (worker_count <= 0)
+    {
+        worker_count = 1;
+    }
+
+    Thread_Pool *pool = new Thread_Pool();
+    pool->worker_count = worker_count;
+    pool->generation = 0;
+    pool->busy = 0;
+    pool->quit = false;
+    pool->threads = new std::thread[worker_count - 1];
+    for (int i = 1;
+         i < worker_count;
+         ++i)
+    {
+        pool->threads[i - 1] = std::thread(thread_pool_worker, pool, i);
+    }
+    return pool;
+}
+
+void thread_pool_destroy(Thread_Pool *pool)
+{
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->quit = true;
+    }
+    pool->wake.notify_all();
+    for (int i = 0;
+         i < pool->worker_count - 1;
+         ++i)
+    {
+        pool->threads[i].join();
+    }
+    delete[] pool->threads;
+    delete pool;
+}
+
+//Runs task(data, i, worker) for every i below task_count and returns when all are done
+void thread_pool_run(Thread_Pool *pool, int task_count, Thread_Pool_Task *task, void *data)
+{
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->task = task;
+        pool->data = data;
+        pool->task_count = task_count;
+        pool->next_task.store(0, std::memory_order_relaxed);
+        pool->busy = pool->worker_count - 1;
+        ++pool->generation;
+    }
+    pool->wake.notify_all();
+
+    thread_pool_work(pool, 0);
+
+    std::unique_lock<std::mutex> lock(pool->mutex);
+    pool->done.wait(lock, [&] { return pool->busy == 0; });
+}
+
+#endif
@@ -0,0 +1,399 @@
+//Round-robin tournament between bot plugins (see bot_plugin.h) on shared seeds.
+//Build: g++ -O2 -pthread tournament.cpp -o tournament -ldl
+//Usage: tournament plugin.so plugin.so ... [--games n] [--pieces n] [--budget ms]
+//                  [--threads n] [--seed n]
+//Every bot plays every seed once; since the games are single player and the seeds are
+//shared, each pairing is decided seed by seed on points from those same games.
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <algorithm>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <time.h>
+#endif
+
+#include "game.h"
+#include "bot.h"
+#include "bot_plugin.h"
+
+#define TOURNAMENT_MAX_BOTS 32
+
+struct Loaded_Plugin
+{
+    const char *path;
+    const Bot_Plugin *plugin;
+};
+
+struct Game_Result
+{
+    s32 points;
+    s32 lines;
+    u32 pieces;
+    u32 overruns;
+    u32 rejected;
+    //Thread CPU time of every decide call, in microseconds
+    std::vector<u32> latencies;
+};
+
+struct Tournament
+{
+    Loaded_Plugin plugins[TOURNAMENT_MAX_BOTS];
+    int plugin_count;
+    int games;
+    int max_pieces;
+    u32 budget_us;
+    u32 seed;
+
+    Game_Result *results;
+    u8 shapes[ARRAY_COUNT(TETROMINOS)][4][16];
+};
+
+//Null with a message when the library or its entry point is missing or of another version
+const Bot_Plugin *load_plugin(const char *path)
+{
+#ifdef _WIN32
+    HMODULE library = LoadLibraryA(path);
+    void *entry = library ? (void *)GetProcAddress(library, BOT_PLUGIN_ENTRY_NAME) : 0;
+#else
+    void *library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    void *entry = library ? dlsym(library, BOT_PLUGIN_ENTRY_NAME) : 0;
+#endif
+    if (!entry)
+    {
+        fprintf(stderr, "could not load %s\n", path);
+        return 0;
+    }
+    const Bot_Plugin *plugin = ((Bot_Plugin_Entry *)entry)();
+    if (!plugin || plugin->abi_version != BOT_PLUGIN_ABI_VERSION)
+    {
+        fprintf(stderr, "%s is not a version %d bot plugin\n", path, BOT_PLUGIN_ABI_VERSION);
+        return 0;
+    }
+    return plugin;
+}
+
+u64 thread_cpu_us()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+    u64 total = ((u64)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime) +
+                ((u64)user.dwHighDateTime << 32 | user.dwLowDateTime);
+    return total / 10;
+#else
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (u64)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#endif
+}
+
+//Only resting spots the piece can be steered to from its spawn and hard dropped into count
+bool placement_valid(const Game_State *game, const Bot_Plugin_Move *move)
+{
+    Piece_State target = game->piece;
+    target.rotation = move->rotation;
+    target.offset_row = move->offset_row;
+    target.offset_col = move->offset_col;
+    if (move->rotation > 3 || !check_piece_valid(&target, game->board, WIDTH, HEIGHT))
+    {
+        return false;
+    }
+    Piece_State below = target;
+    ++below.offset_row;
+    if (check_piece_valid(&below, game->board, WIDTH, HEIGHT))
+    {
+        return false;
+    }
+
+    Finesse_Path path;
+    Piece_State dropped = game->piece;
+    dropped.rotation = move->rotation;
+    dropped.offset_col = move->offset_col;
+    return finesse_find(game->board, &game->piece, move->rotation, move->offset_col, &path) &&
+           finesse_landing(game->board, dropped) == finesse_landing(game->board, target);
+}
+
+bool drop_where_spawned(Game_State *game)
+{
+    Bot_Move move = {};
+    move.tetromino = game->piece.tetromino_index;
+    move.rotation = (u8)game->piece.rotation;
+    move.offset_row = (s8)game->piece.offset_row;
+    move.offset_col = (s8)game->piece.offset_col;
+    return bot_apply_move(game, &move);
+}
+
+void play_game(Tournament *tournament, const Bot_Plugin *plugin, u32 seed, Game_Result *result)
+{
+    Game_State game = {};
+    seed_game(&game, seed);
+    Input_State start = unpack_input(INPUT_SPACE, 0);
+    step_game(&game, &start);
+
+    //Placements are counted here: the game's piece_count also counts the piece in hand and
+    //every hold into an empty slot
+    void *bot = plugin->create(seed);
+    u32 placed = 0;
+    while (game.phase == GAME_PHASE_PLAY && (int)placed < tournament->max_pieces)
+    {
+        Bot_Plugin_View view = {};
+        view.size = sizeof(view);
+        view.board = game.board;
+        view.shapes = tournament->shapes;
+        view.piece.tetromino = game.piece.tetromino_index;
+        view.piece.rotation = (u8)game.piece.rotation;
+        view.piece.offset_row = (s8)game.piece.offset_row;
+        view.piece.offset_col = (s8)game.piece.offset_col;
+        view.next = game.nextPiece.tetromino_index;
+        view.hold = game.holdPlace ? game.holdPiece.tetromino_index : 0;
+        view.hold_allowed = 1;
+        view.level = game.level;
+        view.line_count = game.line_count;
+        view.points = game.points;
+        view.piece_count = game.piece_count;
+        view.budget_us = tournament->budget_us;
+
+        Bot_Plugin_Move move = {};
+        u64 begin = thread_cpu_us();
+        int decided = plugin->decide(bot, &view, &move);
+        u32 spent = (u32)(thread_cpu_us() - begin);
+        result->latencies.push_back(spent);
+
+        bool dropped = false;
+        if (spent > tournament->budget_us)
+        {
+            ++result->overruns;
+            dropped = drop_where_spawned(&game);
+        }
+        else if (!decided)
+        {
+            dropped = drop_where_spawned(&game);
+        }
+        else
+        {
+            Game_State before = game;
+            if (move.use_hold)
+            {
+                hold_piece(&game);
+            }
+            if (placement_valid(&game, &move))
+            {
+                Bot_Move apply = {};
+                apply.tetromino = game.piece.tetromino_index;
+                apply.rotation = move.rotation;
+                apply.offset_row = move.offset_row;
+                apply.offset_col = move.offset_col;
+                dropped = bot_apply_move(&game, &apply);
+            }
+            else
+            {
+                ++result->rejected;
+                game = before;
+                dropped = drop_where_spawned(&game);
+            }
+        }
+        if (!dropped)
+        {
+            break;
+        }
+        ++placed;
+    }
+    plugin->destroy(bot);
+
+    result->points = game.points;
+    result->lines = game.line_count;
+    result->pieces = placed;
+}
+
+void play_task(void *data, int task, int)
+{
+    Tournament *tournament = (Tournament *)data;
+    const Bot_Plugin *plugin = tournament->plugins[task / tournament->games].plugin;
+    play_game(tournament, plugin, tournament->seed + task % tournament->games,
+              tournament->results + task);
+}
+
+u32 percentile(const std::vector<u32> &sorted, double fraction)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+    size_t index = (size_t)(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+int main(int argc, char **argv)
+{
+    Tournament *tournament = new Tournament();
+    tournament->games = 20;
+    tournament->max_pieces = 1000;
+    tournament->budget_us = 20000;
+    tournament->seed = (u32)time(0);
+    int threads = 0;
+    for (int i = 1;
+         i < argc;
+         ++i)
+    {
+        if (strncmp(argv[i], "--", 2) != 0)
+        {
+            if (tournament->plugin_count == TOURNAMENT_MAX_BOTS)
+            {
+                fprintf(stderr, "at most %d bots\n", TOURNAMENT_MAX_BOTS);
+                return 1;
+            }
+            Loaded_Plugin *loaded = tournament->plugins + tournament->plugin_count++;
+            loaded->path = argv[i];
+            loaded->plugin = load_plugin(argv[i]);
+            if (!loaded->plugin)
+            {
+                return 1;
+            }
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *value = argv[++i];
+        if (strcmp(argv[i - 1], "--games") == 0)
+        {
+            tournament->games = max(atoi(value), 1);
+        }
+        else if (strcmp(argv[i - 1], "--pieces") == 0)
+        {
+            tournament->max_pieces = atoi(value);
+        }
+        else if (strcmp(argv[i - 1], "--budget") == 0)
+        {
+            tournament->budget_us = (u32)(atof(value) * 1000);
+        }
+        else if (strcmp(argv[i - 1], "--threads") == 0)
+        {
+            threads = atoi(value);
+        }
+        else if (strcmp(argv[i - 1], "--seed") == 0)
+        {
+            tournament->seed = (u32)strtoul(value, 0, 10);
+        }
+        else
+        {
+            fprintf(stderr, "bad option %s\n", argv[i - 1]);
+            return 1;
+        }
+    }
+    if (tournament->plugin_count < 1)
+    {
+        fprintf(stderr, "usage: tournament plugin... [--games n] [--pieces n] [--budget ms] [--threads n] [--seed n]\n");
+        return 1;
+    }
+
+    for (u32 tetromino = 0;
+         tetromino < ARRAY_COUNT(TETROMINOS);
+         ++tetromino)
+    {
+        const Tetromino *shape = TETROMINOS + tetromino;
+        for (int rotation = 0;
+             rotation < 4;
+             ++rotation)
+        {
+            for (int row = 0;
+                 row < shape->side;
+                 ++row)
+            {
+                for (int col = 0;
+                     col < shape->side;
+                     ++col)
+                {
+                    tournament->shapes[tetromino][rotation][row * 4 + col] =
+                        tetromino_rotate(shape, row, col, rotation);
+                }
+            }
+        }
+    }
+
+    int bot_count = tournament->plugin_count;
+    int games = tournament->games;
+    printf("%d bots, %d seeds from %u, %d pieces per game, %.1f ms per move\n",
+           bot_count, games, tournament->seed, tournament->max_pieces, tournament->budget_us / 1000.0);
+
+    tournament->results = new Game_Result[bot_count * games];
+    Thread_Pool *pool = thread_pool_create(threads);
+    thread_pool_run(pool, bot_count * games, play_task, tournament);
+    thread_pool_destroy(pool);
+
+    //A seed goes to whichever bot scored more on it; ties are half a point each
+    std::vector<double> standing(bot_count);
+    printf("\npairings (wins-losses-draws)\n");
+    for (int a = 0;
+         a < bot_count;
+         ++a)
+    {
+        for (int b = a + 1;
+             b < bot_count;
+             ++b)
+        {
+            int wins = 0;
+            int losses = 0;
+            for (int game = 0;
+                 game < games;
+                 ++game)
+            {
+                s32 points_a = tournament->results[a * games + game].points;
+                s32 points_b = tournament->results[b * games + game].points;
+                wins += points_a > points_b;
+                losses += points_a < points_b;
+            }
+            int draws = games - wins - losses;
+            standing[a] += wins + draws * 0.5;
+            standing[b] += losses + draws * 0.5;
+            printf("%-16s vs %-16s %d-%d-%d\n", tournament->plugins[a].plugin->name,
+                   tournament->plugins[b].plugin->name, wins, losses, draws);
+        }
+    }
+
+    printf("\n%-16s %8s %10s %8s %9s %8s %8s %8s %8s %8s %8s\n", "bot", "standing", "points",
+           "lines", "pieces", "overrun", "rejected", "p50 us", "p90 us", "p99 us", "max us");
+    for (int bot = 0;
+         bot < bot_count;
+         ++bot)
+    {
+        double points = 0;
+        double lines = 0;
+        double pieces = 0;
+        u32 overruns = 0;
+        u32 rejected = 0;
+        std::vector<u32> latencies;
+        for (int game = 0;
+             game < games;
+             ++game)
+        {
+            const Game_Result *result = tournament->results + bot * games + game;
+            points += result->points;
+            lines += result->lines;
+            pieces += result->pieces;
+            overruns += result->overruns;
+            rejected += result->rejected;
+            latencies.insert(latencies.end(), result->latencies.begin(), result->latencies.end());
+        }
+        std::sort(latencies.begin(), latencies.end());
+        printf("%-16s %8.1f %10.0f %8.1f %9.1f %8u %8u %8u %8u %8u %8u\n",
+               tournament->plugins[bot].plugin->name, standing[bot],
+               points / games, lines / games, pieces / games, overruns, rejected,
+               percentile(latencies, 0.5), percentile(latencies, 0.9),
+               percentile(latencies, 0.99), latencies.empty() ? 0 : latencies.back());
+    }
+
+    delete[] tournament->results;
+    delete tournament;
+    return 0;
+}
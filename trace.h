@@ -0,0 +1,190 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TRACE_USE_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+//Scoped timing zones for whole-session profiling, compiled in with TETRIS_TRACE.
+//TRACE_ZONE("name") times the rest of its scope. Each thread appends finished zones to
+//its own buffer and publishes them by bumping a count, so recording takes no lock and no
+//locked instruction; trace_export can read every buffer while the threads keep going.
+//Buffers grow in chunks up to a fixed cap per thread, zones past it are only counted.
+//The export is Chrome trace-event JSON, for chrome://tracing or ui.perfetto.dev.
+//
+//Names must be string literals or otherwise outlive the export.
+//On x86 zones are stamped with the time stamp counter, a fraction of the cost of a clock
+//call, and converted to nanoseconds against the steady clock when exported.
+
+#define TRACE_CHUNK_EVENTS (1 << 16)
+#define TRACE_MAX_CHUNKS 64
+
+struct Trace_Event
+{
+    const char *name;
+    //trace_now ticks
+    u64 start;
+    u64 end;
+};
+
+struct Trace_Buffer
+{
+    Trace_Event *chunks[TRACE_MAX_CHUNKS];
+    //Events below this are complete; only the owning thread stores it
+    std::atomic<u32> count;
+    std::atomic<u32> dropped;
+    u32 thread_id;
+    char thread_name[32];
+    Trace_Buffer *next;
+};
+
+//Buffers are pushed once per thread and never freed, so zones of finished threads remain
+std::atomic<Trace_Buffer *> trace_buffers;
+std::atomic<u32> trace_thread_count;
+thread_local Trace_Buffer *trace_thread_buffer;
+const std::chrono::steady_clock::time_point trace_epoch = std::chrono::steady_clock::now();
+
+#ifdef TRACE_USE_TSC
+const u64 trace_epoch_ticks = __rdtsc();
+
+u64 trace_now()
+{
+    return __rdtsc() - trace_epoch_ticks;
+}
+
+//Measured over the whole session so far, which makes it as exact as the clocks allow
+double trace_nanoseconds_per_tick()
+{
+    u64 ticks = trace_now();
+    double nanoseconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - trace_epoch).count();
+    return ticks ? nanoseconds / (double)ticks : 1.0;
+}
+#else
+u64 trace_now()
+{
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - trace_epoch).count();
+}
+
+double trace_nanoseconds_per_tick()
+{
+    return 1.0;
+}
+#endif
+
+Trace_Buffer *trace_buffer()
+{
+    Trace_Buffer *buffer = trace_thread_buffer;
+    if (!buffer)
+    {
+        buffer = new Trace_Buffer();
+        buffer->thread_id = trace_thread_count.fetch_add(1, std::memory_order_relaxed) + 1;
+        snprintf(buffer->thread_name, sizeof(buffer->thread_name), "thread %u", buffer->thread_id);
+        buffer->next = trace_buffers.load(std::memory_order_relaxed);
+        while (!trace_buffers.compare_exchange_weak(buffer->next, buffer,
+                                                    std::memory_order_release,
+                                                    std::memory_order_relaxed));
+        trace_thread_buffer = buffer;
+    }
+    return buffer;
+}
+
+//Labels the calling thread in the export
+void trace_thread_name(const char *name)
+{
+    Trace_Buffer *buffer = trace_buffer();
+    snprintf(buffer->thread_name, sizeof(buffer->thread_name), "%s", name);
+}
+
+void trace_record(const char *name, u64 start, u64 end)
+{
+    Trace_Buffer *buffer = trace_buffer();
+    u32 count = buffer->count.load(std::memory_order_relaxed);
+    u32 chunk = count / TRACE_CHUNK_EVENTS;
+    if (chunk == TRACE_MAX_CHUNKS)
+    {
+        buffer->dropped.store(buffer->dropped.load(std::memory_order_relaxed) + 1,
+                              std::memory_order_relaxed);
+        return;
+    }
+    if (!buffer->chunks[chunk])
+    {
+        buffer->chunks[chunk] = new Trace_Event[TRACE_CHUNK_EVENTS];
+    }
+    Trace_Event *event = buffer->chunks[chunk] + count % TRACE_CHUNK_EVENTS;
+    event->name = name;
+    event->start = start;
+    event->end = end;
+    buffer->count.store(count + 1, std::memory_order_release);
+}
+
+struct Trace_Zone
+{
+    const char *name;
+    u64 start;
+
+    Trace_Zone(const char *zone_name)
+    {
+        name = zone_name;
+        start = trace_now();
+    }
+
+    ~Trace_Zone()
+    {
+        trace_record(name, start, trace_now());
+    }
+};
+
+//Writes every zone recorded so far; returns false when the file could not be written.
+//Safe to call while other threads are recording, they just aren't waited for.
+bool trace_export(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        return false;
+    }
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Tetris\"}}");
+    u64 dropped = 0;
+    double scale = trace_nanoseconds_per_tick();
+    for (Trace_Buffer *buffer = trace_buffers.load(std::memory_order_acquire);
+         buffer;
+         buffer = buffer->next)
+    {
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                buffer->thread_id, buffer->thread_name);
+        u32 count = buffer->count.load(std::memory_order_acquire);
+        for (u32 i = 0;
+             i < count;
+             ++i)
+        {
+            const Trace_Event *event = buffer->chunks[i / TRACE_CHUNK_EVENTS] + i % TRACE_CHUNK_EVENTS;
+            //Microseconds, the unit the format expects
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    event->name, buffer->thread_id, event->start * scale / 1000.0,
+                    (event->end - event->start) * scale / 1000.0);
+        }
+        dropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
+    fprintf(file, "\n],\"otherData\":{\"dropped_zones\":\"%llu\"}}\n", (unsigned long long)dropped);
+    return fclose(file) == 0;
+}
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_ZONE(name) Trace_Zone TRACE_CONCAT(trace_zone_, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) trace_thread_name(name)
+#define TRACE_EXPORT(path) trace_export(path)
+
+#endif
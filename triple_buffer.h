@@ -0,0 +1,49 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+//Hands slots of a three-element array from one writer thread to one reader thread.
+//The writer fills its back slot and swaps it into the middle; the reader takes the middle
+//whenever it holds something newer than its front slot. Neither side ever waits, and the
+//reader always sees the most recently completed slot.
+
+#define TRIPLE_BUFFER_FRESH 4
+
+struct Triple_Buffer
+{
+    std::atomic<u8> middle;
+    u8 back;
+    u8 front;
+};
+
+void triple_buffer_init(Triple_Buffer *buffer)
+{
+    buffer->front = 0;
+    buffer->middle.store(1, std::memory_order_relaxed);
+    buffer->back = 2;
+}
+
+//Slot the writer may fill
+int triple_buffer_back(const Triple_Buffer *buffer)
+{
+    return buffer->back;
+}
+
+void triple_buffer_publish(Triple_Buffer *buffer)
+{
+    u8 slot = buffer->back | TRIPLE_BUFFER_FRESH;
+    buffer->back = buffer->middle.exchange(slot, std::memory_order_acq_rel) & 3;
+}
+
+//Slot the reader may read until its next call
+int triple_buffer_read(Triple_Buffer *buffer)
+{
+    if (buffer->middle.load(std::memory_order_relaxed) & TRIPLE_BUFFER_FRESH)
+    {
+        buffer->front = buffer->middle.exchange(buffer->front, std::memory_order_acq_rel) & 3;
+    }
+    return buffer->front;
+}
+
+#endif
@@ -0,0 +1,538 @@
+//Genetic tuner for the bot's evaluation weights, scored by headless self-play on every core.
+//Build: g++ -O2 -mavx2 -pthread tuner.cpp -o tuner
+//Usage: tuner [--checkpoint file] [--generations n] [--population n] [--games n]
+//             [--pieces n] [--beam n] [--threads n] [--lines]
+//Progress is saved to the checkpoint after every generation and picked up again on restart.
+//A resumed run keeps the checkpoint's population, games, pieces, beam and lines; passing any
+//of them with a different value is an error, as is a checkpoint that exists but won't load.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <ctime>
+#include <chrono>
+
+#include "game.h"
+#include "bot.h"
+
+#define TUNER_MAX_POPULATION 1024
+#define TUNER_CHECKPOINT_VERSION 1
+
+struct Tuner_Settings
+{
+    int population;
+    int games;
+    int pieces;
+    int beam_width;
+    bool lines;
+};
+
+struct Candidate
+{
+    float weights[BOT_WEIGHT_COUNT];
+    double fitness;
+};
+
+struct Tuner
+{
+    Tuner_Settings settings;
+    int generation;
+    u32 rng_state;
+    Candidate population[TUNER_MAX_POPULATION];
+    Candidate best;
+
+    //Filled while a generation plays
+    Bot *bots[BOT_MAX_WORKERS];
+    u32 seed;
+    s32 *results;
+};
+
+float tuner_random_float(u32 *rng)
+{
+    return (random_next(rng) >> 8) * (1.0f / 16777216.0f);
+}
+
+float tuner_random_normal(u32 *rng)
+{
+    float u = max(1, (int)(random_next(rng) >> 8)) * (1.0f / 16777216.0f);
+    float v = tuner_random_float(rng);
+    return sqrtf(-2.0f * logf(u)) * cosf(6.2831853f * v);
+}
+
+//The evaluation is linear in the weights, so only their direction changes what the bot plays
+void normalize_weights(float *weights)
+{
+    float length = 0;
+    for (int i = 0;
+         i < BOT_WEIGHT_COUNT;
+         ++i)
+    {
+        length += weights[i] * weights[i];
+    }
+    length = sqrtf(length);
+    if (length > 0)
+    {
+        for (int i = 0;
+             i < BOT_WEIGHT_COUNT;
+             ++i)
+        {
+            weights[i] /= length;
+        }
+    }
+}
+
+//Every candidate of a generation plays the same seeds, so luck of the draw cancels out
+u32 generation_seed(int generation)
+{
+    u32 seed = 0x9E3779B9u * (u32)(generation + 1);
+    random_next(&seed);
+    return seed;
+}
+
+s32 play_game(Bot *bot, u32 seed, int max_pieces, bool lines)
+{
+    Game_State game = {};
+    seed_game(&game, seed);
+    Input_State start = unpack_input(INPUT_SPACE, 0);
+    step_game(&game, &start);
+
+    while (game.phase == GAME_PHASE_PLAY && (int)game.piece_count <= max_pieces)
+    {
+        u32 piece_count = game.piece_count;
+        bool allow_hold = true;
+        Bot_Move move;
+        for (;;)
+        {
+            if (!bot_decide(bot, &game, allow_hold, &move))
+            {
+                //Nowhere to go, drop the piece where it is and let it top out
+                move = {};
+                move.tetromino = game.piece.tetromino_index;
+                move.rotation = game.piece.rotation;
+                move.offset_row = (s8)game.piece.offset_row;
+                move.offset_col = (s8)game.piece.offset_col;
+                bot_apply_move(&game, &move);
+                break;
+            }
+            if (bot_apply_move(&game, &move))
+            {
+                break;
+            }
+            allow_hold = false;
+        }
+        if (game.piece_count == piece_count)
+        {
+            //Should not happen, but a stuck game must not hang the whole run
+            break;
+        }
+    }
+    return lines ? game.line_count : game.points;
+}
+
+void play_task(void *data, int task, int worker)
+{
+    Tuner *tuner = (Tuner *)data;
+    int games = tuner->settings.games;
+    const Candidate *candidate = tuner->population + task / games;
+    Bot *bot = tuner->bots[worker];
+    memcpy(bot->config.weights, candidate->weights, sizeof(candidate->weights));
+    tuner->results[task] = play_game(bot, tuner->seed + task % games,
+                                     tuner->settings.pieces, tuner->settings.lines);
+}
+
+void evaluate_population(Tuner *tuner, Thread_Pool *pool)
+{
+    int games = tuner->settings.games;
+    tuner->seed = generation_seed(tuner->generation);
+    thread_pool_run(pool, tuner->settings.population * games, play_task, tuner);
+
+    for (int i = 0;
+         i < tuner->settings.population;
+         ++i)
+    {
+        s64 total = 0;
+        for (int game = 0;
+             game < games;
+             ++game)
+        {
+            total += tuner->results[i * games + game];
+        }
+        tuner->population[i].fitness = (double)total / games;
+    }
+}
+
+bool candidate_better(const Candidate &a, const Candidate &b)
+{
+    return a.fitness > b.fitness;
+}
+
+const Candidate *tournament_select(Tuner *tuner)
+{
+    const Candidate *winner = 0;
+    for (int i = 0;
+         i < 3;
+         ++i)
+    {
+        const Candidate *entry = tuner->population +
+                                 random_next(&tuner->rng_state) % tuner->settings.population;
+        if (!winner || entry->fitness > winner->fitness)
+        {
+            winner = entry;
+        }
+    }
+    return winner;
+}
+
+//Keeps the best quarter and refills the rest with fitness-weighted crossovers plus mutation
+void breed_population(Tuner *tuner)
+{
+    int population = tuner->settings.population;
+    std::sort(tuner->population, tuner->population + population, candidate_better);
+
+    Candidate next[TUNER_MAX_POPULATION];
+    int elite = max(1, population / 4);
+    memcpy(next, tuner->population, elite * sizeof(Candidate));
+    for (int i = elite;
+         i < population;
+         ++i)
+    {
+        const Candidate *a = tournament_select(tuner);
+        const Candidate *b = tournament_select(tuner);
+        double total = a->fitness + b->fitness;
+        float share = total > 0 ? (float)(a->fitness / total) : 0.5f;
+
+        Candidate *child = next + i;
+        *child = {};
+        for (int w = 0;
+             w < BOT_WEIGHT_COUNT;
+             ++w)
+        {
+            child->weights[w] = share * a->weights[w] + (1 - share) * b->weights[w];
+            if (tuner_random_float(&tuner->rng_state) < 0.3f)
+            {
+                child->weights[w] += 0.1f * tuner_random_normal(&tuner->rng_state);
+            }
+        }
+        normalize_weights(child->weights);
+    }
+    memcpy(tuner->population, next, population * sizeof(Candidate));
+}
+
+void init_population(Tuner *tuner)
+{
+    Candidate *population = tuner->population;
+    memcpy(population[0].weights, BOT_DEFAULT_WEIGHTS, sizeof(BOT_DEFAULT_WEIGHTS));
+    normalize_weights(population[0].weights);
+    for (int i = 1;
+         i < tuner->settings.population;
+         ++i)
+    {
+        for (int w = 0;
+             w < BOT_WEIGHT_COUNT;
+             ++w)
+        {
+            population[i].weights[w] = 2 * tuner_random_float(&tuner->rng_state) - 1;
+        }
+        normalize_weights(population[i].weights);
+    }
+    tuner->best = population[0];
+    tuner->best.fitness = -1;
+}
+
+void write_candidate(FILE *file, const Candidate *candidate)
+{
+    fprintf(file, "%.3f", candidate->fitness);
+    for (int w = 0;
+         w < BOT_WEIGHT_COUNT;
+         ++w)
+    {
+        fprintf(file, " %.6f", candidate->weights[w]);
+    }
+    fprintf(file, "\n");
+}
+
+bool read_candidate(FILE *file, Candidate *candidate)
+{
+    if (fscanf(file, "%lf", &candidate->fitness) != 1)
+    {
+        return false;
+    }
+    for (int w = 0;
+         w < BOT_WEIGHT_COUNT;
+         ++w)
+    {
+        if (fscanf(file, "%f", candidate->weights + w) != 1)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Written to a temporary file first so a run killed mid-write keeps the previous checkpoint
+bool save_checkpoint(const Tuner *tuner, const char *path)
+{
+    char temp_path[1024];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE *file = fopen(temp_path, "w");
+    if (!file)
+    {
+        return false;
+    }
+
+    const Tuner_Settings *settings = &tuner->settings;
+    fprintf(file, "tuner %d %d\n", TUNER_CHECKPOINT_VERSION, BOT_WEIGHT_COUNT);
+    fprintf(file, "settings %d %d %d %d %d\n", settings->population, settings->games,
+            settings->pieces, settings->beam_width, settings->lines ? 1 : 0);
+    fprintf(file, "generation %d %u\n", tuner->generation, tuner->rng_state);
+    fprintf(file, "best ");
+    write_candidate(file, &tuner->best);
+    for (int i = 0;
+         i < settings->population;
+         ++i)
+    {
+        write_candidate(file, tuner->population + i);
+    }
+
+    bool ok = fclose(file) == 0;
+    remove(path);
+    return ok && rename(temp_path, path) == 0;
+}
+
+//All or nothing: the tuner is only changed once the whole file has read back
+bool load_checkpoint(Tuner *tuner, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        return false;
+    }
+
+    Tuner_Settings settings = {};
+    int generation = 0;
+    u32 rng_state = 0;
+    Candidate best;
+    int version = 0;
+    int weight_count = 0;
+    int lines = 0;
+    bool ok = fscanf(file, "tuner %d %d", &version, &weight_count) == 2 &&
+              version == TUNER_CHECKPOINT_VERSION && weight_count == BOT_WEIGHT_COUNT &&
+              fscanf(file, " settings %d %d %d %d %d", &settings.population, &settings.games,
+                     &settings.pieces, &settings.beam_width, &lines) == 5 &&
+              settings.population >= 2 && settings.population <= TUNER_MAX_POPULATION &&
+              settings.games > 0 && settings.pieces > 0 && settings.beam_width > 0 &&
+              fscanf(file, " generation %d %u", &generation, &rng_state) == 2 &&
+              fscanf(file, " best") == 0 && read_candidate(file, &best);
+    settings.lines = lines != 0;
+    Candidate *population = (Candidate *)malloc(TUNER_MAX_POPULATION * sizeof(Candidate));
+    for (int i = 0;
+         ok && i < settings.population;
+         ++i)
+    {
+        ok = read_candidate(file, population + i);
+    }
+    fclose(file);
+
+    if (ok)
+    {
+        tuner->settings = settings;
+        tuner->generation = generation;
+        tuner->rng_state = rng_state;
+        tuner->best = best;
+        memcpy(tuner->population, population, settings.population * sizeof(Candidate));
+    }
+    free(population);
+    return ok;
+}
+
+//Options left at zero weren't given; the rest must agree with the checkpoint being resumed
+bool settings_conflict(const Tuner_Settings *checkpoint, const Tuner_Settings *requested)
+{
+    return (requested->population && requested->population != checkpoint->population) ||
+           (requested->games && requested->games != checkpoint->games) ||
+           (requested->pieces && requested->pieces != checkpoint->pieces) ||
+           (requested->beam_width && requested->beam_width != checkpoint->beam_width) ||
+           (requested->lines && !checkpoint->lines);
+}
+
+int main(int argc, char **argv)
+{
+    const char *checkpoint_path = "tuner_checkpoint.txt";
+    int generations = 100;
+    int threads = 0;
+
+    Tuner_Settings requested = {};
+
+    for (int i = 1;
+         i < argc;
+         ++i)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : "0";
+        if (strcmp(arg, "--lines") == 0)
+        {
+            requested.lines = true;
+            continue;
+        }
+
+        if (strcmp(arg, "--checkpoint") == 0)
+        {
+            checkpoint_path = value;
+        }
+        else if (strcmp(arg, "--generations") == 0)
+        {
+            generations = atoi(value);
+        }
+        else if (strcmp(arg, "--population") == 0)
+        {
+            requested.population = min(max(atoi(value), 2), TUNER_MAX_POPULATION);
+        }
+        else if (strcmp(arg, "--games") == 0)
+        {
+            requested.games = max(atoi(value), 1);
+        }
+        else if (strcmp(arg, "--pieces") == 0)
+        {
+            requested.pieces = max(atoi(value), 1);
+        }
+        else if (strcmp(arg, "--beam") == 0)
+        {
+            requested.beam_width = max(atoi(value), 1);
+        }
+        else if (strcmp(arg, "--threads") == 0)
+        {
+            threads = atoi(value);
+        }
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return 1;
+        }
+        ++i;
+    }
+
+    Tuner *tuner = new Tuner();
+    FILE *existing = fopen(checkpoint_path, "r");
+    if (existing)
+    {
+        //Starting over would overwrite the checkpoint at the first save
+        fclose(existing);
+        if (!load_checkpoint(tuner, checkpoint_path))
+        {
+            fprintf(stderr, "checkpoint %s is not readable; move it away to start over\n", checkpoint_path);
+            return 1;
+        }
+        if (settings_conflict(&tuner->settings, &requested))
+        {
+            const Tuner_Settings *settings = &tuner->settings;
+            fprintf(stderr, "checkpoint %s was started with --population %d --games %d --pieces %d --beam %d%s;"
+                    " drop the conflicting options or use another checkpoint\n", checkpoint_path,
+                    settings->population, settings->games, settings->pieces, settings->beam_width,
+                    settings->lines ? " --lines" : "");
+            return 1;
+        }
+        printf("resuming %s at generation %d\n", checkpoint_path, tuner->generation);
+    }
+    else
+    {
+        tuner->settings.population = requested.population ? requested.population : 64;
+        tuner->settings.games = requested.games ? requested.games : 32;
+        tuner->settings.pieces = requested.pieces ? requested.pieces : 500;
+        tuner->settings.beam_width = requested.beam_width ? requested.beam_width : 16;
+        tuner->settings.lines = requested.lines;
+        tuner->rng_state = (u32)time(0);
+        tuner->generation = 0;
+        init_population(tuner);
+    }
+
+    //Games run in parallel, so each bot searches on its own thread with no time limit
+    Thread_Pool *pool = thread_pool_create(threads);
+    if (pool->worker_count > BOT_MAX_WORKERS)
+    {
+        thread_pool_destroy(pool);
+        pool = thread_pool_create(BOT_MAX_WORKERS);
+    }
+    Bot_Config config = bot_default_config();
+    config.beam_width = tuner->settings.beam_width;
+    config.time_budget_ms = 1e9f;
+    config.threads = 1;
+    for (int worker = 0;
+         worker < pool->worker_count;
+         ++worker)
+    {
+        tuner->bots[worker] = bot_create(&config);
+    }
+    tuner->results = (s32 *)calloc(tuner->settings.population * tuner->settings.games, sizeof(s32));
+#ifdef TETRIS_TELEMETRY
+    Telemetry_Writer *telemetry = telemetry_start("tuner_telemetry.bin", 1000);
+#endif
+
+    printf("%d candidates x %d games of up to %d pieces on %d threads, fitness %s\n",
+           tuner->settings.population, tuner->settings.games, tuner->settings.pieces,
+           pool->worker_count, tuner->settings.lines ? "lines" : "points");
+
+    while (tuner->generation < generations)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        evaluate_population(tuner, pool);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        const Candidate *leader = tuner->population;
+        double total = 0;
+        for (int i = 0;
+             i < tuner->settings.population;
+             ++i)
+        {
+            total += tuner->population[i].fitness;
+            if (tuner->population[i].fitness > leader->fitness)
+            {
+                leader = tuner->population + i;
+            }
+        }
+        //Fitness from different seed sets is only roughly comparable, but it is what we have
+        if (leader->fitness > tuner->best.fitness)
+        {
+            tuner->best = *leader;
+        }
+
+        printf("generation %d: best %.1f mean %.1f (%.1fs)\n", tuner->generation,
+               leader->fitness, total / tuner->settings.population, seconds);
+        printf("  weights");
+        for (int w = 0;
+             w < BOT_WEIGHT_COUNT;
+             ++w)
+        {
+            printf(" %.3ff%s", leader->weights[w], w + 1 < BOT_WEIGHT_COUNT ? "," : "\n");
+        }
+        fflush(stdout);
+
+        breed_population(tuner);
+        ++tuner->generation;
+        if (!save_checkpoint(tuner, checkpoint_path))
+        {
+            fprintf(stderr, "could not write %s\n", checkpoint_path);
+        }
+    }
+
+    printf("best %.1f:", tuner->best.fitness);
+    for (int w = 0;
+         w < BOT_WEIGHT_COUNT;
+         ++w)
+    {
+        printf(" %.3ff%s", tuner->best.weights[w], w + 1 < BOT_WEIGHT_COUNT ? "," : "\n");
+    }
+
+    for (int worker = 0;
+         worker < pool->worker_count;
+         ++worker)
+    {
+        bot_destroy(tuner->bots[worker]);
+    }
+#ifdef TETRIS_TELEMETRY
+    telemetry_stop(telemetry);
+#endif
+    thread_pool_destroy(pool);
+    free(tuner->results);
+    delete tuner;
+    return 0;
+}
@@ -0,0 +1,633 @@
+//Renders a recorded game from a replay corpus into video frames without opening a window.
+//Frames are rasterized in memory by a thread pool with the same layout and colors as
+//render_game in Tetris.cpp; keep the two in step when the screen changes.
+//Build: g++ -O2 video_render.cpp -o video_render -lSDL2 -lSDL2_ttf -lSDL2_image -pthread
+//Usage: video_render directory game [--png dir] [--every n] [--threads n]
+//Without --png, raw 800x780 RGBA frames go to stdout, e.g.
+//video_render replays 12 | ffmpeg -f rawvideo -pix_fmt rgba -s 800x780 -r 60 -i - game.mp4
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include <SDL.h>
+#include <SDL_ttf.h>
+#include <SDL_image.h>
+
+#include "game.h"
+#include "colors.h"
+#include "corpus.h"
+#include "render_snapshot.h"
+#include "thread_pool.h"
+
+#define GRID_SIZE 30
+#define SCREEN_WIDTH 800
+#define SCREEN_HEIGHT 780
+
+enum Text_Align
+{
+    TEXT_ALIGN_LEFT,
+    TEXT_ALIGN_CENTER,
+    TEXT_ALIGN_RIGHT,
+    TEXT_ALIGN_HUD
+};
+
+//Pixels are Color, which is already RGBA byte order
+struct Frame
+{
+    Color *pixels;
+};
+
+struct Image
+{
+    int width;
+    int height;
+    Color *pixels;
+};
+
+//SDL_ttf is not thread safe, so every string is rendered once under the lock and
+//kept as a coverage mask. The HUD only ever shows a few hundred distinct strings.
+struct Text_Mask
+{
+    int width;
+    int height;
+    u8 *coverage;
+};
+
+struct Text_Cache
+{
+    TTF_Font *font;
+    std::mutex mutex;
+    std::unordered_map<std::string, Text_Mask *> masks;
+};
+
+const Text_Mask *text_cache_get(Text_Cache *cache, const char *text)
+{
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    Text_Mask *&mask = cache->masks[text];
+    if (mask)
+    {
+        return mask;
+    }
+
+    mask = (Text_Mask *)calloc(1, sizeof(Text_Mask));
+    SDL_Color white = { 0xFF, 0xFF, 0xFF, 0xFF };
+    SDL_Surface *surface = TTF_RenderText_Solid(cache->font, text, white);
+    if (!surface)
+    {
+        return mask;
+    }
+    //Solid text is 8-bit paletted, index 0 is the transparent background
+    mask->width = surface->w;
+    mask->height = surface->h;
+    mask->coverage = (u8 *)malloc(surface->w * surface->h);
+    SDL_LockSurface(surface);
+    for (int y = 0;
+         y < surface->h;
+         ++y)
+    {
+        const u8 *row = (const u8 *)surface->pixels + y * surface->pitch;
+        for (int x = 0;
+             x < surface->w;
+             ++x)
+        {
+            mask->coverage[y * surface->w + x] = row[x] ? 0xFF : 0;
+        }
+    }
+    SDL_UnlockSurface(surface);
+    SDL_FreeSurface(surface);
+    return mask;
+}
+
+void text_cache_free(Text_Cache *cache)
+{
+    for (auto &entry : cache->masks)
+    {
+        free(entry.second->coverage);
+        free(entry.second);
+    }
+    cache->masks.clear();
+}
+
+//Loads an image already scaled to the rectangle it is drawn into, the way
+//SDL_RenderCopy stretches it with nearest-pixel sampling
+bool load_image(const char *path, int width, int height, Image *image)
+{
+    SDL_Surface *loaded = IMG_Load(path);
+    if (!loaded)
+    {
+        fprintf(stderr, "could not load %s: %s\n", path, IMG_GetError());
+        return false;
+    }
+    SDL_Surface *surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(loaded);
+    if (!surface)
+    {
+        return false;
+    }
+
+    image->width = width;
+    image->height = height;
+    image->pixels = (Color *)malloc(width * height * sizeof(Color));
+    SDL_LockSurface(surface);
+    for (int y = 0;
+         y < height;
+         ++y)
+    {
+        const Color *row = (const Color *)((const u8 *)surface->pixels +
+                                           (y * surface->h / height) * surface->pitch);
+        for (int x = 0;
+             x < width;
+             ++x)
+        {
+            image->pixels[y * width + x] = row[x * surface->w / width];
+        }
+    }
+    SDL_UnlockSurface(surface);
+    SDL_FreeSurface(surface);
+    return true;
+}
+
+Color blend(Color dst, Color src, int alpha)
+{
+    Color result;
+    result.r = (u8)((src.r * alpha + dst.r * (255 - alpha)) / 255);
+    result.g = (u8)((src.g * alpha + dst.g * (255 - alpha)) / 255);
+    result.b = (u8)((src.b * alpha + dst.b * (255 - alpha)) / 255);
+    result.a = 0xFF;
+    return result;
+}
+
+void draw_image(Frame *frame, const Image *image, int x, int y)
+{
+    for (int row = 0;
+         row < image->height;
+         ++row)
+    {
+        Color *dst = frame->pixels + (y + row) * SCREEN_WIDTH + x;
+        const Color *src = image->pixels + row * image->width;
+        for (int col = 0;
+             col < image->width;
+             ++col)
+        {
+            dst[col] = blend(dst[col], src[col], src[col].a);
+        }
+    }
+}
+
+//The window has no alpha, so everything lands opaque like it does on screen
+void fill_rect(Frame *frame, int x, int y, int width, int height, Color color)
+{
+    int x0 = max(x, 0);
+    int y0 = max(y, 0);
+    int x1 = min(x + width, SCREEN_WIDTH);
+    int y1 = min(y + height, SCREEN_HEIGHT);
+    color.a = 0xFF;
+    for (int row = y0;
+         row < y1;
+         ++row)
+    {
+        Color *dst = frame->pixels + row * SCREEN_WIDTH;
+        for (int col = x0;
+             col < x1;
+             ++col)
+        {
+            dst[col] = color;
+        }
+    }
+}
+
+void draw_rect(Frame *frame, int x, int y, int width, int height, Color color)
+{
+    fill_rect(frame, x, y, width, 1, color);
+    fill_rect(frame, x, y + height - 1, width, 1, color);
+    fill_rect(frame, x, y, 1, height, color);
+    fill_rect(frame, x + width - 1, y, 1, height, color);
+}
+
+void draw_string(Frame *frame,
+            Text_Cache *cache,
+            const char *text,
+            int x, int y,
+            Text_Align alignment,
+            Color color)
+{
+    const Text_Mask *mask = text_cache_get(cache, text);
+    switch (alignment)
+    {
+    case TEXT_ALIGN_LEFT:
+        break;
+    case TEXT_ALIGN_CENTER:
+        x -= mask->width / 2;
+        break;
+    case TEXT_ALIGN_RIGHT:
+        x -= mask->width;
+        break;
+    case TEXT_ALIGN_HUD:
+        x -= mask->width / 3;
+    }
+
+    for (int row = max(0, -y);
+         row < mask->height && y + row < SCREEN_HEIGHT;
+         ++row)
+    {
+        Color *dst = frame->pixels + (y + row) * SCREEN_WIDTH;
+        const u8 *coverage = mask->coverage + row * mask->width;
+        for (int col = max(0, -x);
+             col < mask->width && x + col < SCREEN_WIDTH;
+             ++col)
+        {
+            if (coverage[col])
+            {
+                dst[x + col] = blend(dst[x + col], color, coverage[col] * color.a / 255);
+            }
+        }
+    }
+}
+
+void draw_cell(Frame *frame,
+          int row, int col, u8 value,
+          int offset_x, int offset_y,
+          bool outline = false)
+{
+    Color base_color = BASE_COLORS[value];
+    Color light_color = LIGHT_COLORS[value];
+    Color dark_color = DARK_COLORS[value];
+
+    int edge = GRID_SIZE / 8;
+
+    int x = col * GRID_SIZE + offset_x;
+    int y = row * GRID_SIZE + offset_y;
+
+    if (outline)
+    {
+        draw_rect(frame, x, y, GRID_SIZE, GRID_SIZE, base_color);
+        return;
+    }
+
+    fill_rect(frame, x, y, GRID_SIZE, GRID_SIZE, dark_color);
+    fill_rect(frame, x + edge, y,
+              GRID_SIZE - edge, GRID_SIZE - edge, light_color);
+    fill_rect(frame, x + edge, y + edge,
+              GRID_SIZE - edge * 2, GRID_SIZE - edge * 2, base_color);
+}
+
+void draw_piece(Frame *frame,
+           const Piece_State *piece,
+           int offset_x, int offset_y,
+           bool outline = false)
+{
+    const Tetromino *tetromino = TETROMINOS + piece->tetromino_index;
+    for (int row = 0;
+         row < tetromino->side;
+         ++row)
+    {
+        for (int col = 0;
+             col < tetromino->side;
+             ++col)
+        {
+            u8 value = tetromino_rotate(tetromino, row, col, piece->rotation);
+            if (value)
+            {
+                draw_cell(frame,
+                          row + piece->offset_row,
+                          col + piece->offset_col,
+                          value,
+                          offset_x, offset_y,
+                          outline);
+            }
+        }
+    }
+}
+
+void draw_board(Frame *frame,
+           const u8 *board, int width, int height,
+           int offset_x, int offset_y)
+{
+    fill_rect(frame, offset_x, offset_y,
+              width * GRID_SIZE, height * GRID_SIZE,
+              BASE_COLORS[0]);
+    for (int row = 0;
+         row < height;
+         ++row)
+    {
+        for (int col = 0;
+             col < width;
+             ++col)
+        {
+            u8 value = matrix_get(board, width, row, col);
+            if (value)
+            {
+                draw_cell(frame, row, col, value, offset_x, offset_y);
+            }
+        }
+    }
+}
+
+void render_game(const Render_Snapshot *game,
+            Frame *frame,
+            Text_Cache *cache)
+{
+    char buffer[4096];
+
+    Color highlight_color = color(0xFF, 0xFF, 0xFF, 0xFF);
+
+    int margin_y = 75;
+
+    draw_board(frame, game->board, WIDTH, HEIGHT, 60, margin_y);
+
+    if (game->phase == GAME_PHASE_PLAY)
+    {
+        draw_piece(frame, &game->piece, 60, margin_y);
+
+        Piece_State piece = game->piece;
+        while (check_piece_valid(&piece, game->board, WIDTH, HEIGHT))
+        {
+            piece.offset_row++;
+        }
+        --piece.offset_row;
+
+        draw_piece(frame, &piece, 60, margin_y, true);
+
+        draw_piece(frame, &game->nextPiece, 545, 495);
+        draw_piece(frame, &game->holdPiece, 545, 630);
+    }
+
+    if (game->phase == GAME_PHASE_LINE)
+    {
+        for (int row = 0;
+             row < HEIGHT;
+             ++row)
+        {
+            if (game->lines[row])
+            {
+                int x = 60;
+                int y = row * GRID_SIZE + margin_y;
+
+                fill_rect(frame, x, y,
+                          WIDTH * GRID_SIZE, GRID_SIZE, highlight_color);
+            }
+        }
+        draw_piece(frame, &game->nextPiece, 545, 495);
+        draw_piece(frame, &game->holdPiece, 545, 630);
+    }
+    else if (game->phase == GAME_PHASE_GAMEOVER)
+    {
+        int x = 60 + WIDTH * GRID_SIZE / 2;
+        int y = (HEIGHT * GRID_SIZE + margin_y) / 2;
+        fill_rect(frame, 95, y - 25, 230, 70, color(0x00, 0x00, 0x00, 0x00));
+        draw_string(frame, cache, "GAME OVER",
+                    x, y, TEXT_ALIGN_CENTER, highlight_color);
+    }
+    else if (game->phase == GAME_PHASE_START)
+    {
+        int x = 60 + WIDTH * GRID_SIZE / 2;
+        int y = (HEIGHT * GRID_SIZE + margin_y) / 2;
+        fill_rect(frame, 85, y - 25, 250, 100, color(0x00, 0x00, 0x00, 0x00));
+
+        draw_string(frame, cache, "PRESS SPACE TO START",
+                    x, y, TEXT_ALIGN_CENTER, highlight_color);
+
+        snprintf(buffer, sizeof(buffer), "STARTING LEVEL: %d", game->start_level);
+        draw_string(frame, cache, buffer,
+                    x, y + 30, TEXT_ALIGN_CENTER, highlight_color);
+    }
+
+    fill_rect(frame,
+              60, margin_y,
+              WIDTH * GRID_SIZE, (HEIGHT - VISIBLE_HEIGHT) * GRID_SIZE,
+              color(0x00, 0x00, 0x00, 0x00));
+
+    snprintf(buffer, sizeof(buffer), "LEVEL: %d", game->level);
+    draw_string(frame, cache, buffer, 505, 190, TEXT_ALIGN_LEFT, highlight_color);
+
+    snprintf(buffer, sizeof(buffer), "LINES: %d", game->line_count);
+    draw_string(frame, cache, buffer, 505, 200 + 120 - 35, TEXT_ALIGN_LEFT, highlight_color);
+
+    snprintf(buffer, sizeof(buffer), "POINTS: %d", game->points);
+    draw_string(frame, cache, buffer, 505, 200 + 240 - 55, TEXT_ALIGN_LEFT, highlight_color);
+}
+
+//One batch of consecutive frames, rasterized in parallel and then written in order
+struct Render_Batch
+{
+    Render_Snapshot *snapshots;
+    Frame *frames;
+    Image overlay;
+    Frame background;
+    Text_Cache *cache;
+
+    const char *png_directory;
+    u32 first_frame;
+    std::atomic<int> png_failures;
+};
+
+void render_frame_task(void *data, int task, int)
+{
+    Render_Batch *batch = (Render_Batch *)data;
+    Frame *frame = batch->frames + task;
+    memcpy(frame->pixels, batch->background.pixels, SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(Color));
+    render_game(batch->snapshots + task, frame, batch->cache);
+    if (batch->overlay.pixels)
+    {
+        draw_image(frame, &batch->overlay, 60, 75);
+    }
+
+    if (batch->png_directory)
+    {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/frame_%06u.png", batch->png_directory, batch->first_frame + task);
+        SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(frame->pixels, SCREEN_WIDTH, SCREEN_HEIGHT, 32,
+                                                                  SCREEN_WIDTH * sizeof(Color),
+                                                                  SDL_PIXELFORMAT_RGBA32);
+        if (!surface || IMG_SavePNG(surface, path) != 0)
+        {
+            batch->png_failures.fetch_add(1, std::memory_order_relaxed);
+        }
+        SDL_FreeSurface(surface);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: video_render directory game [--png dir] [--every n] [--threads n]\n");
+        return 1;
+    }
+
+    const char *png_directory = 0;
+    int every = 1;
+    int threads = 0;
+    for (int i = 3;
+         i + 1 < argc;
+         i += 2)
+    {
+        if (strcmp(argv[i], "--png") == 0)
+        {
+            png_directory = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "--every") == 0)
+        {
+            every = max(atoi(argv[i + 1]), 1);
+        }
+        else if (strcmp(argv[i], "--threads") == 0)
+        {
+            threads = atoi(argv[i + 1]);
+        }
+        else
+        {
+            fprintf(stderr, "bad option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (png_directory && !make_directory(png_directory))
+    {
+        fprintf(stderr, "could not create %s\n", png_directory);
+        return 1;
+    }
+#ifdef _WIN32
+    if (!png_directory)
+    {
+        _setmode(_fileno(stdout), _O_BINARY);
+    }
+#endif
+
+    Corpus *corpus = corpus_open_read(argv[1]);
+    if (!corpus)
+    {
+        fprintf(stderr, "could not open corpus %s\n", argv[1]);
+        return 1;
+    }
+    Replay_View view;
+    if (!corpus_replay(corpus, (u32)strtoul(argv[2], 0, 10), &view))
+    {
+        fprintf(stderr, "no game %s in %s\n", argv[2], argv[1]);
+        return 1;
+    }
+
+    if (TTF_Init() < 0 || !(IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG))
+    {
+        fprintf(stderr, "could not initialize SDL_ttf or SDL_image\n");
+        return 2;
+    }
+    Text_Cache *cache = new Text_Cache();
+    cache->font = TTF_OpenFont("font/novem___.ttf", 24);
+    if (!cache->font)
+    {
+        fprintf(stderr, "could not open font/novem___.ttf\n");
+        return 2;
+    }
+
+    Thread_Pool *pool = thread_pool_create(threads);
+    int batch_size = pool->worker_count * 4;
+
+    Render_Batch *batch = new Render_Batch();
+    batch->cache = cache;
+    batch->png_directory = png_directory;
+    batch->png_failures.store(0, std::memory_order_relaxed);
+    batch->snapshots = (Render_Snapshot *)malloc(batch_size * sizeof(Render_Snapshot));
+    batch->frames = (Frame *)malloc(batch_size * sizeof(Frame));
+    for (int i = 0;
+         i < batch_size;
+         ++i)
+    {
+        batch->frames[i].pixels = (Color *)malloc(SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(Color));
+    }
+
+    //The backdrop never changes, so it is composed once and copied into every frame
+    batch->background.pixels = (Color *)calloc(SCREEN_WIDTH * SCREEN_HEIGHT, sizeof(Color));
+    fill_rect(&batch->background, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, color(0x00, 0x00, 0x00, 0xFF));
+    Image backdrop = {};
+    if (load_image("image/Back1.png", SCREEN_WIDTH, SCREEN_HEIGHT, &backdrop))
+    {
+        draw_image(&batch->background, &backdrop, 0, 0);
+        free(backdrop.pixels);
+    }
+    load_image("image/Fix.png", 300, 60, &batch->overlay);
+
+    auto begin = std::chrono::steady_clock::now();
+    Replay_Player player;
+    Game_State game;
+    replay_player_start(&player, &view, &game);
+    u32 frame_count = 0;
+    u32 tick = 0;
+    bool done = false;
+    while (!done)
+    {
+        //Simulating is far cheaper than drawing, so the batch is filled on this thread
+        int count = 0;
+        while (count < batch_size && !done)
+        {
+            if (tick % every == 0)
+            {
+                make_render_snapshot(&game, batch->snapshots + count++);
+            }
+            if (replay_player_step(&player, &game))
+            {
+                ++tick;
+            }
+            else
+            {
+                done = true;
+            }
+        }
+        batch->first_frame = frame_count;
+        thread_pool_run(pool, count, render_frame_task, batch);
+
+        if (!png_directory)
+        {
+            for (int i = 0;
+                 i < count;
+                 ++i)
+            {
+                if (fwrite(batch->frames[i].pixels, sizeof(Color) * SCREEN_WIDTH, SCREEN_HEIGHT, stdout) != SCREEN_HEIGHT)
+                {
+                    fprintf(stderr, "output closed after %u frames\n", frame_count + i);
+                    done = true;
+                    break;
+                }
+            }
+        }
+        frame_count += count;
+    }
+    fflush(stdout);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    fprintf(stderr, "%u frames (%.1f s of play) rendered in %.2f s\n",
+            frame_count, tick * TARGET_SECONDS_PER_FRAME, seconds);
+    int png_failures = batch->png_failures.load(std::memory_order_relaxed);
+    if (png_failures)
+    {
+        fprintf(stderr, "%d frames could not be written\n", png_failures);
+    }
+
+    thread_pool_destroy(pool);
+    for (int i = 0;
+         i < batch_size;
+         ++i)
+    {
+        free(batch->frames[i].pixels);
+    }
+    free(batch->frames);
+    free(batch->snapshots);
+    free(batch->background.pixels);
+    free(batch->overlay.pixels);
+    delete batch;
+    text_cache_free(cache);
+    TTF_CloseFont(cache->font);
+    delete cache;
+    IMG_Quit();
+    TTF_Quit();
+    corpus_close(corpus);
+    return png_failures ? 1 : 0;
+}